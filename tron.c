@@ -7,10 +7,6 @@
 
 
   TODO
-   Bugs
-    * inputing a couple keys really quick (ex: heading right and inputting up->left quickly) results in a death
-
-    * Add more complex AI for computer players
     * flasling light when star is running low
     * Add support for modifying game settings including a more complex start menu
     * Add more items
@@ -22,90 +18,67 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include <SDL3_ttf/SDL_ttf.h>
-#include <SDL3_image/SDL_image.h>
 #include <stdbool.h>
-
-#define GAME_WIDTH  60U
-#define GAME_HEIGHT 40U
-#define BLOCK_SIZE_IN_PIXELS 16
-#define SDL_WINDOW_WIDTH           (BLOCK_SIZE_IN_PIXELS * GAME_WIDTH)
-#define SDL_WINDOW_HEIGHT          (BLOCK_SIZE_IN_PIXELS * GAME_HEIGHT)
-#define BACKGROUND_SCALE 1
-#define STEP_RATE_IN_MILLISECONDS 60
-#define ITEM_RATE_IN_MILLISECONDS 3000
-#define STAR_TIME                 5000
+#include "tron_sim.h"
+#include "tron_ai.h"
+#include "tron_replay.h"
+#include "tron_render.h"
+#include "tron_profile.h"
+#include "tron_net.h"
+#include "tron_spectate.h"
+
+#define MAX_WINDOW_WIDTH     1600 // big arenas get smaller blocks so the window still fits
+#define MAX_WINDOW_HEIGHT    1000
+#define SDL_WINDOW_WIDTH           ((int)SDL_ceilf(block_size * arena_width))
+#define SDL_WINDOW_HEIGHT          ((int)SDL_ceilf(block_size * arena_height))
 #define DEFAULT_VOLUME            0.5
-#define PLAYER_COUNT 4 // Todo - make this customizable
+#define SCRUB_TICKS          16          // left/right while paused, about a second
+#define SCRUB_ALL            SDL_MAX_SINT32 // home/end
+#define MAX_CATCHUP_TICKS    2           // default --max-catchup
+#define MAX_CATCHUP_LIMIT    64
 
 // SDL static variables
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static SDL_AudioDeviceID audio_device = 0;
 
-// Cell on the game board - shows if any player occupies that square
-typedef enum
-{
-    CELL_NOTHING   = 0U,
-    CELL_P1        = 1U,
-    CELL_P2        = 2U,
-    CELL_P3        = 3U,
-    CELL_P4        = 4U,
-    CELL_DEAD      = 5U, 
-    CELL_ITEM_STAR = 6U,
-    CELL_ITEM_BOMB = 7U
-} Cell;
-
-// possible states the game can be in
-typedef enum
-{
-    START = 0U,
-    RUNNING = 1U,
-    PAUSED = 2U,
-    GAME_OVER = 3U
-} State;
-
-// possible effects that a character or game may posses that changes game logic or visuals
-typedef enum
-{
-    NONE       = 0U,
-    INVINSIBLE = 1U
-} Effect;
-
-typedef enum
-{
-    STAR = 0U,
-    BOMB = 1U
-} Item;
-
-// Possible Game Modes
-typedef enum
-{
-    PVP = 0U,
-    PVE = 1U,
-} GameMode;
-
-// represents where the players car head is currently located, and its next direction
-typedef struct
-{
-    int head_xpos;
-    int head_ypos;
-    char next_dir;
-    int player_id;
-    char player_name[20];
-    bool is_human;
-    bool is_alive;
-    bool is_invinsible;
-    Uint64 invinsible_time;
-} CharacterContext;
-
-// possible direction
-typedef enum
-{
-    DIR_RIGHT,
-    DIR_UP,
-    DIR_LEFT,
-    DIR_DOWN
-} CharacterDirection;
+// Arena picked on the command line (--width, --height, --players) and how big a cell is drawn
+static int arena_width = TRON_DEFAULT_WIDTH;
+static int arena_height = TRON_DEFAULT_HEIGHT;
+static int arena_players = TRON_DEFAULT_PLAYERS;
+static float block_size = BLOCK_SIZE_IN_PIXELS;
+// Most steps played in one frame (--max-catchup). Time the frame can't catch up on is carried to the
+// next ones, up to as many steps again, anything past that is dropped and the match slows down instead
+static int max_catchup_ticks = MAX_CATCHUP_TICKS;
+static BoardRenderer board_renderer;
+static HeadMotion head_motion; // the heads a step ago, to draw them moving between steps
+
+// every match played is recorded, --replay FILE plays a recorded one instead
+static ReplayRecorder recorder;
+static Replay replay;
+static bool replay_loaded = false;
+static ReplayTimeline timeline;  // keyframes of the match on screen, for scrubbing while paused
+static Replay live_view;         // the live match as a replay while it is being scrubbed
+static bool scrubbing_live = false;
+
+// where the frames' time goes, F3 shows it and --profile-csv FILE writes every frame to FILE
+static FrameProfiler profiler;
+static bool show_profile = false;
+
+// --host PORT or --join HOST:PORT plays PVP against another copy of the game (tron_net.h), the
+// --net-* options make the link worse for testing. Netplay matches aren't recorded or paused
+static NetSession net = {.socket = {.fd = -1}};
+static bool netplay = false;
+static int host_port = -1;
+static const char *join_address = NULL;
+static NetConditions net_conditions;
+
+// --broadcast PORT streams every match played here to spectators, --watch HOST:PORT is one of them
+// and only shows what it is sent (tron_spectate.h)
+static SpectateServer spectate_server = {.listen_fd = -1};
+static int broadcast_port = -1;
+static SpectateViewer viewer = {.fd = -1};
+static const char *watch_address = NULL;
 
 // Key mapping for which keys belong to which human players (limitation: max 2 humans)
 SDL_Scancode player_keys[2][4] = {
@@ -113,32 +86,20 @@ SDL_Scancode player_keys[2][4] = {
     {SDL_SCANCODE_D, SDL_SCANCODE_A, SDL_SCANCODE_W, SDL_SCANCODE_S}              // Player 2
 };
 
-// Starting off positions for the players (limitation: max 4 players in game)
-int starting_positions[4][2] = {
-    {GAME_WIDTH / 4, GAME_HEIGHT / 2},     // Player 1
-    {3 * GAME_WIDTH / 4, GAME_HEIGHT / 2}, // Player 2
-    {GAME_WIDTH / 4, GAME_HEIGHT / 4},     // Player 3
-    {3 * GAME_WIDTH / 4, GAME_HEIGHT / 4}, // Player 4
-};
+// player_keys the other way around: the human player a key belongs to, -1 for nobody (init_key_players)
+static Sint8 key_players[SDL_SCANCODE_COUNT];
 
-// contains game specific data
+// A human player's key press waiting for the step it falls into (feed_inputs)
 typedef struct
 {
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    CharacterContext character_ctx[PLAYER_COUNT]; // Todo - make this customizable
-    Cell matrix[GAME_WIDTH][GAME_HEIGHT];
-    State state;
-    GameMode game_mode;
-    int total_human_players;
-    int total_computer_players;
-    int remaining_players;
-    char winner[20];
-    Uint64 pause_time;
-    bool is_muted;
-    Uint64 last_step;
-    Uint64 last_item;
-} AppState;
+    Uint64 timestamp; // of the key event, SDL_GetTicksNS() time
+    int player;
+    CharacterDirection dir;
+} TimedInput;
+
+#define MAX_TIMED_INPUTS 32
+static TimedInput timed_inputs[MAX_TIMED_INPUTS]; // oldest first
+static int timed_input_count = 0;
 
 typedef struct
 {
@@ -170,8 +131,6 @@ typedef struct Sound {
 static Sound sounds[3];
 
 // Colors
-static const SDL_Color COLOR_BG                   = {8, 12, 20, SDL_ALPHA_OPAQUE};     // Deep faded blue
-static const SDL_Color COLOR_BG_OUTLINE           = {18, 24, 35, SDL_ALPHA_OPAQUE};    // Subtle grid outline
 static const SDL_Color MENU_COLOR                 = {15,15,35,SDL_ALPHA_OPAQUE};
 static const SDL_Color MENU_OUTLINE_COLOR         = {0,255,255,SDL_ALPHA_OPAQUE};
 static const SDL_Color MENU_TITLE_COLOR           = {255, 255, 255, SDL_ALPHA_OPAQUE};
@@ -180,39 +139,6 @@ static const SDL_Color PAUSE_TITLE_COLOR          = {255, 255, 255, SDL_ALPHA_OP
 static const SDL_Color MENU_MESSAGE_COLOR         = {255, 255, 255, SDL_ALPHA_OPAQUE};
 static const SDL_Color HIGHLIGHTED_MENU_OPT_COLOR = {125, 249, 255, SDL_ALPHA_OPAQUE};
 static const SDL_Color DISABLED_MENU_OPT_COLOR    = {105, 105, 105, SDL_ALPHA_OPAQUE};
-static const SDL_Color COLOR_P1                   = {0, 255, 255, SDL_ALPHA_OPAQUE};    // Cyan (classic Tron)
-static const SDL_Color COLOR_P2                   = {255, 0, 255, SDL_ALPHA_OPAQUE};    // Magenta (cyberpunky)
-static const SDL_Color COLOR_P3                   = {255, 165, 0, SDL_ALPHA_OPAQUE};    // Orange (warm neon)
-static const SDL_Color COLOR_P4                   = {0, 255, 128, SDL_ALPHA_OPAQUE};    // Mint green (futuristic)
-static const SDL_Color COLOR_CRASHED              = {90, 100, 110, SDL_ALPHA_OPAQUE};
-static const SDL_Color COLOR_INVINSIBLE           = {0, 255, 255, SDL_ALPHA_OPAQUE};
-
-// helper to create rectangle objects, x and y coords will be the position on the 2d matrix,
-// but has to be scaled for the window size
-static void set_rect_xy(SDL_FRect *r, short x, short y, short w, short h)
-{
-    r->x = (float)(x * BLOCK_SIZE_IN_PIXELS);
-    r->y = (float)(y * BLOCK_SIZE_IN_PIXELS);
-    r->w = (float)(w);
-    r->h = (float)(h);
-}
-
-// cell in a matrix will be mapped to a player. This maps each player to a sepcific color.
-static const SDL_Color get_color_for_cell(Cell cell) {
-    switch (cell) {
-        case CELL_P1:   return COLOR_P1;
-        case CELL_P2:   return COLOR_P2;
-        case CELL_P3:   return COLOR_P3;
-        case CELL_P4:   return COLOR_P4;
-        case CELL_DEAD: return COLOR_CRASHED;
-        default:        return COLOR_BG;
-    }
-}
-
-// Helper function to set the rendering color instead of manually type RGB values everytime
-void set_sdl_color(SDL_Renderer *renderer, const SDL_Color *color) {
-    SDL_SetRenderDrawColor(renderer, color->r, color->g, color->b, color->a);
-}
 
 // Draw a menu with generic attributes such as a title, a message, background and outline
 static void draw_menu(SDL_Renderer *renderer, Menu menu) {
@@ -274,13 +200,14 @@ static void draw_menu(SDL_Renderer *renderer, Menu menu) {
 }
 
 // Draw the start menu before the core came cycle kicks off
-static void draw_start_menu(SDL_Renderer *renderer, GameMode game_mode, StartMenu start_menu) {
+static void draw_start_menu(SDL_Renderer *renderer, GameMode game_mode, AiType cpu_ai, StartMenu start_menu) {
     SDL_Texture *texture = NULL;
     SDL_Surface *surface = NULL;
     TTF_Font    *font    = NULL;
     SDL_FRect msg_text_rect;
     SDL_Color option_color_1;
     SDL_Color option_color_2;
+    char ai_text_buffer[50];
 
     draw_menu(renderer,start_menu.menu);
 
@@ -319,453 +246,292 @@ static void draw_start_menu(SDL_Renderer *renderer, GameMode game_mode, StartMen
     SDL_RenderTexture(renderer, texture, NULL, &msg_text_rect);
     SDL_DestroyTexture(texture);
     TTF_CloseFont(font);
-}
-
-// sets winner as the player name of the last one standing
-void set_winner(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    CharacterContext ctx;
-    int total_players = as->total_human_players + as->total_computer_players;
-    for(int i = 0; i < total_players; i++) {
-        ctx = as->character_ctx[i];
-        if(ctx.is_alive) {
-            strcpy(as->winner,as->character_ctx[i].player_name);
-        }
-    }
-}
-// Draw background, first thing that will get drawn on every game cycle
-static void draw_background(SDL_Renderer *renderer, const SDL_Color *bg_color, const SDL_Color *bg_outline_color) {
-    SDL_FRect r;
-    set_sdl_color(renderer, bg_color);
-    SDL_RenderClear(renderer);
-    set_sdl_color(renderer, bg_outline_color);
-    for(int i = 0; i < GAME_WIDTH; i += BACKGROUND_SCALE) {
-        for(int j = 0; j < GAME_HEIGHT; j += BACKGROUND_SCALE) {
-            set_rect_xy(&r, i, j, BLOCK_SIZE_IN_PIXELS*BACKGROUND_SCALE, BLOCK_SIZE_IN_PIXELS*BACKGROUND_SCALE);
-            SDL_RenderRect(renderer, &r);
-        }
-    } 
-}
 
-static void draw_item(SDL_Renderer *renderer, int x, int y) {
-    SDL_Texture *texture = NULL;
-    SDL_Surface *surface = NULL;
-    SDL_FRect r;
-    int texture_width = 0;
-    int texture_height = 0;
-    surface = IMG_Load("ressources/sprites/star.png");
-    if (!surface) {
-        SDL_Log("Could not load file: %s", SDL_GetError());
-    }
-    texture_width = surface->w;
-    texture_height = surface->h;
+    // CPU strategy, changed with left/right
+    SDL_snprintf(ai_text_buffer, sizeof(ai_text_buffer), "< CPU: %s >", ai_type_name(cpu_ai));
+    font = TTF_OpenFont("ressources/fonts/Audiowide-Regular.ttf", 18.0f);
+    surface = TTF_RenderText_Blended(font, ai_text_buffer, 0, MENU_MESSAGE_COLOR);
     texture = SDL_CreateTextureFromSurface(renderer, surface);
-    if (!texture) {
-        SDL_Log("Couldn't create static texture: %s", SDL_GetError());
-    }
-    set_rect_xy(&r, x, y, BLOCK_SIZE_IN_PIXELS, BLOCK_SIZE_IN_PIXELS);
-    SDL_RenderTexture(renderer, texture, NULL, &r);
-    SDL_DestroySurface(surface);  /* done with this, the texture has a copy of the pixels now. */
-}
-
-void draw_cell(SDL_Renderer *renderer, Cell cell, int x, int y, Effect effect) {
-    SDL_FRect r;
-    switch(cell) {
-        case CELL_NOTHING:
-            break;
-        case CELL_P1:
-        case CELL_P2:
-        case CELL_P3:
-        case CELL_P4:
-        case CELL_DEAD:{
-            SDL_Color cell_color = get_color_for_cell(cell);
-            set_sdl_color(renderer, &cell_color);
-            set_rect_xy(&r, x, y, BLOCK_SIZE_IN_PIXELS, BLOCK_SIZE_IN_PIXELS);
-            if(effect == INVINSIBLE)
-                SDL_RenderRect(renderer, &r);  
-            else
-                SDL_RenderFillRect(renderer, &r);
-            break;}
-        case CELL_ITEM_STAR:
-            draw_item(renderer,x,y);
-            break;
-        case CELL_ITEM_BOMB:
-            draw_item(renderer,x,y);
-            break;
-        default:
-            SDL_Log("ERROR - unexpected cell: %d\n", cell);
-    }
-}
-
-Effect get_cell_effect(void *appstate, Cell cell) {
-    AppState *as = (AppState *)appstate;
-    Effect effect = NONE;
-    if(cell >= CELL_P1 && cell <= CELL_P4) {
-        if(as->character_ctx[cell-1].is_invinsible)
-            return effect = INVINSIBLE;
-    }
-    return effect;
+    SDL_DestroySurface(surface);
+    SDL_GetTextureSize(texture, &msg_text_rect.w, &msg_text_rect.h);
+    msg_text_rect.x = (SDL_WINDOW_WIDTH - msg_text_rect.w) / 2;
+    msg_text_rect.y = 58 * (SDL_WINDOW_HEIGHT - msg_text_rect.h) / 100;
+    set_sdl_color(renderer, &MENU_MESSAGE_COLOR);
+    SDL_RenderTexture(renderer, texture, NULL, &msg_text_rect);
+    SDL_DestroyTexture(texture);
+    TTF_CloseFont(font);
 }
 
-// Draw each character and their tails on the game board 
-static void draw_game_board(void *appstate) {
+void toggle_mute(void *appstate) {
     AppState *as = (AppState *)appstate;
-    Cell cell;
-    Effect effect = NONE;
-    for (int i = 0; i < GAME_WIDTH; i++) {
-        for (int j = 0; j < GAME_HEIGHT; j++) {
-            cell = as->matrix[i][j];
-            effect = get_cell_effect(as, cell);
-            draw_cell(as->renderer,cell,i,j,effect);
-        }
-    }
+    float volume = 0.0;
+    if(as->is_muted)
+        volume = DEFAULT_VOLUME;
+    as->is_muted = !as->is_muted;
+    SDL_SetAudioDeviceGain(audio_device, volume);
 }
 
-// Spawns an item in a randon unoccupied space
-void spawn_item(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    int x_coord = SDL_rand(GAME_WIDTH);
-    int y_coord = SDL_rand(GAME_HEIGHT);
-    Cell cell = as->matrix[x_coord][y_coord];
-    while(cell != CELL_NOTHING) {
-        x_coord = SDL_rand(GAME_WIDTH);
-        y_coord = SDL_rand(GAME_HEIGHT);
-        cell = as->matrix[x_coord][y_coord];
+// Move the match on screen by ticks (negative to rewind) from the pause or game over screen. A replay
+// carries on from there when unpaused, a live match goes back to where it was left
+static void scrub(AppState *as, Sint64 ticks) {
+    Replay *seeking = replay_loaded ? &replay : &live_view;
+    if(!replay_loaded && !scrubbing_live) {
+        replay_view_recording(&live_view, &recorder);
+        scrubbing_live = true;
     }
-    as->matrix[x_coord][y_coord] = CELL_ITEM_STAR + SDL_rand(1);
-}
-
-// checks if player collided with another player
-bool collides_with_player(Cell matrix[GAME_WIDTH][GAME_HEIGHT], int x, int y) {
-    if(matrix[x][y] >= CELL_P1 && matrix[x][y] <= CELL_DEAD)
-        return true;
-    return false;
-}
-
-// Check if player collided with a wall
-bool collides_with_wall(Cell matrix[GAME_WIDTH][GAME_HEIGHT], int x, int y) {
-    if(x < 0 || x >= GAME_WIDTH || y < 0 || y >= GAME_HEIGHT)
-        return true;
-    return false;
+    Uint64 target = ticks < 0 ? as->tick - SDL_min((Uint64)-ticks, as->tick) : as->tick + (Uint64)ticks;
+    // the simulation only steps running matches, the seek leaves it RUNNING or GAME_OVER
+    if(as->state == PAUSED)
+        as->state = RUNNING;
+    if(!replay_seek(seeking, as, target))
+        SDL_Log("Couldn't seek to tick %" SDL_PRIu64 ": %s", target, SDL_GetError());
+    if(as->state == RUNNING)
+        as->state = PAUSED;
+    as->events = SIM_EVENT_NONE;
 }
 
-// Checks if player collided with a wall or another player's tail
-bool is_collision(Cell matrix[GAME_WIDTH][GAME_HEIGHT], int x, int y) {
-    if(collides_with_wall(matrix,x,y))
-        return true;
-    if(collides_with_player(matrix,x,y))
-        return true;
-    return false;
+// Put a scrubbed live match back at its last tick, ready to carry on
+static void stop_scrubbing(AppState *as) {
+    if(!scrubbing_live)
+        return;
+    as->state = RUNNING;
+    if(!replay_seek(&live_view, as, recorder.header.ticks))
+        SDL_Log("Couldn't get back to the match: %s", SDL_GetError());
+    as->scripted = false;
+    as->events = SIM_EVENT_NONE;
+    replay_close(&live_view);
+    scrubbing_live = false;
 }
 
-// Returns the number of empty cells in a single direction from a particular location
-int get_path_length(Cell matrix[GAME_WIDTH][GAME_HEIGHT], int x, int y, CharacterDirection direction) {
-   int path_length = 0;
-   int x_increment = 0;
-   int y_increment = 0;
-   switch (direction) {
-    case DIR_RIGHT:
-        x_increment = 1;
-        break;
-    case DIR_UP:
-        y_increment = -1;
-        break;
-    case DIR_LEFT:
-        x_increment =  -1;
-        break;
-    case DIR_DOWN:
-        y_increment = 1;
-        break;
-    default:
-        SDL_Log("ERROR - Invalid direction");
-        break;
-    }
+// Pause and unpause the game depending on current state
+void toggle_pause(void *appstate) {
+    AppState *as = (AppState *)appstate;
 
-    x += x_increment;
-    y += y_increment;
-    bool collision = is_collision(matrix,x,y);
-    while(!collision) {
-        path_length++;
-        x += x_increment;
-        y += y_increment;
-        collision = is_collision(matrix,x,y);
+    if(as->state == RUNNING) {
+        // Pausing
+        as->pause_time = SDL_GetTicksNS();
+        as->state = PAUSED;
+    } else if(as->state == PAUSED) {
+        // Unpausing - shift last_step forward to ignore time spent paused
+        Uint64 now = SDL_GetTicksNS();
+        Uint64 paused_duration = now - as->pause_time;
+        as->last_step += paused_duration;
+        as->state = RUNNING;
+        stop_scrubbing(as);
+    } else {
+        // do nothing
     }
-    return path_length;
 }
 
-// Picks a direction for the computer - currently checks with the direction with the most uninterupted cells
-CharacterDirection pick_next_dir(Cell matrix[GAME_WIDTH][GAME_HEIGHT], int head_xpos, int head_ypos, CharacterDirection curr_dir) {
-    char next_dir = curr_dir;
-    int longest_path = 0;
-
-    for(int i = 0; i < 4; i++) {
-        //Can't go backwards
-        if((curr_dir == DIR_LEFT  && i == DIR_RIGHT) ||
-           (curr_dir == DIR_RIGHT && i == DIR_LEFT)  ||
-           (curr_dir == DIR_UP    && i == DIR_DOWN)  ||
-           (curr_dir == DIR_DOWN  && i == DIR_UP)) {
-            continue;
-        }
-
-        int current_run = get_path_length(matrix, head_xpos, head_ypos, (CharacterDirection)i);
-        if(current_run > longest_path) {
-            longest_path = current_run;
-            next_dir = (CharacterDirection)i;
-        }
+// Start a netplay match: the host picks the seed and tells the client, the client starts the one
+// the host announced (net.start)
+static void start_net_match(AppState *as) {
+    if(!net.connected)
+        return;
+    if(net.is_host) {
+        as->seed = ((Uint64)SDL_rand_bits() << 32) | SDL_rand_bits();
+        as->board_width = arena_width;
+        as->board_height = arena_height;
+    } else if(net.start.width != arena_width || net.start.height != arena_height) {
+        SDL_Log("The host plays on %dx%d, start with --width %d --height %d to join",
+                net.start.width, net.start.height, net.start.width, net.start.height);
+        return;
     }
-    return next_dir;
-}
-
-// Moves player forward one unit in a particular direction
-void move_head(CharacterContext *ctx) {
-    // Move head forward
-    switch (ctx->next_dir) {
-        case DIR_RIGHT:
-            ctx->head_xpos++;
-            break;
-        case DIR_UP:
-            ctx->head_ypos--;
-            break;
-        case DIR_LEFT:
-            ctx->head_xpos--;
-            break;
-        case DIR_DOWN:
-            ctx->head_ypos++;
-            break;
-        default:
-            break;
+    as->scripted = false;
+    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "netplay match seed %" SDL_PRIu64, as->seed);
+    if(!net_start_match(&net, as, net.is_host ? arena_players : net.start.players)) {
+        SDL_Log("Couldn't start the match: %s", SDL_GetError());
+        return;
     }
+    timed_input_count = 0;
+    latency_reset(&profiler.latency);
+    as->last_step = SDL_GetTicksNS();
+    if(broadcast_port >= 0)
+        spectate_begin(&spectate_server, as);
 }
 
-void handle_collision(void *appstate, int player_id) {
+// Kick off the core game cycle
+void start_game(void *appstate) {
     AppState *as = (AppState *)appstate;
 
-    int index = -1;
-    for(int i = 0; i < PLAYER_COUNT; i++) {
-        if(as->character_ctx[i].player_id == player_id) {
-            index = i;
-            break;
-        }
+    if(scrubbing_live) {
+        replay_close(&live_view);
+        scrubbing_live = false;
     }
-
-    as->character_ctx[index].is_alive = false;
-    as->remaining_players--; 
-
-    for(int i = 0; i < GAME_WIDTH; i++) {
-        for(int j = 0; j < GAME_HEIGHT; j++) {
-            if(as->matrix[i][j] == (Cell) player_id)
-                as->matrix[i][j] = CELL_DEAD;
+    if(replay_loaded) {
+        if(!replay_begin(&replay, as)) {
+            SDL_Log("Couldn't start the replay: %s", SDL_GetError());
+            return;
         }
+        as->last_step = SDL_GetTicksNS();
+        if(broadcast_port >= 0)
+            spectate_begin(&spectate_server, as);
+        return;
     }
-
-    if (SDL_GetAudioStreamQueued(sounds[1].stream) < ((int) sounds[1].wav_data_len)) {
-        SDL_PutAudioStreamData(sounds[1].stream, sounds[1].wav_data, (int) sounds[1].wav_data_len);
-    }
-
-}
-
-// Handle any special events
-void on_player_touch(void *appstate, CharacterContext *ctx, Cell cell) {
-    AppState *as = (AppState *)appstate;
-    Uint64 now = SDL_GetTicks();
-    switch(cell) {
-        case CELL_NOTHING:
-            break;
-        case CELL_P1:
-        case CELL_P2:
-        case CELL_P3:
-        case CELL_P4:
-            break;
-        case CELL_DEAD:
-            break;
-        case CELL_ITEM_STAR:
-            as->matrix[ctx->head_xpos][ctx->head_ypos] = ctx->player_id; //replace star with player block
-            ctx->is_invinsible = true;
-            ctx->invinsible_time = now;
-            if (SDL_GetAudioStreamQueued(sounds[2].stream) < ((int) sounds[2].wav_data_len)) {
-                SDL_PutAudioStreamData(sounds[2].stream, sounds[2].wav_data, (int) sounds[2].wav_data_len);
-            }
-            break;
-        default:
-            SDL_Log("ERROR - unexpected cell: %d\n", cell);
+    // the client waits for the host to start
+    if(netplay) {
+        if(net.is_host)
+            start_net_match(as);
+        return;
     }
-}
 
-// Checks what direction player has inputed, updates position and checks for collision
-void move_player(CharacterContext *ctx, void *appstate) {
-    AppState *as = (AppState *)appstate;
-    
-    if (collides_with_wall(as->matrix,ctx->head_xpos, ctx->head_ypos)) {
-        SDL_Log("ERROR - The player: %d moved out of bounds at an unexpected time \n", ctx->player_id);
-    }
-
-    // if player is a computer, determine which direction go
-    if(!ctx->is_human) {
-        ctx->next_dir = pick_next_dir(as->matrix, ctx->head_xpos, ctx->head_ypos, ctx->next_dir);
-    }
-
-    move_head(ctx);
-    Cell new_cell = as->matrix[ctx->head_xpos][ctx->head_ypos];
-
-    // check if the player crashed - when player has star power they can only crash with wall
-    bool crashed = false;
-    if(ctx->is_invinsible) {
-        crashed = collides_with_wall(as->matrix,ctx->head_xpos, ctx->head_ypos);
-    } else {
-        crashed = is_collision(as->matrix,ctx->head_xpos, ctx->head_ypos);
+    // Set the number of players and computers
+    int humans = as->game_mode == PVP ? 2 : 1;
+    // a fresh seed every match, logged so an interesting match can be played again
+    as->seed = ((Uint64)SDL_rand_bits() << 32) | SDL_rand_bits();
+    as->scripted = false;
+    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "match seed %" SDL_PRIu64, as->seed);
+    if(!sim_init_match(as, humans, arena_players - humans)) {
+        SDL_Log("Couldn't start the match: %s", SDL_GetError());
+        return;
     }
+    replay_record_begin(&recorder, as);
+    timed_input_count = 0;
+    latency_reset(&profiler.latency);
+    if(broadcast_port >= 0)
+        spectate_begin(&spectate_server, as);
 
-    if(crashed) {
-        handle_collision(as, ctx->player_id);
-    } else {
-        // update player position on the board and handle any special cases such as items
-        as->matrix[ctx->head_xpos][ctx->head_ypos] = ctx->player_id;
-        on_player_touch(as, ctx, new_cell);
-    }
+    as->last_step  = SDL_GetTicksNS();
 }
 
-// start time 
-// now 1500ms since start
-// invinsible time 1000ms since start
-// 1500 - 1000 = 500ms 
-// update the player status such as invulnerable
-void handle_invinsible(CharacterContext *ctx){
-    Uint64 now = SDL_GetTicks();
-    if(ctx->is_invinsible == true) {
-        if(now - ctx->invinsible_time > STAR_TIME) {
-            ctx->is_invinsible = false;
-        }
+// Save the finished match to replays/ in the user's pref folder, named after its seed
+static void save_replay(AppState *as) {
+    char *pref_path = SDL_GetPrefPath("tron", "tron");
+    char *dir = NULL;
+    char *path = NULL;
+    replay_record_end(&recorder, as);
+    if(pref_path && SDL_asprintf(&dir, "%sreplays", pref_path) > 0 && SDL_CreateDirectory(dir) &&
+       SDL_asprintf(&path, "%s/%016" SDL_PRIx64 ".trpl", dir, as->seed) > 0 && replay_save(&recorder, path)) {
+        SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "replay saved to %s", path);
+    } else {
+        SDL_Log("Couldn't save the replay: %s", SDL_GetError());
     }
+    SDL_free(path);
+    SDL_free(dir);
+    SDL_free(pref_path);
 }
 
-// Update the positions of all players in the game if they are still alive
-void move_characters(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    CharacterContext *ctx;
-    int total_players = as->total_human_players + as->total_computer_players;
-
-    for(int i = 0; i < total_players; i++) {
-        ctx = &as->character_ctx[i];
-        if(ctx->is_alive) {
-            handle_invinsible(ctx); //check invinsible status, and update if it should end
-            move_player(ctx, as); // update player position
+// Advance the match by one tick: the next tick of the replay, a netplay one, or a live one that gets
+// recorded. False when netplay has to wait for the other side's inputs
+static bool step_match(AppState *as) {
+    if(replay_loaded) {
+        if(!replay_step(&replay, as) && !sim_is_over(as)) {
+            SDL_Log("The replay stopped at tick %" SDL_PRIu64 ": %s", as->tick, SDL_GetError());
+            as->state = START;
         }
+        return true;
     }
+    if(netplay)
+        return net_step(&net, as);
+    sim_step(as);
+    replay_record_tick(&recorder, as);
+    if(sim_is_over(as))
+        save_replay(as);
+    return true;
 }
 
-void toggle_mute(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    float volume = 0.0;
-    if(as->is_muted)
-        volume = DEFAULT_VOLUME;
-    as->is_muted = !as->is_muted;
-    SDL_SetAudioDeviceGain(audio_device, volume);
+// Hold on to a human player's key press until the step it falls into runs
+static void queue_input(AppState *as, int player, CharacterDirection dir, Uint64 timestamp) {
+    if(player < 0 || as->state != RUNNING || timed_input_count == MAX_TIMED_INPUTS)
+        return;
+    timed_inputs[timed_input_count++] = (TimedInput){timestamp, player, dir};
 }
 
-// Pause and unpause the game depending on current state
-void toggle_pause(void *appstate) {
-    AppState *as = (AppState *)appstate;
-
-    if(as->state == RUNNING) {
-        // Pausing
-        as->pause_time = SDL_GetTicks();
-        as->state = PAUSED;
-    } else if(as->state == PAUSED) {
-        // Unpausing - shift last_step forward to ignore time spent paused
-        Uint64 now = SDL_GetTicks();
-        Uint64 paused_duration = now - as->pause_time;
-        as->last_step += paused_duration;
-        as->state = RUNNING;
-    } else {
-        // do nothing
+// Hand the simulation every key press made before due, the time the next step is due at. A press
+// made after it was due belongs to the step after that one, even when both run in the same frame
+static void feed_inputs(AppState *as, Uint64 due) {
+    int fed = 0;
+    while(fed < timed_input_count && timed_inputs[fed].timestamp < due) {
+        TimedInput *input = &timed_inputs[fed++];
+        bool queued = netplay ? net_local_input(&net, input->dir) : sim_set_input(as, input->player, input->dir);
+        if(queued)
+            latency_turn_queued(&profiler.latency, input->player, input->timestamp);
     }
+    timed_input_count -= fed;
+    SDL_memmove(timed_inputs, &timed_inputs[fed], timed_input_count * sizeof(TimedInput));
 }
 
-// Reset the game board so that each cell is empty
-void initialize_game_board(Cell matrix[GAME_WIDTH][GAME_HEIGHT]) {
-    for(int i = 0; i < GAME_WIDTH; i++) {
-        for(int j = 0; j < GAME_HEIGHT; j++) {
-            matrix[i][j] = CELL_NOTHING;
-        }
-    }
+// Turns of a human player still waiting for a step
+static int queued_turns(const AppState *as, int player) {
+    if(netplay)
+        return player == net.local_player ? net.queued_count : 0;
+    return as->character_ctx[player].queued_count;
 }
 
-// Create required amount of characters, determine their starting positions, directions and attributes
-void initialize_characters(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    int humans_added = 0;
-    int computers_added = 0;
-    int total_players = as->total_human_players + as->total_computer_players;
-    for(int i = 0; i < total_players; i++) {
-
-        // Add the character, set is_human and the player name
-        if(humans_added < as->total_human_players) {
-            as->character_ctx[i].is_human = true;
-            humans_added++;
-            sprintf(as->character_ctx[i].player_name, "P%d", humans_added);
-        } else {
-            as->character_ctx[i].is_human = false;
-            computers_added++;
-            sprintf(as->character_ctx[i].player_name, "CPU%d", computers_added);
-        }
-
-        // alive enabled
-        as->character_ctx[i].is_alive = true;
-
-        // Set starting positions
-        as->character_ctx[i].head_xpos = starting_positions[i][0];
-        as->character_ctx[i].head_ypos = starting_positions[i][1];
-
-        // Set player IDs
-        as->character_ctx[i].player_id = computers_added + humans_added;
-        
-        // players can use items to be come temporarirly invsible
-        as->character_ctx[i].is_invinsible = false;
-
-        // mark the first spot on game board
-        as->matrix[as->character_ctx[i].head_xpos][as->character_ctx[i].head_ypos] = as->character_ctx[i].player_id;
-
-        // Set starting direction
-        switch (i) {
-        case 0:
-            as->character_ctx[i].next_dir = DIR_RIGHT;
-            break;
-        case 1:
-            as->character_ctx[i].next_dir = DIR_LEFT;
+// Play the steps that are due, each with the key presses that came before it was due. Runs first
+// thing in a frame so a step never waits for the frame's drawing.
+//
+// After a stall (a window drag, a debugger, a slow present) a lot of steps are due at once, playing
+// them all in one go would move everybody several cells before anyone sees a frame. So a frame plays
+// at most max_catchup_ticks of them and the rest wait for the next frames, which catch up a bit each.
+// How far behind the clock can fall is bounded too: steps due more than max_catchup_ticks past the
+// ones this frame played are dropped, the clock moves on without them and the match plays on in
+// slow motion rather than bursting ahead once the stall is over.
+//
+// In netplay the side that is ahead of the other puts its next step off by an eighth of a step until
+// they meet, and a step waiting for the other side's inputs stays due, see tron_net.h
+static void run_due_steps(AppState *as) {
+    Uint64 now = SDL_GetTicksNS();
+    int played = 0;
+    int late = 0;
+    while(as->state == RUNNING && now - as->last_step >= STEP_RATE_IN_NS && played < max_catchup_ticks) {
+        Uint64 due = as->last_step + STEP_RATE_IN_NS;
+        if(netplay && net_ticks_ahead(&net, as) > 0) {
+            as->last_step += STEP_RATE_IN_NS / 8;
             break;
-        case 2:
-            as->character_ctx[i].next_dir = DIR_UP;
-            break;
-        case 3:
-            as->character_ctx[i].next_dir = DIR_DOWN;
-            break;
-        default:
-            SDL_Log("ERROR - Invalid player id: %d\n", i);
+        }
+        int humans = SDL_min(as->total_human_players, LATENCY_PLAYERS);
+        int queued[LATENCY_PLAYERS];
+        // a whole step or more behind when it runs
+        if(now - due >= STEP_RATE_IN_NS)
+            late++;
+        feed_inputs(as, due);
+        for(int i = 0; i < humans; i++) {
+            queued[i] = queued_turns(as, i);
+        }
+        render_remember_heads(&head_motion, as);
+        if(!step_match(as))
             break;
+        if(broadcast_port >= 0)
+            spectate_tick(&spectate_server, as);
+        played++;
+        now = SDL_GetTicksNS();
+        for(int i = 0; i < humans; i++) {
+            latency_turns_taken(&profiler.latency, i, queued[i] - queued_turns(as, i), now);
         }
+        as->last_step = due;
     }
+
+    Uint64 dropped = 0;
+    if(as->state == RUNNING && now - as->last_step >= STEP_RATE_IN_NS) {
+        Uint64 behind = (now - as->last_step) / STEP_RATE_IN_NS;
+        if(behind > (Uint64)max_catchup_ticks) {
+            dropped = behind - max_catchup_ticks;
+            as->last_step += dropped * STEP_RATE_IN_NS;
+        }
+    }
+    profile_count_ticks(&profiler, played, late, dropped);
 }
 
-// Kick off the core game cycle
-void start_game(void *appstate) {
-    AppState *as = (AppState *)appstate;
-    initialize_game_board(as->matrix);
-    as->state = RUNNING;
-    as->last_step  = SDL_GetTicks();
-    as->last_item  = SDL_GetTicks();
+// How far the frame is from the last step to the next one, 0 to 1
+static float step_fraction(const AppState *as) {
+    Uint64 since = SDL_GetTicksNS() - as->last_step;
+    return since >= STEP_RATE_IN_NS ? 1.0f : (float)since / STEP_RATE_IN_NS;
+}
 
-    // Set the number of players and computers
-    if(as->game_mode == PVP) {
-        as->total_human_players = 2;                 // Todo - make this customizable
-        as->total_computer_players = PLAYER_COUNT-2; // Todo - make this customizable
-    } else {
-        as->total_human_players = 1;                  // Todo - make this customizable
-        as->total_computer_players = PLAYER_COUNT -1; // Todo - make this customizable
+// Queue sound effects for anything that happened in the simulation since the last frame
+static void play_sim_events(AppState *as) {
+    if (as->events & SIM_EVENT_CRASH) {
+        if (SDL_GetAudioStreamQueued(sounds[1].stream) < ((int) sounds[1].wav_data_len)) {
+            SDL_PutAudioStreamData(sounds[1].stream, sounds[1].wav_data, (int) sounds[1].wav_data_len);
+        }
     }
- 
-    as->remaining_players = as->total_human_players + as->total_computer_players;
-
-    initialize_characters(as);
+    if (as->events & SIM_EVENT_STAR) {
+        if (SDL_GetAudioStreamQueued(sounds[2].stream) < ((int) sounds[2].wav_data_len)) {
+            SDL_PutAudioStreamData(sounds[2].stream, sounds[2].wav_data, (int) sounds[2].wav_data_len);
+        }
+    }
+    as->events = SIM_EVENT_NONE;
 }
 
 static bool init_sound(const char *fname, Sound *sound)
@@ -798,20 +564,61 @@ static bool init_sound(const char *fname, Sound *sound)
 }
 
 
-// map key presses to specific characters and game controls such as pause, reset, enter etc.
-static SDL_AppResult handle_key_event(void *appstate, SDL_Scancode key_code) {
-    AppState *as = (AppState *)appstate;
-    CharacterContext *ctx = NULL;
+// Ticks a key scrubs by on the pause and game over screens, 0 for any other key
+static Sint64 scrub_ticks(SDL_Scancode key_code) {
+    switch (key_code) {
+    case SDL_SCANCODE_LEFT:
+    case SDL_SCANCODE_A:
+        return -SCRUB_TICKS;
+    case SDL_SCANCODE_RIGHT:
+    case SDL_SCANCODE_D:
+        return SCRUB_TICKS;
+    case SDL_SCANCODE_PAGEUP:
+        return -REPLAY_KEYFRAME_TICKS;
+    case SDL_SCANCODE_PAGEDOWN:
+        return REPLAY_KEYFRAME_TICKS;
+    case SDL_SCANCODE_HOME:
+        return -SCRUB_ALL;
+    case SDL_SCANCODE_END:
+        return SCRUB_ALL;
+    default:
+        return 0;
+    }
+}
 
-    // find out which player's key was pressed if any
-    for(int i = 0; i < as->total_human_players; i++) {
+static void init_key_players(void) {
+    SDL_memset(key_players, -1, sizeof(key_players));
+    for(int i = 0; i < (int)SDL_arraysize(player_keys); i++) {
         for(int j = 0; j < 4; j++) {
-            if(player_keys[i][j] == key_code) {
-                ctx = &as->character_ctx[i];
-                break;
-            }
+            key_players[player_keys[i][j]] = (Sint8)i;
+        }
+    }
+}
+
+// map key presses to specific characters and game controls such as pause, reset, enter etc.
+static SDL_AppResult handle_key_event(void *appstate, SDL_Scancode key_code, Uint64 timestamp) {
+    AppState *as = (AppState *)appstate;
+    int player = -1;
+
+    // spectators can only watch, mute and leave
+    if(watch_address && key_code != SDL_SCANCODE_ESCAPE && key_code != SDL_SCANCODE_Q &&
+       key_code != SDL_SCANCODE_M && key_code != SDL_SCANCODE_F3)
+        return SDL_APP_CONTINUE;
+
+    if(!netplay && (as->state == PAUSED || as->state == GAME_OVER)) {
+        Sint64 ticks = scrub_ticks(key_code);
+        if(ticks != 0) {
+            scrub(as, ticks);
+            return SDL_APP_CONTINUE;
         }
     }
+
+    // find out which player's key was pressed if any, nobody steers a replay
+    if(!replay_loaded && key_code < SDL_SCANCODE_COUNT && key_players[key_code] < as->total_human_players)
+        player = key_players[key_code];
+    // in netplay both sets of keys steer the player on this side
+    if(netplay && player >= 0)
+        player = net.local_player;
     switch (key_code) {
     /* Start the game. */
     case SDL_SCANCODE_KP_ENTER:
@@ -834,49 +641,274 @@ static SDL_AppResult handle_key_event(void *appstate, SDL_Scancode key_code) {
     /* Decide new direction of the character. */
     case SDL_SCANCODE_RIGHT:
     case SDL_SCANCODE_D:
-        if(as->state == RUNNING && ctx && ctx->next_dir != DIR_LEFT) {
-            ctx->next_dir = DIR_RIGHT;
+        if(as->state == START && !netplay) {
+            as->cpu_ai = (as->cpu_ai + 1) % AI_TYPE_COUNT;
         }
+        queue_input(as, player, DIR_RIGHT, timestamp);
         break;
     case SDL_SCANCODE_UP:
     case SDL_SCANCODE_W:
-        if(as->state == START) {
+        if(as->state == START && !netplay) {
             as->game_mode ^= 1U;
         }
-        if(as->state == RUNNING && ctx && ctx->next_dir != DIR_DOWN) {
-            ctx->next_dir = DIR_UP;
-        }
+        queue_input(as, player, DIR_UP, timestamp);
         break;
     case SDL_SCANCODE_LEFT:
     case SDL_SCANCODE_A:
-        if(as->state == RUNNING && ctx && ctx->next_dir != DIR_RIGHT) {
-            ctx->next_dir = DIR_LEFT;
+        if(as->state == START && !netplay) {
+            as->cpu_ai = (as->cpu_ai + AI_TYPE_COUNT - 1) % AI_TYPE_COUNT;
         }
+        queue_input(as, player, DIR_LEFT, timestamp);
         break;
     case SDL_SCANCODE_DOWN:
     case SDL_SCANCODE_S:
-        if(as->state == START) {
+        if(as->state == START && !netplay) {
             as->game_mode ^= 1U;
         }
-        if(as->state == RUNNING && ctx && ctx->next_dir != DIR_UP) {
-            ctx->next_dir = DIR_DOWN;
-        }
+        queue_input(as, player, DIR_DOWN, timestamp);
         break;
     /* Pause the game. */
     case SDL_SCANCODE_P:
-        toggle_pause(as);
+        if(!netplay)
+            toggle_pause(as);
         break;
     case SDL_SCANCODE_M:
         toggle_mute(as);
+        break;
+    /* Frame profile overlay. */
+    case SDL_SCANCODE_F3:
+        show_profile = !show_profile;
+        break;
     default:
         break;
     }
     return SDL_APP_CONTINUE;
 }
 
+// --width N, --height N and --players N pick the arena, --replay FILE takes it from a recorded match.
+// --profile-csv FILE writes the frame profile. --host PORT and --join HOST:PORT play netplay, with
+// --net-latency MS, --net-jitter MS and --net-loss PERCENT added to the link. --broadcast PORT streams
+// the matches to spectators and --watch HOST:PORT watches one. Returns false on anything it doesn't understand
+static bool parse_arena_args(int argc, char *argv[]) {
+    for(int i = 1; i < argc; i++) {
+        int *target = NULL;
+        if(SDL_strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            const char *path = argv[++i];
+            if(!replay_open(&replay, path)) {
+                SDL_Log("Couldn't open %s: %s", path, SDL_GetError());
+                return false;
+            }
+            replay_loaded = true;
+            replay.timeline = &timeline;
+            arena_width = replay.header.width;
+            arena_height = replay.header.height;
+            arena_players = replay.header.players;
+            continue;
+        }
+        if(SDL_strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+            const char *path = argv[++i];
+            if(!profile_open_csv(&profiler, path)) {
+                SDL_Log("Couldn't open %s: %s", path, SDL_GetError());
+                return false;
+            }
+            continue;
+        }
+        if(SDL_strcmp(argv[i], "--join") == 0 && i + 1 < argc) {
+            join_address = argv[++i];
+            continue;
+        }
+        if(SDL_strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch_address = argv[++i];
+            continue;
+        }
+        if(SDL_strcmp(argv[i], "--width") == 0)
+            target = &arena_width;
+        else if(SDL_strcmp(argv[i], "--height") == 0)
+            target = &arena_height;
+        else if(SDL_strcmp(argv[i], "--players") == 0)
+            target = &arena_players;
+        else if(SDL_strcmp(argv[i], "--max-catchup") == 0)
+            target = &max_catchup_ticks;
+        else if(SDL_strcmp(argv[i], "--host") == 0)
+            target = &host_port;
+        else if(SDL_strcmp(argv[i], "--net-latency") == 0)
+            target = &net_conditions.latency_ms;
+        else if(SDL_strcmp(argv[i], "--net-jitter") == 0)
+            target = &net_conditions.jitter_ms;
+        else if(SDL_strcmp(argv[i], "--net-loss") == 0)
+            target = &net_conditions.loss_percent;
+        else if(SDL_strcmp(argv[i], "--broadcast") == 0)
+            target = &broadcast_port;
+        if(!target || i + 1 >= argc) {
+            SDL_Log("Usage: %s [--width %d-%d] [--height %d-%d] [--players 2-%d] [--replay FILE] [--profile-csv FILE] [--max-catchup 1-%d]"
+                    " [--host PORT | --join HOST:PORT] [--net-latency MS] [--net-jitter MS] [--net-loss PERCENT] [--broadcast PORT | --watch HOST:PORT]",
+                    argv[0], BOARD_MIN_SIZE, BOARD_MAX_SIZE, BOARD_MIN_SIZE, BOARD_MAX_SIZE, MAX_PLAYERS, MAX_CATCHUP_LIMIT);
+            return false;
+        }
+        *target = SDL_atoi(argv[++i]);
+    }
+    if(arena_width < BOARD_MIN_SIZE || arena_width > BOARD_MAX_SIZE || arena_height < BOARD_MIN_SIZE ||
+       arena_height > BOARD_MAX_SIZE || (!replay_loaded && (arena_players < 2 || arena_players > MAX_PLAYERS))) {
+        SDL_Log("Arena out of range: %dx%d with %d players", arena_width, arena_height, arena_players);
+        return false;
+    }
+    if(max_catchup_ticks < 1 || max_catchup_ticks > MAX_CATCHUP_LIMIT) {
+        SDL_Log("--max-catchup out of range: %d", max_catchup_ticks);
+        return false;
+    }
+    netplay = host_port >= 0 || join_address;
+    if(netplay && (replay_loaded || (host_port >= 0 && join_address) || host_port > 65535)) {
+        SDL_Log("Netplay takes one of --host PORT (0-65535) or --join HOST:PORT, and no --replay");
+        return false;
+    }
+    if(net_conditions.latency_ms < 0 || net_conditions.jitter_ms < 0 || net_conditions.loss_percent < 0 ||
+       net_conditions.loss_percent > 100) {
+        SDL_Log("--net-latency, --net-jitter and --net-loss out of range");
+        return false;
+    }
+    if(broadcast_port > 65535 || (watch_address && (broadcast_port >= 0 || netplay || replay_loaded))) {
+        SDL_Log("--broadcast takes a port (0-65535), --watch HOST:PORT plays nothing itself");
+        return false;
+    }
+    block_size = SDL_min((float)MAX_WINDOW_WIDTH / arena_width, (float)MAX_WINDOW_HEIGHT / arena_height);
+    block_size = SDL_min(block_size, BLOCK_SIZE_IN_PIXELS);
+    return true;
+}
+
+// Host or join as the command line said
+static bool open_net_session(void) {
+    NetAddress address;
+    bool opened;
+    if(!net_init()) {
+        SDL_Log("Couldn't start networking: %s", SDL_GetError());
+        return false;
+    }
+    if(join_address)
+        opened = net_resolve(join_address, &address) && net_join(&net, &address, &net_conditions);
+    else
+        opened = net_host(&net, (Uint16)host_port, &net_conditions);
+    if(!opened) {
+        SDL_Log("Couldn't %s: %s", join_address ? "join" : "host", SDL_GetError());
+        return false;
+    }
+    if(!join_address)
+        SDL_Log("Hosting on port %d", net.socket.port);
+    return true;
+}
+
+// Write the match as it was on the tick the hashes first differed to the pref folder, the other side
+// writes its own for the tick it noticed (usually the same or the next). When that tick is no longer
+// kept the match as it is now is written instead
+static void dump_desync(AppState *as) {
+    AppState then;
+    bool kept = net_match_at(&net, as, net.desync_tick, &then);
+    const AppState *dumped = kept ? &then : as;
+    char *pref_path = SDL_GetPrefPath("tron", "tron");
+    char *path = NULL;
+    SDL_Log("Out of sync with the other side since tick %" SDL_PRIu64, net.desync_tick);
+    if(pref_path && SDL_asprintf(&path, "%sdesync-%016" SDL_PRIx64 "-%" SDL_PRIu64 "-%s.txt", pref_path, as->seed,
+                                 dumped->tick, net.is_host ? "host" : "client") > 0) {
+        SDL_IOStream *io = SDL_IOFromFile(path, "w");
+        bool written = io && sim_dump(dumped, io);
+        if(io && !SDL_CloseIO(io))
+            written = false;
+        if(written)
+            SDL_Log("The match at tick %" SDL_PRIu64 " is in %s", dumped->tick, path);
+        else
+            SDL_Log("Couldn't write %s: %s", path, SDL_GetError());
+    }
+    if(kept)
+        sim_free(&then);
+    SDL_free(path);
+    SDL_free(pref_path);
+}
+
+// Everything the other side sent: a player joining, a match the host started, a lost connection, a
+// match that stopped being the same on both sides
+static void poll_net(AppState *as) {
+    switch(net_poll(&net, as)) {
+    case NET_EVENT_JOINED:
+        SDL_Log("%s", net.is_host ? "A player joined" : "Joined the host");
+        break;
+    case NET_EVENT_START:
+        start_net_match(as);
+        break;
+    case NET_EVENT_LOST:
+        SDL_Log("Lost the connection");
+        as->state = START;
+        break;
+    case NET_EVENT_DESYNC:
+        dump_desync(as);
+        break;
+    default:
+        break;
+    }
+}
+
+// Start the spectator server or connect to one as the command line said
+static bool open_spectate(void) {
+    NetAddress address;
+    if(!net_init()) {
+        SDL_Log("Couldn't start networking: %s", SDL_GetError());
+        return false;
+    }
+    if(watch_address) {
+        if(!net_resolve(watch_address, &address)) {
+            SDL_Log("Couldn't watch %s: %s", watch_address, SDL_GetError());
+            return false;
+        }
+        // the port defaults to the spectators' one, not the netplay one
+        if(!SDL_strchr(watch_address, ':'))
+            address.port = SPECTATE_DEFAULT_PORT;
+        if(!spectate_connect(&viewer, &address)) {
+            SDL_Log("Couldn't watch %s: %s", watch_address, SDL_GetError());
+            return false;
+        }
+        return true;
+    }
+    if(!spectate_open(&spectate_server, (Uint16)broadcast_port)) {
+        SDL_Log("Couldn't broadcast: %s", SDL_GetError());
+        return false;
+    }
+    SDL_Log("Broadcasting on port %d", spectate_server.port);
+    return true;
+}
+
+// Play whatever the server sent. The heads move between the ticks as in a match played here, from
+// where they were before the last tick that came in
+static void watch_match(AppState *as) {
+    HeadMotion before;
+    Uint64 tick = as->tick;
+    if(viewer.fd < 0)
+        return;
+    render_remember_heads(&before, as);
+    if(!spectate_receive(&viewer, as)) {
+        SDL_Log("Stopped watching: %s", SDL_GetError());
+        spectate_disconnect(&viewer);
+        as->state = START;
+        return;
+    }
+    if(viewer.has_match && (as->board_width != arena_width || as->board_height != arena_height)) {
+        SDL_Log("The server plays on %dx%d, start with --width %d --height %d to watch",
+                as->board_width, as->board_height, as->board_width, as->board_height);
+        spectate_disconnect(&viewer);
+        as->state = START;
+        return;
+    }
+    if(as->tick != tick) {
+        head_motion = before;
+        as->last_step = SDL_GetTicksNS();
+    }
+}
+
 // This function runs once at startup
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {    
-    
+
+    if (!parse_arena_args(argc, argv)) {
+        return SDL_APP_FAILURE;
+    }
+    init_key_players();
+
     // AppState stores various game specific information
     AppState *as = (AppState *)SDL_calloc(1, sizeof(AppState));
     if (!as) {
@@ -894,6 +926,7 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
     if (!SDL_CreateWindowAndRenderer("TRON", SDL_WINDOW_WIDTH, SDL_WINDOW_HEIGHT, 0, &as->window, &as->renderer)) {
         return SDL_APP_FAILURE;
     }
+    render_init(&board_renderer, as->renderer, block_size);
 
     /* Metadata */
     if (!SDL_SetAppMetadata("TRON", "1.0", "TRONv1.0")) {
@@ -924,10 +957,20 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
      }
 
     /* Initialize some required AppState variables. The rest gets covered on game start */
+    as->board_width  = arena_width;
+    as->board_height = arena_height;
     as->state      = START;
-    as->pause_time = SDL_GetTicks();
-    as->last_step  = SDL_GetTicks();
+    as->pause_time = SDL_GetTicksNS();
+    as->last_step  = SDL_GetTicksNS();
     as->game_mode  = PVP;
+    as->cpu_ai     = AI_STRAIGHT;
+    recorder.timeline = &timeline;
+    if(netplay && !open_net_session()) {
+        return SDL_APP_FAILURE;
+    }
+    if((broadcast_port >= 0 || watch_address) && !open_spectate()) {
+        return SDL_APP_FAILURE;
+    }
     toggle_mute(as);
 
     return SDL_APP_CONTINUE;
@@ -940,7 +983,7 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
     case SDL_EVENT_QUIT:
         return SDL_APP_SUCCESS;
     case SDL_EVENT_KEY_DOWN:
-        return handle_key_event(as, event->key.scancode);
+        return handle_key_event(as, event->key.scancode, event->key.timestamp);
     default:
         break;
     }
@@ -955,42 +998,54 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
     Menu pause_menu;
     Menu game_over_menu;
     char winner_text_buffer[50];
-    const Uint64 now = SDL_GetTicks();
+    char player_name[PLAYER_NAME_SIZE];
+    char tick_text_buffer[50];
+    char net_text_buffer[50];
     SDL_FRect r;
     int cell;
+    State shown;
+
+    profile_frame_begin(&profiler, as->tick);
+    if(netplay)
+        poll_net(as);
+    // Step the simulation in real time, items and the winner are handled by the simulation
+    if(watch_address)
+        watch_match(as);
+    else
+        run_due_steps(as);
+    if(broadcast_port >= 0)
+        spectate_poll(&spectate_server);
+    play_sim_events(as);
+    profile_mark(&profiler, PHASE_STEP);
 
     for (int i = 0; i < 1; i++) {
         if (SDL_GetAudioStreamQueued(sounds[i].stream) < ((int) sounds[i].wav_data_len)) {
             SDL_PutAudioStreamData(sounds[i].stream, sounds[i].wav_data, (int) sounds[i].wav_data_len);
         }
     } 
+    profile_mark(&profiler, PHASE_AUDIO);
 
-    draw_background(as->renderer, &COLOR_BG, &COLOR_BG_OUTLINE);
+    draw_background(&board_renderer, arena_width, arena_height);
+    profile_mark(&profiler, PHASE_BACKGROUND);
     
-    switch (as->state) {
+    // a netplay match is only over once the other side's inputs say so, a rollback can undo it
+    shown = as->state;
+    if(netplay && shown == GAME_OVER && !net_confirmed(&net, as))
+        shown = RUNNING;
+    switch (shown) {
     case RUNNING:
-        // Spawn item
-        while(now - as->last_item >= ITEM_RATE_IN_MILLISECONDS) {
-            spawn_item(as);
-            as->last_item += ITEM_RATE_IN_MILLISECONDS;
-        }
-        // Update character positions internally
-        while(now - as->last_step >= STEP_RATE_IN_MILLISECONDS) {
-            move_characters(as); 
-            as->last_step += STEP_RATE_IN_MILLISECONDS;
-        }
-        // Set the winner when one player remaining
-        if(as->remaining_players <= 1) {
-            as->state = GAME_OVER;
-            set_winner(as);
-        }
-        draw_game_board(as);
+        draw_game_board(&board_renderer, as);
+        draw_moving_heads(&board_renderer, as, &head_motion, step_fraction(as));
+        profile_mark(&profiler, PHASE_BOARD);
         break;
     case PAUSED: 
-        draw_game_board(as);
+        draw_game_board(&board_renderer, as);
+        profile_mark(&profiler, PHASE_BOARD);
+        sprintf(tick_text_buffer, "Tick %" SDL_PRIu64 " of %" SDL_PRIu64, as->tick,
+                replay_loaded ? replay.header.ticks : recorder.header.ticks);
         pause_menu.title = "PAUSED";
-        pause_menu.msg = "";
-        pause_menu.msg2 = "Press P to continue";
+        pause_menu.msg = tick_text_buffer;
+        pause_menu.msg2 = "P to continue, LEFT/RIGHT to scrub";
         pause_menu.x = SDL_WINDOW_WIDTH / 3;
         pause_menu.y = SDL_WINDOW_HEIGHT / 4;
         pause_menu.w = SDL_WINDOW_WIDTH / 3;
@@ -1000,13 +1055,21 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
         pause_menu.title_font_color = PAUSE_TITLE_COLOR;
         pause_menu.msg_font_color = MENU_MESSAGE_COLOR;
         draw_menu(as->renderer, pause_menu);
+        profile_mark(&profiler, PHASE_MENU);
         break;
     case GAME_OVER:
-        draw_game_board(as);
-        sprintf(winner_text_buffer, "%s WINS", as->winner);
+        draw_game_board(&board_renderer, as);
+        profile_mark(&profiler, PHASE_BOARD);
+        if(as->winner >= 0)
+            sprintf(winner_text_buffer, "%s WINS", sim_player_name(as, as->winner, player_name));
+        else
+            sprintf(winner_text_buffer, "DRAW");
         game_over_menu.title = "GAME OVER";
         game_over_menu.msg  = winner_text_buffer;
-        game_over_menu.msg2 = "Press SPACE to restart";
+        if(watch_address)
+            game_over_menu.msg2 = "Waiting for the next match";
+        else
+            game_over_menu.msg2 = netplay && !net.is_host ? "Waiting for the host to restart" : "Press SPACE to restart";
         game_over_menu.x = SDL_WINDOW_WIDTH / 3;
         game_over_menu.y = SDL_WINDOW_HEIGHT / 4;
         game_over_menu.w = SDL_WINDOW_WIDTH / 3;
@@ -1016,11 +1079,25 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
         game_over_menu.title_font_color = GAME_OVER_TITLE_COLOR;
         game_over_menu.msg_font_color = MENU_MESSAGE_COLOR;    
         draw_menu(as->renderer, game_over_menu);
+        profile_mark(&profiler, PHASE_MENU);
         break;
     case START:
         start_sub_menu.title = "Tron";
         start_sub_menu.msg = "";
         start_sub_menu.msg2 = "Press ENTER to begin";
+        if(netplay && net.is_host) {
+            SDL_snprintf(net_text_buffer, sizeof(net_text_buffer), "Hosting on port %d", net.socket.port);
+            start_sub_menu.msg = net_text_buffer;
+            if(!net.connected)
+                start_sub_menu.msg2 = "Waiting for a player to join";
+        } else if(netplay) {
+            start_sub_menu.msg = net.connected ? "Joined" : "Joining...";
+            start_sub_menu.msg2 = "Waiting for the host to start";
+        } else if(watch_address) {
+            SDL_snprintf(net_text_buffer, sizeof(net_text_buffer), "Watching %s", watch_address);
+            start_sub_menu.msg = net_text_buffer;
+            start_sub_menu.msg2 = viewer.fd >= 0 ? "Waiting for a match" : "Not connected";
+        }
         start_sub_menu.x = SDL_WINDOW_WIDTH / 3;
         start_sub_menu.y = SDL_WINDOW_HEIGHT / 4;
         start_sub_menu.w = SDL_WINDOW_WIDTH / 3;
@@ -1030,13 +1107,19 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
         start_sub_menu.title_font_color = MENU_TITLE_COLOR;
         start_sub_menu.msg_font_color = MENU_MESSAGE_COLOR;    
         start_menu.menu = start_sub_menu;
-        draw_start_menu(as->renderer, as->game_mode, start_menu);
+        draw_start_menu(as->renderer, as->game_mode, as->cpu_ai, start_menu);
+        profile_mark(&profiler, PHASE_MENU);
         break;
     default:
         break;
     }
 
+    if(show_profile)
+        profile_draw_overlay(&profiler, as->renderer);
+    profile_mark(&profiler, PHASE_OVERLAY);
     SDL_RenderPresent(as->renderer);
+    latency_presented(&profiler.latency, SDL_GetTicksNS());
+    profile_mark(&profiler, PHASE_PRESENT);
     return SDL_APP_CONTINUE;
 }
 
@@ -1045,10 +1128,39 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result)
 {
     if (appstate != NULL) {
         AppState *as = (AppState *)appstate;
+        render_free(&board_renderer);
         SDL_DestroyRenderer(as->renderer);
         SDL_DestroyWindow(as->window);
+        sim_free(as);
         SDL_free(as);
     }
+    ai_shutdown();
+    replay_record_free(&recorder);
+    if(scrubbing_live)
+        replay_close(&live_view);
+    if(replay_loaded)
+        replay_close(&replay);
+    replay_timeline_free(&timeline);
+    profile_close_csv(&profiler);
+    latency_log(&profiler.latency);
+    profile_log_ticks(&profiler);
+    if(netplay) {
+        SDL_Log("netplay: %" SDL_PRIu64 " rollbacks, %" SDL_PRIu64 " ticks played again, %" SDL_PRIu64 " stalls, %"
+                SDL_PRIu64 " of %" SDL_PRIu64 " hash checks failed",
+                net.stats.rollbacks, net.stats.resimulated, net.stats.stalls, net.stats.desyncs, net.stats.hash_checks);
+        net_close(&net);
+        net_quit();
+    }
+    if(broadcast_port >= 0) {
+        SDL_Log("broadcast: %" SDL_PRIu64 " spectators, %" SDL_PRIu64 " ticks and %" SDL_PRIu64 " keyframes, %" SDL_PRIu64 " bytes sent",
+                spectate_server.stats.spectators, spectate_server.stats.ticks, spectate_server.stats.keyframes, spectate_server.stats.sent);
+        spectate_close(&spectate_server);
+        net_quit();
+    }
+    if(watch_address) {
+        spectate_disconnect(&viewer);
+        net_quit();
+    }
 
     SDL_CloseAudioDevice(audio_device);
  
@@ -0,0 +1,378 @@
+// Computer players. See tron_ai.h
+#include "tron_ai_internal.h"
+#include "tron_bits.h"
+
+// how often (in BFS levels) the territory search checks the deadline
+#define VORONOI_DEADLINE_CHECK 8
+
+const int DIR_DX[4] = { 1, 0, -1, 0 };
+const int DIR_DY[4] = { 0, -1, 0, 1 };
+
+static const char *AI_TYPE_NAMES[AI_TYPE_COUNT] = { "Classic", "Voronoi", "Search", "MCTS" };
+
+const char *ai_type_name(AiType ai) {
+    if(ai >= AI_TYPE_COUNT)
+        return "?";
+    return AI_TYPE_NAMES[ai];
+}
+
+int ai_parse_types(char *list, AiType *ais, int max_ais) {
+    int count = 0;
+    char *saveptr = NULL;
+    for(char *name = SDL_strtok_r(list, ",", &saveptr); name; name = SDL_strtok_r(NULL, ",", &saveptr)) {
+        bool found = false;
+        for(int i = 0; i < AI_TYPE_COUNT && !found; i++) {
+            if(SDL_strcasecmp(name, AI_TYPE_NAMES[i]) == 0) {
+                found = true;
+                if(count < max_ais)
+                    ais[count++] = (AiType)i;
+            }
+        }
+        if(!found) {
+            SDL_SetError("unknown AI type: %s", name);
+            return 0;
+        }
+    }
+    return count;
+}
+
+// Picks a direction for the computer - currently checks with the direction with the most uninterupted cells
+CharacterDirection pick_next_dir(const Board *board, int head_xpos, int head_ypos, CharacterDirection curr_dir) {
+    char next_dir = curr_dir;
+    int longest_path = 0;
+
+    for(int i = 0; i < 4; i++) {
+        //Can't go backwards
+        if(is_reverse(curr_dir, (CharacterDirection)i)) {
+            continue;
+        }
+
+        int current_run = get_path_length(board, head_xpos, head_ypos, (CharacterDirection)i);
+        if(current_run > longest_path) {
+            longest_path = current_run;
+            next_dir = (CharacterDirection)i;
+        }
+    }
+    return next_dir;
+}
+
+// Start of a step: analyse the board once for every computer player that reads more than the free runs
+void ai_begin_step(AppState *as) {
+    int total_players = as->total_human_players + as->total_computer_players;
+    as->analysis.valid = false;
+    if(!analysis_supports(&as->board))
+        return;
+    for(int i = 0; i < total_players; i++) {
+        CharacterContext *ctx = &as->character_ctx[i];
+        if(ctx->is_alive && !ctx->is_human && ctx->ai != AI_STRAIGHT) {
+            ai_analysis(as);
+            return;
+        }
+    }
+}
+
+// The analysis for this step, computed on first use when nothing ran ai_begin_step.
+// Not valid when the board is too big for it (or it ran out of memory)
+const BoardAnalysis *ai_analysis(AppState *as) {
+    if(!as->analysis.valid) {
+        int total_players = as->total_human_players + as->total_computer_players;
+        int head_x[MAX_PLAYERS] = {0};
+        int head_y[MAX_PLAYERS] = {0};
+        Uint64 players = 0;
+        for(int i = 0; i < total_players; i++) {
+            CharacterContext *ctx = &as->character_ctx[i];
+            head_x[i] = ctx->head_xpos;
+            head_y[i] = ctx->head_ypos;
+            if(ctx->is_alive)
+                players |= (Uint64)1 << i;
+        }
+        analyze_board(&as->analysis, &as->board, head_x, head_y, players);
+    }
+    return &as->analysis;
+}
+
+// The analysis' free cells with the heads that moved since then blocked
+void ai_free_rows(AppState *as, Uint64 *free_rows) {
+    int total_players = as->total_human_players + as->total_computer_players;
+    SDL_memcpy(free_rows, ai_analysis(as)->free_rows, sizeof(as->analysis.free_rows));
+    for(int i = 0; i < total_players; i++) {
+        CharacterContext *ctx = &as->character_ctx[i];
+        if(ctx->is_alive)
+            free_rows[ctx->head_ypos] &= ~((Uint64)1 << ctx->head_xpos);
+    }
+}
+
+// Set up a duel against the nearest opponent we can still run into (by moves, from the step's
+// analysis). Returns false when there is nobody left to play against.
+bool find_duel(AppState *as, CharacterContext *ctx, Duel *duel) {
+    const BoardAnalysis *analysis = ai_analysis(as);
+    int total_players = as->total_human_players + as->total_computer_players;
+    int player = (int)(ctx - as->character_ctx);
+    CharacterContext *opponent = NULL;
+    int opponent_distance = ANALYSIS_FAR;
+
+    for(int i = 0; i < total_players; i++) {
+        CharacterContext *other = &as->character_ctx[i];
+        if(other == ctx || !other->is_alive || !analysis_same_region(analysis, player, i))
+            continue;
+        int distance = analysis_meeting_distance(analysis, player, i);
+        if(distance < opponent_distance) {
+            opponent_distance = distance;
+            opponent = other;
+        }
+    }
+    if(!opponent)
+        return false;
+    duel->head_x[0] = ctx->head_xpos;
+    duel->head_y[0] = ctx->head_ypos;
+    duel->head_x[1] = opponent->head_xpos;
+    duel->head_y[1] = opponent->head_ypos;
+    duel->height = analysis->height;
+    SDL_zeroa(duel->others);
+    for(int i = 0; i < total_players; i++) {
+        CharacterContext *other = &as->character_ctx[i];
+        if(other != ctx && other != opponent && other->is_alive)
+            duel->others[other->head_ypos] |= (Uint64)1 << other->head_xpos;
+    }
+    return true;
+}
+
+// Searches use up all their time, so they split what is left of the step between the searching computers still to move
+Uint64 thinking_deadline(AppState *as, CharacterContext *ctx) {
+    Uint64 now = SDL_GetTicksNS();
+    int waiting = 0;
+    int total_players = as->total_human_players + as->total_computer_players;
+    for(int i = (int)(ctx - as->character_ctx); i < total_players; i++) {
+        CharacterContext *other = &as->character_ctx[i];
+        if(other->is_alive && !other->is_human && (other->ai == AI_SEARCH || other->ai == AI_MCTS))
+            waiting++;
+    }
+    if(now >= as->ai_deadline_ns)
+        return now;
+    return now + (as->ai_deadline_ns - now) / SDL_max(waiting, 1);
+}
+
+/*
+  Multi-source BFS from both duel heads (and the other players, as one more source) at once. Each
+  level grows every frontier by one cell in all four directions (row shifted left/right, rows
+  above/below), restricted to free cells nobody has reached yet. A cell reached by more than one
+  frontier on the same level is contested and counts for nobody. territory[0] and territory[1] end
+  up as the number of cells the two heads reach strictly first.
+  Returns false if the deadline passed before the search finished.
+*/
+bool voronoi_territory(const Uint64 *free_rows, const Duel *duel, const int *head_x, const int *head_y,
+                       Uint64 deadline_ns, int *territory) {
+    enum { SOURCES = 3 };
+    int height = duel->height;
+    Uint64 frontier[SOURCES][ANALYSIS_MAX_SIZE];
+    Uint64 next[SOURCES][ANALYSIS_MAX_SIZE];
+    Uint64 visited[ANALYSIS_MAX_SIZE];
+    Uint64 claimed[2][ANALYSIS_MAX_SIZE]; // cells counted once at the end, not every level
+    int top = height;
+    int bottom = -1;
+
+    SDL_zeroa(frontier);
+    SDL_zeroa(claimed);
+    for(int y = 0; y < height; y++) {
+        frontier[2][y] = duel->others[y];
+        visited[y] = duel->others[y];
+        if(duel->others[y]) {
+            top = SDL_min(top, y);
+            bottom = SDL_max(bottom, y);
+        }
+    }
+    for(int p = 0; p < 2; p++) {
+        territory[p] = 0;
+        frontier[p][head_y[p]] |= (Uint64)1 << head_x[p];
+        visited[head_y[p]] |= (Uint64)1 << head_x[p];
+        top = SDL_min(top, head_y[p]);
+        bottom = SDL_max(bottom, head_y[p]);
+    }
+
+    for(int level = 1; top <= bottom; level++) {
+        if(level % VORONOI_DEADLINE_CHECK == 0 && SDL_GetTicksNS() > deadline_ns)
+            return false;
+
+        // only rows next to a non empty frontier row can change
+        int lo = SDL_max(top - 1, 0);
+        int hi = SDL_min(bottom + 1, height - 1);
+        Uint64 reached_once[ANALYSIS_MAX_SIZE];
+        Uint64 reached_twice[ANALYSIS_MAX_SIZE];
+        for(int y = lo; y <= hi; y++) {
+            reached_once[y] = 0;
+            reached_twice[y] = 0;
+        }
+
+        for(int p = 0; p < SOURCES; p++) {
+            for(int y = lo; y <= hi; y++) {
+                Uint64 row = frontier[p][y];
+                Uint64 up = y > 0 ? frontier[p][y - 1] : 0;
+                Uint64 down = y < height - 1 ? frontier[p][y + 1] : 0;
+                Uint64 grown = (row | (row << 1) | (row >> 1) | up | down) & free_rows[y] & ~visited[y];
+                next[p][y] = grown;
+                reached_twice[y] |= reached_once[y] & grown;
+                reached_once[y] |= grown;
+            }
+        }
+
+        top = height;
+        bottom = -1;
+        for(int y = lo; y <= hi; y++) {
+            visited[y] |= reached_once[y];
+            if(reached_once[y]) {
+                top = SDL_min(top, y);
+                bottom = SDL_max(bottom, y);
+            }
+        }
+        for(int p = 0; p < SOURCES; p++) {
+            for(int y = lo; y <= hi; y++) {
+                frontier[p][y] = next[p][y];
+            }
+        }
+        for(int p = 0; p < 2; p++) {
+            for(int y = lo; y <= hi; y++) {
+                claimed[p][y] |= next[p][y] & ~reached_twice[y];
+            }
+        }
+    }
+    for(int p = 0; p < 2; p++) {
+        for(int y = 0; y < height; y++) {
+            territory[p] += count_bits(claimed[p][y]);
+        }
+    }
+    return true;
+}
+
+/*
+  Territory of player after moving to (x,y): a BFS from there, level by level, compared against the
+  closest other player of every cell from the step's analysis. Cells we reach first are ours and
+  come out of their owner's count, cells we reach at the same time as the owner go to nobody.
+  Returns false if the deadline passed first.
+*/
+static bool move_territory(const BoardAnalysis *analysis, const Uint64 *free_rows, int player, int x, int y,
+                           Uint64 deadline_ns, int *mine, int *best_opponent) {
+    int height = analysis->height;
+    Uint64 frontier[ANALYSIS_MAX_SIZE];
+    Uint64 next[ANALYSIS_MAX_SIZE];
+    Uint64 visited[ANALYSIS_MAX_SIZE];
+    int territory[MAX_PLAYERS];
+    int top = y;
+    int bottom = y;
+
+    SDL_memcpy(territory, analysis_territory(analysis, player, 0), analysis->player_count * sizeof(int));
+    SDL_zeroa(frontier);
+    SDL_zeroa(visited);
+    frontier[y] = (Uint64)1 << x;
+    visited[y] = frontier[y];
+    *mine = 0;
+
+    for(int level = 1; top <= bottom; level++) {
+        if(level % VORONOI_DEADLINE_CHECK == 0 && SDL_GetTicksNS() > deadline_ns)
+            return false;
+
+        int lo = SDL_max(top - 1, 0);
+        int hi = SDL_min(bottom + 1, height - 1);
+        for(int row = lo; row <= hi; row++) {
+            Uint64 current = frontier[row];
+            Uint64 up = row > 0 ? frontier[row - 1] : 0;
+            Uint64 down = row < height - 1 ? frontier[row + 1] : 0;
+            next[row] = (current | (current << 1) | (current >> 1) | up | down) & free_rows[row] & ~visited[row];
+        }
+
+        top = height;
+        bottom = -1;
+        for(int row = lo; row <= hi; row++) {
+            frontier[row] = next[row];
+            if(!next[row])
+                continue;
+            visited[row] |= next[row];
+            top = SDL_min(top, row);
+            bottom = SDL_max(bottom, row);
+            for(Uint64 bits = next[row]; bits; bits &= bits - 1) {
+                int cell = analysis_cell(analysis, lowest_bit(bits), row);
+                // closest player other than us, and the one after that
+                int rank = analysis->rank_player[0][cell] == player;
+                int owner = analysis->rank_player[rank][cell];
+                int owner_distance = analysis->rank_distance[rank][cell];
+                int runner_up = rank + 1 + (analysis->rank_player[rank + 1][cell] == player);
+                bool owned = owner != ANALYSIS_NOBODY && owner_distance < analysis->rank_distance[runner_up][cell];
+                if(level < owner_distance)
+                    (*mine)++;
+                if(owned && level <= owner_distance)
+                    territory[owner]--;
+            }
+        }
+    }
+
+    *best_opponent = 0;
+    for(int p = 0; p < analysis->player_count; p++) {
+        if(p != player && (analysis->players >> p) & 1)
+            *best_opponent = SDL_max(*best_opponent, territory[p]);
+    }
+    return true;
+}
+
+// Picks the move that leaves this player with the most territory compared to the best opponent
+CharacterDirection pick_voronoi_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns) {
+    const BoardAnalysis *analysis = ai_analysis(as);
+    Uint64 free_rows[ANALYSIS_MAX_SIZE];
+    int player = (int)(ctx - as->character_ctx);
+    CharacterDirection curr_dir = (CharacterDirection)ctx->next_dir;
+    CharacterDirection best_dir = curr_dir;
+    int best_score = SDL_MIN_SINT32;
+    int best_run = -1;
+    bool has_move = false;
+
+    ai_free_rows(as, free_rows);
+    for(int dir = 0; dir < 4; dir++) {
+        if(is_reverse(curr_dir, (CharacterDirection)dir))
+            continue;
+        int x = ctx->head_xpos + DIR_DX[dir];
+        int y = ctx->head_ypos + DIR_DY[dir];
+        if(is_collision(&as->board, x, y))
+            continue;
+
+        // the cell we move into is ours now, nobody else can expand through it
+        int mine;
+        int best_opponent;
+        free_rows[y] &= ~((Uint64)1 << x);
+        bool finished = move_territory(analysis, free_rows, player, x, y, deadline_ns, &mine, &best_opponent);
+        free_rows[y] |= (Uint64)1 << x;
+        if(!finished)
+            return pick_next_dir(&as->board, ctx->head_xpos, ctx->head_ypos, curr_dir);
+
+        int score = mine - best_opponent;
+        int run = get_path_length(&as->board, ctx->head_xpos, ctx->head_ypos, (CharacterDirection)dir);
+        if(!has_move || score > best_score || (score == best_score && run > best_run)) {
+            has_move = true;
+            best_score = score;
+            best_run = run;
+            best_dir = (CharacterDirection)dir;
+        }
+    }
+
+    // boxed in, nothing left to score
+    if(!has_move)
+        return pick_next_dir(&as->board, ctx->head_xpos, ctx->head_ypos, curr_dir);
+    return best_dir;
+}
+
+// Pick the next direction of a computer player according to its strategy and the step's time budget.
+// Everything but AI_STRAIGHT needs the step's analysis, on boards too big for it they all play AI_STRAIGHT
+CharacterDirection ai_pick_dir(AppState *as, CharacterContext *ctx) {
+    CharacterDirection curr_dir = (CharacterDirection)ctx->next_dir;
+    if(ctx->ai != AI_STRAIGHT && SDL_GetTicksNS() < as->ai_deadline_ns && ai_analysis(as)->valid) {
+        switch(ctx->ai) {
+        case AI_VORONOI:
+            return pick_voronoi_dir(as, ctx, as->ai_deadline_ns);
+        case AI_SEARCH:
+            return pick_search_dir(as, ctx, thinking_deadline(as, ctx));
+        case AI_MCTS:
+            return pick_mcts_dir(as, ctx, thinking_deadline(as, ctx), NULL);
+        case AI_STRAIGHT:
+        default:
+            break;
+        }
+    }
+    return pick_next_dir(&as->board, ctx->head_xpos, ctx->head_ypos, curr_dir);
+}
@@ -0,0 +1,69 @@
+/*
+  Computer players.
+
+  AI_STRAIGHT  heads for the longest straight line (pick_next_dir)
+  AI_VORONOI   scores every legal move by territory: the cells this player would reach strictly
+               before anybody else after the move. Everyone else's distances come from the step's
+               shared analysis (tron_analysis.h), so scoring a move is one BFS from the new head no
+               matter how many players there are. The move with the best "my territory - best
+               opponent territory" wins, ties go to the longer straight line. The BFS works on one
+               64-bit mask per board row, a whole row of the frontier is expanded with a couple of
+               shifts and masks.
+
+  AI_SEARCH    iterative deepening alpha-beta against the nearest opponent (in moves) it can still run
+               into, other players stay put as obstacles. Both players move simultaneously: the
+               opponent replies knowing our move and the pair is resolved together, so head-on
+               crashes are draws. Leaves are scored
+               with the Voronoi territory difference, moves are ordered by the transposition table's
+               best move then by get_path_length. Positions are Zobrist hashed on the occupied cells
+               and head positions, the table is per thread. Each decision logs its depth and nodes/sec
+               at debug level (SDL_LOGGING=app=debug).
+
+  AI_MCTS      Monte Carlo tree search against the nearest opponent, with the same simultaneous move
+               model as AI_SEARCH. Rollouts play random free moves for a few steps and are settled by
+               territory. Every core works on one shared tree: node stats are atomics, a thread bumps
+               the visit count on the way down (virtual loss) so the others spread out, and adds the
+               reward on the way back. Workers are a pool of SDL threads, each with its own SDL_rand_r
+               state, started on first use and stopped by ai_shutdown. ai_set_thread_count picks the
+               pool size (0 is one per core). There is one pool per process and it works on one
+               decision at a time: a decision asked for while it's busy (another AppState stepping
+               on another thread) searches alone on its thread's own tree instead of waiting, and
+               with a pool size of 1 every decision does. Decisions log rollouts/sec at debug level.
+
+  ai_begin_step runs the shared analysis once at the start of a step when any computer player
+  other than AI_STRAIGHT is alive. The analysis keeps a board row in one 64-bit mask, so on
+  arenas bigger than 64x64 every computer player plays AI_STRAIGHT.
+
+  All computer players in a step share AppState.ai_budget_ns of thinking time. Once the step's
+  deadline has passed every remaining decision falls back to AI_STRAIGHT, so a step can never take
+  longer than the budget plus one BFS level.
+*/
+#ifndef TRON_AI_H
+#define TRON_AI_H
+
+#include "tron_sim.h"
+
+// What the last MCTS decision did
+typedef struct
+{
+    Uint64 rollouts;
+    Uint64 elapsed_ns;
+    int nodes;
+    int threads;
+} MctsStats;
+
+const char *ai_type_name(AiType ai);
+// Read a comma separated list of AI names (case insensitive) into ais, returns how many were read
+// or 0 with SDL_GetError set for an unknown name. list is modified
+int ai_parse_types(char *list, AiType *ais, int max_ais);
+void ai_begin_step(AppState *as);
+CharacterDirection ai_pick_dir(AppState *as, CharacterContext *ctx);
+CharacterDirection pick_next_dir(const Board *board, int head_xpos, int head_ypos, CharacterDirection curr_dir);
+CharacterDirection pick_voronoi_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns);
+CharacterDirection pick_search_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns);
+CharacterDirection pick_mcts_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns, MctsStats *stats);
+// Pool size for AI_MCTS, 0 is one per core. One decision at a time gets the pool, see above
+void ai_set_thread_count(int threads);
+void ai_shutdown(void);
+
+#endif // TRON_AI_H
@@ -0,0 +1,37 @@
+// Helpers shared between the computer player strategies, not part of the public AI interface
+#ifndef TRON_AI_INTERNAL_H
+#define TRON_AI_INTERNAL_H
+
+#include "tron_ai.h"
+
+extern const int DIR_DX[4];
+extern const int DIR_DY[4];
+
+// free_rows always has ANALYSIS_MAX_SIZE rows and nothing past the board is free
+static inline bool row_is_free(const Uint64 *free_rows, int x, int y) {
+    if((unsigned)x >= ANALYSIS_MAX_SIZE || (unsigned)y >= ANALYSIS_MAX_SIZE)
+        return false;
+    return (free_rows[y] >> x) & 1;
+}
+
+/*
+  A two player search against the nearest opponent: slot 0 is us, slot 1 the opponent. Everybody
+  else still alive stays where they are, their heads are merged into one mask since the searches
+  only ever score us against the opponent.
+*/
+typedef struct
+{
+    int head_x[2];
+    int head_y[2];
+    Uint64 others[ANALYSIS_MAX_SIZE];
+    int height;
+} Duel;
+
+const BoardAnalysis *ai_analysis(AppState *as);
+void ai_free_rows(AppState *as, Uint64 *free_rows);
+bool find_duel(AppState *as, CharacterContext *ctx, Duel *duel);
+Uint64 thinking_deadline(AppState *as, CharacterContext *ctx);
+bool voronoi_territory(const Uint64 *free_rows, const Duel *duel, const int *head_x, const int *head_y,
+                       Uint64 deadline_ns, int *territory);
+
+#endif // TRON_AI_INTERNAL_H
@@ -0,0 +1,397 @@
+// Monte Carlo tree search computer player (AI_MCTS). See tron_ai.h
+#include "tron_ai_internal.h"
+
+#define MCTS_MAX_THREADS   64
+#define MCTS_MAX_NODES     (1 << 19)
+#define MCTS_ROLLOUT_STEPS 24    // random moves before the rollout is settled by territory
+#define MCTS_EXPLORATION   1.4
+#define MCTS_EXPANDING     -1    // children value while a thread is creating them
+#define MCTS_FULL          -2    // out of nodes, this leaf only gets rollouts
+#define MCTS_MAX_PATH      (2 * ANALYSIS_MAX_SIZE * ANALYSIS_MAX_SIZE)
+
+// Rewards are in half points for whoever picked the move: 2 win, 1 draw, 0 loss
+#define REWARD_WIN  2
+#define REWARD_DRAW 1
+#define REWARD_LOSS 0
+
+/*
+  Nodes alternate between our move and the opponent's answer, the opponent's answer resolves both
+  moves at once like the alpha-beta search. visits is bumped on the way down (the virtual loss that
+  steers other threads elsewhere until the reward comes back), score on the way back up.
+*/
+typedef struct
+{
+    SDL_AtomicInt visits;
+    SDL_AtomicInt score;
+    SDL_AtomicInt children; // index of the first of the four children, one per direction, 0 if not expanded
+} MctsNode;
+
+typedef struct
+{
+    Uint64 free_rows[ANALYSIS_MAX_SIZE];
+    Duel duel;
+    Uint64 deadline_ns;
+    Uint64 seed;
+    MctsNode *nodes;
+    SDL_AtomicInt node_count;
+    SDL_AtomicInt rollouts;
+} MctsJob;
+
+// Worker threads sleep on work_ready between decisions, the thread asking for a move works too. One
+// decision at a time: another one asked for meanwhile runs alone, see pick_mcts_dir
+typedef struct
+{
+    SDL_InitState init;
+    SDL_Mutex *job_lock; // one decision at a time
+    SDL_Mutex *lock;
+    SDL_Condition *work_ready;
+    SDL_Condition *work_done;
+    SDL_Thread *threads[MCTS_MAX_THREADS - 1];
+    int thread_count; // pool threads, not counting the caller
+    Uint32 generation; // bumped for every job
+    int busy;          // pool threads still working on the current job
+    bool quit;
+    MctsJob job;
+} MctsPool;
+
+static MctsPool pool;
+static int requested_threads; // 0 is one per core
+static SDL_TLSID thread_job_tls;
+
+// A random free direction, or -1 when boxed in
+static int random_free_dir(const Uint64 *free_rows, int x, int y, Uint64 *rng) {
+    int dirs[4];
+    int count = 0;
+    for(int dir = 0; dir < 4; dir++) {
+        if(row_is_free(free_rows, x + DIR_DX[dir], y + DIR_DY[dir]))
+            dirs[count++] = dir;
+    }
+    if(count == 0)
+        return -1;
+    return dirs[SDL_rand_r(rng, count)];
+}
+
+// Resolve a pair of moves, returns our reward if the game ends or -1 if both survive
+static int resolve_moves(const Uint64 *free_rows, int my_x, int my_y, int x, int y) {
+    bool i_crash = !row_is_free(free_rows, my_x, my_y);
+    bool opponent_crashes = !row_is_free(free_rows, x, y);
+    if((my_x == x && my_y == y) || (i_crash && opponent_crashes))
+        return REWARD_DRAW;
+    if(i_crash)
+        return REWARD_LOSS;
+    if(opponent_crashes)
+        return REWARD_WIN;
+    return -1;
+}
+
+static void apply_moves(Uint64 *free_rows, int *head_x, int *head_y, int my_dir, int dir) {
+    head_x[0] += DIR_DX[my_dir];
+    head_y[0] += DIR_DY[my_dir];
+    head_x[1] += DIR_DX[dir];
+    head_y[1] += DIR_DY[dir];
+    free_rows[head_y[0]] &= ~((Uint64)1 << head_x[0]);
+    free_rows[head_y[1]] &= ~((Uint64)1 << head_x[1]);
+}
+
+// Both players move at random for a while, whoever has more territory afterwards wins
+static int rollout(const Duel *duel, Uint64 *free_rows, int *head_x, int *head_y, int pending_dir, Uint64 *rng) {
+    int territory[2];
+    for(int step = 0; step < MCTS_ROLLOUT_STEPS; step++) {
+        int my_dir = pending_dir >= 0 ? pending_dir : random_free_dir(free_rows, head_x[0], head_y[0], rng);
+        int dir = random_free_dir(free_rows, head_x[1], head_y[1], rng);
+        pending_dir = -1;
+        if(my_dir < 0 || dir < 0)
+            return my_dir < 0 && dir < 0 ? REWARD_DRAW : my_dir < 0 ? REWARD_LOSS : REWARD_WIN;
+        int result = resolve_moves(free_rows, head_x[0] + DIR_DX[my_dir], head_y[0] + DIR_DY[my_dir],
+                                   head_x[1] + DIR_DX[dir], head_y[1] + DIR_DY[dir]);
+        if(result >= 0)
+            return result;
+        apply_moves(free_rows, head_x, head_y, my_dir, dir);
+    }
+    voronoi_territory(free_rows, duel, head_x, head_y, SDL_MAX_UINT64, territory);
+    return territory[0] > territory[1] ? REWARD_WIN : territory[0] < territory[1] ? REWARD_LOSS : REWARD_DRAW;
+}
+
+static void expand(MctsJob *job, MctsNode *node) {
+    if(!SDL_CompareAndSwapAtomicInt(&node->children, 0, MCTS_EXPANDING))
+        return;
+    int first = SDL_AddAtomicInt(&job->node_count, 4);
+    if(first + 4 > MCTS_MAX_NODES) {
+        SDL_SetAtomicInt(&node->children, MCTS_FULL);
+        return;
+    }
+    for(int i = first; i < first + 4; i++) {
+        SDL_SetAtomicInt(&job->nodes[i].visits, 0);
+        SDL_SetAtomicInt(&job->nodes[i].score, 0);
+        SDL_SetAtomicInt(&job->nodes[i].children, 0);
+    }
+    SDL_SetAtomicInt(&node->children, first);
+}
+
+// UCT, visits still waiting for their reward count as losses
+static int select_child(MctsJob *job, MctsNode *node, int first) {
+    double log_visits = SDL_log((double)SDL_max(SDL_GetAtomicInt(&node->visits), 1));
+    double best_value = -1.0;
+    int best = first;
+    for(int i = first; i < first + 4; i++) {
+        int visits = SDL_GetAtomicInt(&job->nodes[i].visits);
+        if(visits == 0)
+            return i;
+        double value = SDL_GetAtomicInt(&job->nodes[i].score) / (2.0 * visits) +
+                       MCTS_EXPLORATION * SDL_sqrt(log_visits / visits);
+        if(value > best_value) {
+            best_value = value;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// One selection, expansion, rollout and backup pass on a private copy of the position
+static void mcts_iterate(MctsJob *job, Uint64 *rng) {
+    Uint64 free_rows[ANALYSIS_MAX_SIZE];
+    int head_x[2];
+    int head_y[2];
+    int path[MCTS_MAX_PATH];
+    int path_length = 0;
+    int pending_dir = -1; // our move, waiting for the opponent's answer
+    int result = -1;
+    MctsNode *node = &job->nodes[0];
+
+    SDL_memcpy(free_rows, job->free_rows, sizeof(free_rows));
+    SDL_memcpy(head_x, job->duel.head_x, sizeof(head_x));
+    SDL_memcpy(head_y, job->duel.head_y, sizeof(head_y));
+    SDL_AddAtomicInt(&node->visits, 1);
+
+    while(path_length < MCTS_MAX_PATH) {
+        int first = SDL_GetAtomicInt(&node->children);
+        if(first == 0 && (path_length == 0 || SDL_GetAtomicInt(&node->visits) > 1)) {
+            expand(job, node);
+            first = SDL_GetAtomicInt(&node->children);
+        }
+        if(first <= 0)
+            break;
+
+        int child = select_child(job, node, first);
+        int dir = child - first;
+        SDL_AddAtomicInt(&job->nodes[child].visits, 1);
+        path[path_length++] = child;
+        node = &job->nodes[child];
+
+        if(pending_dir < 0) {
+            pending_dir = dir;
+            continue;
+        }
+        result = resolve_moves(free_rows, head_x[0] + DIR_DX[pending_dir], head_y[0] + DIR_DY[pending_dir],
+                               head_x[1] + DIR_DX[dir], head_y[1] + DIR_DY[dir]);
+        if(result >= 0)
+            break;
+        apply_moves(free_rows, head_x, head_y, pending_dir, dir);
+        pending_dir = -1;
+    }
+
+    if(result < 0)
+        result = rollout(&job->duel, free_rows, head_x, head_y, pending_dir, rng);
+
+    // even entries are our moves, odd ones the opponent's
+    for(int i = 0; i < path_length; i++) {
+        SDL_AddAtomicInt(&job->nodes[path[i]].score, i % 2 == 0 ? result : REWARD_WIN - result);
+    }
+}
+
+static void mcts_work(MctsJob *job, int worker) {
+    Uint64 rng = job->seed + (Uint64)worker * 0x9e3779b97f4a7c15ULL;
+    int rollouts = 0;
+    while(SDL_GetTicksNS() < job->deadline_ns) {
+        mcts_iterate(job, &rng);
+        rollouts++;
+    }
+    SDL_AddAtomicInt(&job->rollouts, rollouts);
+}
+
+static int SDLCALL mcts_worker(void *data) {
+    int worker = (int)(intptr_t)data;
+    Uint32 seen = 0;
+
+    SDL_LockMutex(pool.lock);
+    for(;;) {
+        while(!pool.quit && pool.generation == seen) {
+            SDL_WaitCondition(pool.work_ready, pool.lock);
+        }
+        if(pool.quit)
+            break;
+        seen = pool.generation;
+        SDL_UnlockMutex(pool.lock);
+
+        mcts_work(&pool.job, worker);
+
+        SDL_LockMutex(pool.lock);
+        if(--pool.busy == 0)
+            SDL_SignalCondition(pool.work_done);
+    }
+    SDL_UnlockMutex(pool.lock);
+    return 0;
+}
+
+// Stops the workers and frees everything the pool holds, safe on a partly created pool
+static void stop_pool(void) {
+    if(pool.lock) {
+        SDL_LockMutex(pool.lock);
+        pool.quit = true;
+        SDL_BroadcastCondition(pool.work_ready);
+        SDL_UnlockMutex(pool.lock);
+    }
+    for(int i = 0; i < pool.thread_count; i++) {
+        SDL_WaitThread(pool.threads[i], NULL);
+    }
+    pool.thread_count = 0;
+    SDL_DestroyCondition(pool.work_done);
+    SDL_DestroyCondition(pool.work_ready);
+    SDL_DestroyMutex(pool.lock);
+    SDL_DestroyMutex(pool.job_lock);
+    SDL_free(pool.job.nodes);
+    pool.work_done = NULL;
+    pool.work_ready = NULL;
+    pool.lock = NULL;
+    pool.job_lock = NULL;
+    pool.job.nodes = NULL;
+}
+
+static bool start_pool(void) {
+    if(!SDL_ShouldInit(&pool.init))
+        return true;
+
+    int threads = requested_threads > 0 ? requested_threads : SDL_GetNumLogicalCPUCores();
+    threads = SDL_clamp(threads, 1, MCTS_MAX_THREADS);
+    pool.quit = false;
+    pool.generation = 0;
+    pool.job_lock = SDL_CreateMutex();
+    pool.lock = SDL_CreateMutex();
+    pool.work_ready = SDL_CreateCondition();
+    pool.work_done = SDL_CreateCondition();
+    pool.job.nodes = (MctsNode *)SDL_malloc(MCTS_MAX_NODES * sizeof(MctsNode));
+    if(!pool.job_lock || !pool.lock || !pool.work_ready || !pool.work_done || !pool.job.nodes) {
+        SDL_Log("Couldn't set up MCTS: %s", SDL_GetError());
+        stop_pool();
+        SDL_SetInitialized(&pool.init, false);
+        return false;
+    }
+    for(int i = 1; i < threads; i++) {
+        SDL_Thread *thread = SDL_CreateThread(mcts_worker, "tron_mcts", (void *)(intptr_t)i);
+        if(!thread) {
+            SDL_Log("Couldn't start MCTS worker: %s", SDL_GetError());
+            break; // run with what we have
+        }
+        pool.threads[pool.thread_count++] = thread;
+    }
+    SDL_SetInitialized(&pool.init, true);
+    return true;
+}
+
+void ai_shutdown(void) {
+    if(!SDL_ShouldQuit(&pool.init))
+        return;
+    stop_pool();
+    SDL_SetInitialized(&pool.init, false);
+}
+
+void ai_set_thread_count(int threads) {
+    ai_shutdown();
+    requested_threads = threads;
+}
+
+// A decision that doesn't get the pool searches alone on a tree of its thread's own, kept from one
+// decision to the next
+static MctsJob *get_thread_job(void) {
+    MctsJob *job = (MctsJob *)SDL_GetTLS(&thread_job_tls);
+    if(!job) {
+        job = (MctsJob *)SDL_malloc(sizeof(MctsJob) + MCTS_MAX_NODES * sizeof(MctsNode));
+        if(job && !SDL_SetTLS(&thread_job_tls, job, SDL_free)) {
+            SDL_free(job);
+            job = NULL;
+        }
+        if(job)
+            job->nodes = (MctsNode *)(job + 1);
+    }
+    return job;
+}
+
+CharacterDirection pick_mcts_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns, MctsStats *stats) {
+    CharacterDirection curr_dir = (CharacterDirection)ctx->next_dir;
+    Duel duel;
+    bool has_opponent = find_duel(as, ctx, &duel);
+    Uint64 start = SDL_GetTicksNS();
+
+    if(stats)
+        SDL_zerop(stats);
+    if(!has_opponent || !start_pool())
+        return pick_voronoi_dir(as, ctx, deadline_ns);
+
+    // the pool takes one decision at a time, waiting for it could eat the whole deadline
+    bool pooled = pool.thread_count > 0 && SDL_TryLockMutex(pool.job_lock);
+    MctsJob *job = pooled ? &pool.job : get_thread_job();
+    if(!job)
+        return pick_voronoi_dir(as, ctx, deadline_ns);
+    int threads = pooled ? pool.thread_count + 1 : 1;
+
+    ai_free_rows(as, job->free_rows);
+    job->duel = duel;
+    job->deadline_ns = deadline_ns;
+    // derived from the match rather than drawn from as->rng, how often MCTS gets to run mustn't move the items
+    job->seed = (as->seed ^ (as->tick * MAX_PLAYERS + (Uint64)ctx->player_id)) * 0x9e3779b97f4a7c15ULL;
+    SDL_SetAtomicInt(&job->node_count, 1);
+    SDL_SetAtomicInt(&job->rollouts, 0);
+    SDL_SetAtomicInt(&job->nodes[0].visits, 0);
+    SDL_SetAtomicInt(&job->nodes[0].score, 0);
+    SDL_SetAtomicInt(&job->nodes[0].children, 0);
+
+    if(pooled) {
+        SDL_LockMutex(pool.lock);
+        pool.busy = pool.thread_count;
+        pool.generation++;
+        SDL_BroadcastCondition(pool.work_ready);
+        SDL_UnlockMutex(pool.lock);
+    }
+
+    mcts_work(job, 0);
+
+    if(pooled) {
+        SDL_LockMutex(pool.lock);
+        while(pool.busy > 0) {
+            SDL_WaitCondition(pool.work_done, pool.lock);
+        }
+        SDL_UnlockMutex(pool.lock);
+    }
+
+    // the most visited move is the one the search trusts most
+    CharacterDirection best_dir = pick_next_dir(&as->board, ctx->head_xpos, ctx->head_ypos, curr_dir);
+    int first = SDL_GetAtomicInt(&job->nodes[0].children);
+    if(first > 0) {
+        int best_visits = 0;
+        for(int dir = 0; dir < 4; dir++) {
+            int visits = SDL_GetAtomicInt(&job->nodes[first + dir].visits);
+            if(visits > best_visits) {
+                best_visits = visits;
+                best_dir = (CharacterDirection)dir;
+            }
+        }
+    }
+
+    int rollouts = SDL_GetAtomicInt(&job->rollouts);
+    int nodes = SDL_min(SDL_GetAtomicInt(&job->node_count), MCTS_MAX_NODES);
+    if(pooled)
+        SDL_UnlockMutex(pool.job_lock);
+
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    char name[PLAYER_NAME_SIZE];
+    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "%s mcts: %d threads, %d rollouts, %d nodes, %.0f rollouts/sec",
+                 sim_player_name(as, (int)(ctx - as->character_ctx), name), threads, rollouts, nodes,
+                 elapsed ? (double)rollouts * SDL_NS_PER_SECOND / elapsed : 0.0);
+    if(stats) {
+        stats->rollouts = rollouts;
+        stats->nodes = nodes;
+        stats->threads = threads;
+        stats->elapsed_ns = elapsed;
+    }
+    return best_dir;
+}
@@ -0,0 +1,309 @@
+// Alpha-beta search computer player (AI_SEARCH). See tron_ai.h
+#include "tron_ai_internal.h"
+#include "tron_bits.h"
+
+#define SEARCH_MAX_DEPTH      64     // in full moves (us and the opponent)
+#define SEARCH_TABLE_SIZE     (1 << 16)
+#define SEARCH_DEADLINE_CHECK 255    // deadline is checked every 256 nodes
+#define SEARCH_WIN            1000000
+#define SEARCH_DECIDED        (SEARCH_WIN - 1000)
+#define SEARCH_ZOBRIST_SEED   0x7472306eU
+
+// slots in the zobrist head keys
+#define SLOT_ME       0
+#define SLOT_OPPONENT 1
+#define SLOT_OTHER    2
+
+#define ZOBRIST_CELLS (ANALYSIS_MAX_SIZE * ANALYSIS_MAX_SIZE)
+
+typedef enum
+{
+    BOUND_EXACT,
+    BOUND_LOWER, // the real score is at least this
+    BOUND_UPPER  // the real score is at most this
+} SearchBound;
+
+typedef struct
+{
+    Uint64 key;
+    Sint32 score;
+    Uint8 depth;
+    Uint8 bound;
+    Uint8 best_dir;
+} SearchEntry;
+
+typedef struct
+{
+    Uint64 free_rows[ANALYSIS_MAX_SIZE];
+    Duel duel;
+    int head_x[2]; // where the duel's two players are in the line being searched
+    int head_y[2];
+    Uint64 hash;
+    Uint64 deadline_ns;
+    Uint64 nodes;
+    bool aborted;
+    CharacterDirection root_dir;
+    const Board *board; // only matches the search at ply 0
+    SearchEntry *table;
+} SearchContext;
+
+static Uint64 zobrist_cells[ZOBRIST_CELLS];
+static Uint64 zobrist_heads[3][ZOBRIST_CELLS];
+static SDL_InitState zobrist_init;
+static SDL_TLSID search_table_tls;
+
+// The keys are the same every run so searches stay reproducible
+static void init_zobrist(void) {
+    if(!SDL_ShouldInit(&zobrist_init))
+        return;
+    Uint64 state = SEARCH_ZOBRIST_SEED;
+    for(int i = 0; i < ZOBRIST_CELLS; i++) {
+        zobrist_cells[i] = ((Uint64)SDL_rand_bits_r(&state) << 32) | SDL_rand_bits_r(&state);
+        for(int slot = 0; slot < 3; slot++) {
+            zobrist_heads[slot][i] = ((Uint64)SDL_rand_bits_r(&state) << 32) | SDL_rand_bits_r(&state);
+        }
+    }
+    SDL_SetInitialized(&zobrist_init, true);
+}
+
+// Every thread searching gets its own table, it's kept from one decision to the next
+static SearchEntry *get_search_table(void) {
+    SearchEntry *table = (SearchEntry *)SDL_GetTLS(&search_table_tls);
+    if(!table) {
+        table = (SearchEntry *)SDL_calloc(SEARCH_TABLE_SIZE, sizeof(SearchEntry));
+        if(table && !SDL_SetTLS(&search_table_tls, table, SDL_free)) {
+            SDL_free(table);
+            table = NULL;
+        }
+    }
+    return table;
+}
+
+static inline int cell_key(int x, int y) {
+    return y * ANALYSIS_MAX_SIZE + x;
+}
+
+// Move a player onto a free cell, it stays blocked behind them
+static void apply_move(SearchContext *s, int slot, int x, int y) {
+    s->hash ^= zobrist_heads[slot][cell_key(s->head_x[slot], s->head_y[slot])];
+    s->hash ^= zobrist_heads[slot][cell_key(x, y)] ^ zobrist_cells[cell_key(x, y)];
+    s->free_rows[y] &= ~((Uint64)1 << x);
+    s->head_x[slot] = x;
+    s->head_y[slot] = y;
+}
+
+static void undo_move(SearchContext *s, int slot, int old_x, int old_y) {
+    int x = s->head_x[slot];
+    int y = s->head_y[slot];
+    s->hash ^= zobrist_heads[slot][cell_key(x, y)] ^ zobrist_cells[cell_key(x, y)];
+    s->hash ^= zobrist_heads[slot][cell_key(old_x, old_y)];
+    s->free_rows[y] |= (Uint64)1 << x;
+    s->head_x[slot] = old_x;
+    s->head_y[slot] = old_y;
+}
+
+// get_path_length on the search's own rows, the board doesn't follow the moves we try
+static int rows_path_length(const Uint64 *free_rows, int x, int y, int dir) {
+    int length = 0;
+    x += DIR_DX[dir];
+    y += DIR_DY[dir];
+    while(row_is_free(free_rows, x, y)) {
+        length++;
+        x += DIR_DX[dir];
+        y += DIR_DY[dir];
+    }
+    return length;
+}
+
+// Order the four directions: the table's best move first, then the longest free run
+static void order_moves(const SearchContext *s, int slot, int first_dir, int ply, int *dirs) {
+    int runs[4];
+    for(int dir = 0; dir < 4; dir++) {
+        dirs[dir] = dir;
+        if(ply == 0)
+            runs[dir] = get_path_length(s->board, s->head_x[slot], s->head_y[slot], (CharacterDirection)dir);
+        else
+            runs[dir] = rows_path_length(s->free_rows, s->head_x[slot], s->head_y[slot], dir);
+        if(dir == first_dir)
+            runs[dir] = SDL_MAX_SINT32;
+    }
+    // insertion sort, it's four entries
+    for(int i = 1; i < 4; i++) {
+        for(int j = i; j > 0 && runs[dirs[j]] > runs[dirs[j - 1]]; j--) {
+            int tmp = dirs[j];
+            dirs[j] = dirs[j - 1];
+            dirs[j - 1] = tmp;
+        }
+    }
+}
+
+static bool out_of_time(SearchContext *s) {
+    if((s->nodes & SEARCH_DEADLINE_CHECK) == 0 && SDL_GetTicksNS() > s->deadline_ns)
+        s->aborted = true;
+    return s->aborted;
+}
+
+// Leaf score: our territory minus the opponent's. A single BFS is short, out_of_time covers the deadline
+static int evaluate(SearchContext *s) {
+    int territory[2];
+    voronoi_territory(s->free_rows, &s->duel, s->head_x, s->head_y, SDL_MAX_UINT64, territory);
+    return territory[SLOT_ME] - territory[SLOT_OPPONENT];
+}
+
+static int search_max(SearchContext *s, int depth, int alpha, int beta, int ply);
+
+// The opponent answers our move, then both moves happen at once
+static int search_min(SearchContext *s, int depth, int alpha, int beta, int my_dir, int ply) {
+    int my_x = s->head_x[SLOT_ME] + DIR_DX[my_dir];
+    int my_y = s->head_y[SLOT_ME] + DIR_DY[my_dir];
+    bool i_crash = !row_is_free(s->free_rows, my_x, my_y);
+    int dirs[4];
+    int best = SEARCH_WIN + 1;
+
+    order_moves(s, SLOT_OPPONENT, -1, ply, dirs);
+    for(int i = 0; i < 4; i++) {
+        int x = s->head_x[SLOT_OPPONENT] + DIR_DX[dirs[i]];
+        int y = s->head_y[SLOT_OPPONENT] + DIR_DY[dirs[i]];
+        bool opponent_crashes = !row_is_free(s->free_rows, x, y);
+        int score;
+
+        // sooner wins and later losses are better
+        if((x == my_x && y == my_y) || (i_crash && opponent_crashes)) {
+            score = 0;
+        } else if(i_crash) {
+            score = -SEARCH_WIN + ply;
+        } else if(opponent_crashes) {
+            score = SEARCH_WIN - ply;
+        } else {
+            int my_old_x = s->head_x[SLOT_ME];
+            int my_old_y = s->head_y[SLOT_ME];
+            int old_x = s->head_x[SLOT_OPPONENT];
+            int old_y = s->head_y[SLOT_OPPONENT];
+            apply_move(s, SLOT_ME, my_x, my_y);
+            apply_move(s, SLOT_OPPONENT, x, y);
+            score = search_max(s, depth - 1, alpha, beta, ply + 1);
+            undo_move(s, SLOT_OPPONENT, old_x, old_y);
+            undo_move(s, SLOT_ME, my_old_x, my_old_y);
+            if(s->aborted)
+                return 0;
+        }
+
+        best = SDL_min(best, score);
+        beta = SDL_min(beta, score);
+        if(alpha >= beta)
+            break;
+    }
+    return best;
+}
+
+static int search_max(SearchContext *s, int depth, int alpha, int beta, int ply) {
+    s->nodes++;
+    if(out_of_time(s))
+        return 0;
+    if(depth == 0)
+        return evaluate(s);
+
+    SearchEntry *entry = &s->table[s->hash & (SEARCH_TABLE_SIZE - 1)];
+    int table_dir = -1;
+    int alpha_in = alpha;
+    if(entry->key == s->hash) {
+        table_dir = entry->best_dir;
+        if(entry->depth >= depth && ply > 0) {
+            if(entry->bound == BOUND_EXACT)
+                return entry->score;
+            if(entry->bound == BOUND_LOWER)
+                alpha = SDL_max(alpha, entry->score);
+            else
+                beta = SDL_min(beta, entry->score);
+            if(alpha >= beta)
+                return entry->score;
+        }
+    }
+
+    int dirs[4];
+    int best = -SEARCH_WIN - 1;
+    order_moves(s, SLOT_ME, table_dir, ply, dirs);
+    int best_dir = dirs[0];
+    for(int i = 0; i < 4; i++) {
+        int score = search_min(s, depth, alpha, beta, dirs[i], ply);
+        if(s->aborted)
+            return 0;
+        if(score > best) {
+            best = score;
+            best_dir = dirs[i];
+        }
+        alpha = SDL_max(alpha, score);
+        if(alpha >= beta)
+            break;
+    }
+
+    entry->key = s->hash;
+    entry->score = best;
+    entry->depth = (Uint8)depth;
+    entry->best_dir = (Uint8)best_dir;
+    entry->bound = best <= alpha_in ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+    if(ply == 0)
+        s->root_dir = (CharacterDirection)best_dir;
+    return best;
+}
+
+// Deepen one full move at a time until the deadline, keeping the move of the last search that finished
+CharacterDirection pick_search_dir(AppState *as, CharacterContext *ctx, Uint64 deadline_ns) {
+    SearchContext s;
+    CharacterDirection curr_dir = (CharacterDirection)ctx->next_dir;
+    CharacterDirection best_dir = curr_dir;
+    int depth_reached = 0;
+    Uint64 start = SDL_GetTicksNS();
+
+    s.table = get_search_table();
+    if(!s.table)
+        return pick_voronoi_dir(as, ctx, deadline_ns);
+    init_zobrist();
+
+    // search against whoever is closest, everyone else is frozen in place
+    if(!find_duel(as, ctx, &s.duel))
+        return pick_voronoi_dir(as, ctx, deadline_ns);
+    SDL_memcpy(s.head_x, s.duel.head_x, sizeof(s.head_x));
+    SDL_memcpy(s.head_y, s.duel.head_y, sizeof(s.head_y));
+    ai_free_rows(as, s.free_rows);
+    s.board = &as->board;
+
+    s.hash = 0;
+    for(int y = 0; y < as->board.height; y++) {
+        for(int x = 0; x < as->board.width; x++) {
+            if(!row_is_free(s.free_rows, x, y))
+                s.hash ^= zobrist_cells[cell_key(x, y)];
+        }
+        for(Uint64 others = s.duel.others[y]; others; others &= others - 1) {
+            s.hash ^= zobrist_heads[SLOT_OTHER][cell_key(lowest_bit(others), y)];
+        }
+    }
+    for(int p = SLOT_ME; p <= SLOT_OPPONENT; p++) {
+        s.hash ^= zobrist_heads[p][cell_key(s.head_x[p], s.head_y[p])];
+    }
+    s.deadline_ns = deadline_ns;
+    s.nodes = 0;
+    s.aborted = false;
+
+    for(int depth = 1; depth <= SEARCH_MAX_DEPTH; depth++) {
+        int score = search_max(&s, depth, -SEARCH_WIN - 1, SEARCH_WIN + 1, 0);
+        if(s.aborted)
+            break;
+        best_dir = s.root_dir;
+        depth_reached = depth;
+        // won or lost whatever we do, deeper won't change the move
+        if(score >= SEARCH_DECIDED || score <= -SEARCH_DECIDED)
+            break;
+    }
+
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    char name[PLAYER_NAME_SIZE];
+    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "%s search: depth %d, %" SDL_PRIu64 " nodes, %.0f nodes/sec",
+                 sim_player_name(as, (int)(ctx - as->character_ctx), name), depth_reached, s.nodes,
+                 elapsed ? (double)s.nodes * SDL_NS_PER_SECOND / elapsed : 0.0);
+
+    // not even one full move in time
+    if(depth_reached == 0)
+        return pick_next_dir(&as->board, ctx->head_xpos, ctx->head_ypos, curr_dir);
+    return best_dir;
+}
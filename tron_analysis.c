@@ -0,0 +1,227 @@
+// Board analysis shared by the computer players. See tron_analysis.h
+#include <SDL3/SDL_assert.h>
+#include "tron_analysis.h"
+#include "tron_bits.h"
+
+SDL_FORCE_INLINE void free_rows_kernel(const Board *board, int width, int height, Uint64 *free_rows) {
+    for(int y = 0; y < height; y++) {
+        const Uint8 *row = &board->cells[board_index_in(width + 2, 0, y)];
+        Uint64 mask = 0;
+        for(int x = 0; x < width; x++) {
+            mask |= (Uint64)!cell_blocks(row[x]) << x;
+        }
+        free_rows[y] = mask;
+    }
+    for(int y = height; y < ANALYSIS_MAX_SIZE; y++) {
+        free_rows[y] = 0;
+    }
+}
+
+// One mask per row with a bit set for every cell a player could move into
+void build_free_rows(const Board *board, Uint64 *free_rows) {
+    SDL_assert(analysis_supports(board));
+    BOARD_SPECIALIZE(board, free_rows_kernel, free_rows);
+}
+
+/*
+  BFS from (x,y) over the free cells, a row of the frontier at a time. Every free cell reached is
+  added to reached and, when distance isn't NULL, gets the number of moves it took. The start cell
+  itself is only marked in reached.
+*/
+static void flood(const BoardAnalysis *analysis, int x, int y, Uint16 *distance, Uint64 *reached) {
+    const Uint64 *free_rows = analysis->free_rows;
+    int height = analysis->height;
+    Uint64 frontier[ANALYSIS_MAX_SIZE];
+    Uint64 next[ANALYSIS_MAX_SIZE];
+    int top = y;
+    int bottom = y;
+
+    SDL_zeroa(frontier);
+    frontier[y] = (Uint64)1 << x;
+    reached[y] |= frontier[y];
+
+    for(int level = 1; top <= bottom; level++) {
+        int lo = SDL_max(top - 1, 0);
+        int hi = SDL_min(bottom + 1, height - 1);
+        for(int row = lo; row <= hi; row++) {
+            Uint64 current = frontier[row];
+            Uint64 up = row > 0 ? frontier[row - 1] : 0;
+            Uint64 down = row < height - 1 ? frontier[row + 1] : 0;
+            next[row] = (current | (current << 1) | (current >> 1) | up | down) & free_rows[row] & ~reached[row];
+        }
+
+        top = height;
+        bottom = -1;
+        for(int row = lo; row <= hi; row++) {
+            Uint64 grown = next[row];
+            frontier[row] = grown;
+            if(!grown)
+                continue;
+            reached[row] |= grown;
+            top = SDL_min(top, row);
+            bottom = SDL_max(bottom, row);
+            if(distance) {
+                for(Uint64 bits = grown; bits; bits &= bits - 1) {
+                    distance[analysis_cell(analysis, lowest_bit(bits), row)] = (Uint16)level;
+                }
+            }
+        }
+    }
+}
+
+/*
+  One pass over the cells: keep the three closest players of every cell (ties go to the lower
+  player index) and count territory. Leaving a player out only changes who owns the cells where
+  they were first or second, so territory[p][q] is q's own count plus a correction for those.
+*/
+static void rank_players(BoardAnalysis *analysis) {
+    int owned[MAX_PLAYERS] = {0};
+    int players = analysis->player_count;
+    SDL_memset(analysis->territory, 0, (size_t)players * players * sizeof(int));
+    for(int cell = 0; cell < analysis->cells; cell++) {
+        Uint16 d0 = ANALYSIS_FAR, d1 = ANALYSIS_FAR, d2 = ANALYSIS_FAR;
+        Uint8 p0 = ANALYSIS_NOBODY, p1 = ANALYSIS_NOBODY, p2 = ANALYSIS_NOBODY;
+        for(Uint64 alive = analysis->players; alive; alive &= alive - 1) {
+            int p = lowest_bit(alive);
+            Uint16 distance = analysis_distance(analysis, p)[cell];
+            if(distance >= d2)
+                continue;
+            if(distance >= d1) {
+                d2 = distance;
+                p2 = (Uint8)p;
+            } else if(distance >= d0) {
+                d2 = d1;
+                p2 = p1;
+                d1 = distance;
+                p1 = (Uint8)p;
+            } else {
+                d2 = d1;
+                p2 = p1;
+                d1 = d0;
+                p1 = p0;
+                d0 = distance;
+                p0 = (Uint8)p;
+            }
+        }
+        analysis->rank_distance[0][cell] = d0;
+        analysis->rank_distance[1][cell] = d1;
+        analysis->rank_distance[2][cell] = d2;
+        analysis->rank_player[0][cell] = p0;
+        analysis->rank_player[1][cell] = p1;
+        analysis->rank_player[2][cell] = p2;
+
+        if(p0 == ANALYSIS_NOBODY)
+            continue;
+        if(d0 < d1)
+            owned[p0]++;
+        // without the closest player the second one may own it
+        if(p1 != ANALYSIS_NOBODY && d1 < d2)
+            (*analysis_territory(analysis, p0, p1))++;
+        // without the second one a tie for first turns into a win
+        if(p1 != ANALYSIS_NOBODY && d0 == d1 && d0 < d2)
+            (*analysis_territory(analysis, p1, p0))++;
+    }
+    for(int p = 0; p < players; p++) {
+        for(int q = 0; q < players; q++) {
+            if(q != p)
+                *analysis_territory(analysis, p, q) += owned[q];
+        }
+    }
+}
+
+// Size the arrays for the board and its players, they are kept as long as neither changes
+static bool analysis_reserve(BoardAnalysis *analysis, const Board *board) {
+    if(analysis->storage && analysis->width == board->width && analysis->height == board->height &&
+       analysis->player_count == board->players)
+        return true;
+    analysis_free(analysis);
+
+    size_t cells = (size_t)board->width * board->height;
+    size_t players = (size_t)board->players;
+    size_t region_bytes = players * sizeof(analysis->region[0]);
+    size_t distance_bytes = players * cells * sizeof(Uint16);
+    size_t rank_distance_bytes = ANALYSIS_RANKS * cells * sizeof(Uint16);
+    size_t territory_bytes = (players * players + players) * sizeof(int);
+    size_t rank_player_bytes = ANALYSIS_RANKS * cells;
+    // carved largest alignment first (Uint64, int, Uint16, Uint8) so every array lands on a boundary it
+    // is happy with whatever the cell and player counts
+    Uint8 *storage = (Uint8 *)SDL_malloc(region_bytes + territory_bytes + distance_bytes + rank_distance_bytes + rank_player_bytes);
+    if(!storage)
+        return false;
+
+    analysis->storage = storage;
+    analysis->width = board->width;
+    analysis->height = board->height;
+    analysis->cells = (int)cells;
+    analysis->player_count = board->players;
+    analysis->region = (Uint64 (*)[ANALYSIS_MAX_SIZE])storage;
+    storage += region_bytes;
+    analysis->territory = (int *)storage;
+    analysis->region_size = analysis->territory + players * players;
+    storage += territory_bytes;
+    analysis->distance = (Uint16 *)storage;
+    storage += distance_bytes;
+    for(int rank = 0; rank < ANALYSIS_RANKS; rank++) {
+        analysis->rank_distance[rank] = (Uint16 *)storage + rank * cells;
+    }
+    storage += rank_distance_bytes;
+    for(int rank = 0; rank < ANALYSIS_RANKS; rank++) {
+        analysis->rank_player[rank] = storage + rank * cells;
+    }
+    return true;
+}
+
+void analysis_free(BoardAnalysis *analysis) {
+    SDL_free(analysis->storage);
+    SDL_zerop(analysis);
+}
+
+bool analyze_board(BoardAnalysis *analysis, const Board *board, const int *head_x, const int *head_y, Uint64 players) {
+    analysis->valid = false;
+    if(!analysis_supports(board) || !analysis_reserve(analysis, board))
+        return false;
+    analysis->players = players;
+    build_free_rows(board, analysis->free_rows);
+    for(int p = 0; p < analysis->player_count; p++) {
+        Uint16 *distance = analysis_distance(analysis, p);
+        analysis->head_x[p] = head_x[p];
+        analysis->head_y[p] = head_y[p];
+        analysis->region_size[p] = 0;
+        SDL_zeroa(analysis->region[p]);
+        SDL_memset(distance, 0xFF, analysis->cells * sizeof(Uint16));
+        if(!((players >> p) & 1))
+            continue;
+        flood(analysis, head_x[p], head_y[p], distance, analysis->region[p]);
+        // the head isn't a free cell
+        analysis->region[p][head_y[p]] &= ~((Uint64)1 << head_x[p]);
+        for(int y = 0; y < analysis->height; y++) {
+            analysis->region_size[p] += count_bits(analysis->region[p][y]);
+        }
+    }
+    rank_players(analysis);
+    analysis->valid = true;
+    return true;
+}
+
+static const int NEIGHBOUR_DX[4] = { 1, 0, -1, 0 };
+static const int NEIGHBOUR_DY[4] = { 0, -1, 0, 1 };
+
+int analysis_meeting_distance(const BoardAnalysis *analysis, int player, int other) {
+    int best = ANALYSIS_FAR;
+    for(int dir = 0; dir < 4; dir++) {
+        int x = analysis->head_x[other] + NEIGHBOUR_DX[dir];
+        int y = analysis->head_y[other] + NEIGHBOUR_DY[dir];
+        if(x < 0 || x >= analysis->width || y < 0 || y >= analysis->height)
+            continue;
+        best = SDL_min(best, analysis_distance(analysis, player)[analysis_cell(analysis, x, y)]);
+    }
+    return best;
+}
+
+bool analysis_same_region(const BoardAnalysis *analysis, int player, int other) {
+    for(int y = 0; y < analysis->height; y++) {
+        if(analysis->region[player][y] & analysis->region[other][y])
+            return true;
+    }
+    return false;
+}
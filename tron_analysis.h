@@ -0,0 +1,84 @@
+/*
+  Board analysis shared by every computer player for one step.
+
+  The computer players all look at the same board, so the expensive part of reading it is done
+  once per step, before anybody moves (ai_begin_step), and every AI reads from the result:
+
+   * free_rows: one mask per row with a bit for every cell a player could move into
+   * distance: for every alive player, moves from their head to every free cell (BFS)
+   * the three closest players to every cell, so "closest player except me" is a lookup
+   * region: for every alive player the free cells they can still reach (a mask per row) and how many
+   * territory: for every player p, how many cells each other player reaches strictly first when
+     p is left out. A move of p only changes ownership of the cells p can reach, so scoring a
+     move is a single BFS from p no matter how many players there are.
+
+  Free runs don't need anything extra, the board keeps those up to date (get_path_length).
+
+  Players move one after the other within a step. The distances and territory stay as they were
+  when the step began, readers block the heads that moved since then in their copy of free_rows.
+
+  A row of the board is a single mask and rows are kept in fixed ANALYSIS_MAX_SIZE arrays (the rows
+  past the board's height are never free), so the analysis and every AI built on it only take
+  boards up to 64x64 (analysis_supports). The per player arrays are sized for the board and player
+  count on first use and kept for the next matches.
+*/
+#ifndef TRON_ANALYSIS_H
+#define TRON_ANALYSIS_H
+
+#include "tron_board.h"
+
+#define ANALYSIS_MAX_SIZE 64     // board sides the masks cover
+#define ANALYSIS_FAR      0xFFFFU // distance of a cell a player can't reach
+#define ANALYSIS_RANKS    3
+#define ANALYSIS_NOBODY   0xFFU
+
+typedef struct
+{
+    bool valid;
+    int width;
+    int height;
+    int cells;        // width * height
+    int player_count; // player slots the arrays below have room for
+    Uint64 players;   // bit p is set for every player that was alive when the analysis ran
+    int head_x[MAX_PLAYERS];
+    int head_y[MAX_PLAYERS];
+    Uint64 free_rows[ANALYSIS_MAX_SIZE];
+    Uint16 *distance;                    // cells per player, see analysis_distance
+    Uint16 *rank_distance[ANALYSIS_RANKS]; // closest players first
+    Uint8 *rank_player[ANALYSIS_RANKS];    // ANALYSIS_NOBODY when fewer players reach the cell
+    Uint64 (*region)[ANALYSIS_MAX_SIZE];   // per player, free cells they can reach, bit x of row y
+    int *region_size;
+    int *territory;   // player_count * player_count, see analysis_territory
+    void *storage;    // all of the arrays above
+} BoardAnalysis;
+
+static inline bool analysis_supports(const Board *board) {
+    return board->width <= ANALYSIS_MAX_SIZE && board->height <= ANALYSIS_MAX_SIZE;
+}
+
+static inline int analysis_cell(const BoardAnalysis *analysis, int x, int y) {
+    return y * analysis->width + x;
+}
+
+// moves from player's head to every cell
+static inline Uint16 *analysis_distance(const BoardAnalysis *analysis, int player) {
+    return &analysis->distance[player * analysis->cells];
+}
+
+// cells q reaches strictly first among everyone but p
+static inline int *analysis_territory(const BoardAnalysis *analysis, int p, int q) {
+    return &analysis->territory[p * analysis->player_count + q];
+}
+
+// free_rows has ANALYSIS_MAX_SIZE entries, rows past the board are 0
+void build_free_rows(const Board *board, Uint64 *free_rows);
+// Returns false when the board is too big (analysis_supports) or out of memory
+bool analyze_board(BoardAnalysis *analysis, const Board *board, const int *head_x, const int *head_y, Uint64 players);
+void analysis_free(BoardAnalysis *analysis);
+
+// Moves from player's head (at the start of the step) to the nearest free cell next to other's head, ANALYSIS_FAR if they can't meet
+int analysis_meeting_distance(const BoardAnalysis *analysis, int player, int other);
+// Whether two players could still reach a common free cell
+bool analysis_same_region(const BoardAnalysis *analysis, int player, int other);
+
+#endif // TRON_ANALYSIS_H
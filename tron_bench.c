@@ -0,0 +1,581 @@
+/*
+  Microbenchmarks for the simulation and the arena drawing.
+
+  usage: tron_bench [--samples N] [--filter TEXT] [--json FILE] [--renderer NAME]
+
+  Every benchmark runs one warm up sample and then --samples timed ones (20 by default). A sample
+  does a batch of operations and only the operations are timed, whatever puts the board back in
+  between is left out. Each sample gives a ns/op figure and a benchmark reports their mean, standard
+  deviation, minimum and median. Boards and matches come from fixed seeds, so two runs (or two
+  versions of the game) time exactly the same work. --filter only runs the benchmarks whose name
+  contains TEXT, --json also writes the results to FILE for comparing versions.
+
+  move_characters      one tick of classic computer players, over whole matches from fixed seeds
+  pick_next_dir        AI_STRAIGHT's decision from random free cells of a half full board
+  get_path_length      free run from random free cells of a half full board, in a random direction
+  handle_collision     a crash, for every player of a 16 player match in full swing
+  spawn_item           placing an item against how full the board is, next to the old rejection
+                       sampling loop (spawn_item_rejection, which never finishes on a full board)
+  sim_snapshot         saving a match in full swing (sim_snapshot), on the default arena and on a
+                       crowded 200x150 one, into a ring of snapshots like netplay's
+  sim_restore          putting it back (sim_restore), both are meant to stay under a microsecond on
+                       the default arena
+  mcts                 ns per rollout of the MCTS player on the opening position with 1, 2, 4 and 8
+                       threads, one sample is one decision
+  draw_background      the grid of the default arena against the offscreen video driver
+  draw_game_board      a half full default arena against the offscreen video driver
+
+  The drawing benchmarks flush the renderer after every draw so the rasterizing is counted, not
+  just queueing the commands. They use SDL's software renderer unless --renderer names another one
+  (opengl, vulkan...): a GPU driver only has to take the commands by then, which makes for noisy
+  numbers that depend on the driver. The star sprite is loaded from the working directory like the
+  game does, run from the repository's root to get items drawn.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+#include "tron_ai.h"
+#include "tron_render.h"
+
+#define DEFAULT_SAMPLES      20
+#define BENCH_SEED           1
+#define MOVE_MATCHES         8    // matches a move_characters sample plays
+#define QUERY_COUNT          4096 // pick_next_dir / get_path_length calls per sample
+#define QUERY_FILL           50
+#define COLLISION_PLAYERS    16
+#define COLLISION_TICKS      40   // how long the collision match runs before everybody crashes
+#define COLLISION_ROUNDS     32   // crashes of every player per sample
+#define SPAWN_BATCH          16
+#define SPAWN_BATCHES        64
+#define SNAPSHOT_TICKS       400  // how far the snapshot match gets before it is saved
+#define SNAPSHOT_RING        16   // snapshots saved round robin, NET_ROLLBACK_TICKS
+#define SNAPSHOT_COUNT       1024 // snapshots or restores per sample
+#define MCTS_DECISION_MS     50
+#define DRAW_FRAMES          8
+#define DRAW_FILL            50
+
+typedef struct
+{
+    char name[64];
+    double ops;      // operations per sample, on average
+    int samples;
+    double mean_ns;  // per operation
+    double stddev_ns;
+    double min_ns;
+    double median_ns;
+} BenchResult;
+
+// One sample: does a batch of operations, stores how many in ops and returns the ns they took
+typedef Uint64 (*SampleFunc)(void *data, int *ops);
+
+static int sample_count = DEFAULT_SAMPLES;
+static const char *filter = NULL;
+static const char *render_driver = "software";
+static BenchResult *results = NULL;
+static int result_count = 0;
+static volatile int sink; // keeps the compiler from dropping the queries' results
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static bool bench_selected(const char *name) {
+    return !filter || SDL_strstr(name, filter);
+}
+
+// Run and report one benchmark, unless --filter leaves it out
+static void run_bench(const char *name, SampleFunc sample, void *data) {
+    double *per_op;
+    double total_ops = 0.0;
+    double sum = 0.0;
+    double squares = 0.0;
+    int ops = 0;
+    if(!bench_selected(name))
+        return;
+    BenchResult *grown = (BenchResult *)SDL_realloc(results, (result_count + 1) * sizeof(BenchResult));
+    per_op = (double *)SDL_malloc(sample_count * sizeof(double));
+    if(!grown || !per_op) {
+        SDL_free(per_op);
+        results = grown ? grown : results;
+        printf("%s: out of memory\n", name);
+        return;
+    }
+    results = grown;
+
+    sample(data, &ops); // warm up: caches, the MCTS thread pool, the renderer's first frame
+    for(int s = 0; s < sample_count; s++) {
+        Uint64 elapsed = sample(data, &ops);
+        per_op[s] = ops ? (double)elapsed / ops : 0.0;
+        total_ops += ops;
+        sum += per_op[s];
+    }
+
+    BenchResult *result = &results[result_count++];
+    SDL_strlcpy(result->name, name, sizeof(result->name));
+    result->samples = sample_count;
+    result->ops = total_ops / sample_count;
+    result->mean_ns = sum / sample_count;
+    for(int s = 0; s < sample_count; s++) {
+        squares += (per_op[s] - result->mean_ns) * (per_op[s] - result->mean_ns);
+    }
+    result->stddev_ns = sample_count > 1 ? SDL_sqrt(squares / (sample_count - 1)) : 0.0;
+    SDL_qsort(per_op, sample_count, sizeof(double), compare_doubles);
+    result->min_ns = per_op[0];
+    result->median_ns = sample_count % 2 ? per_op[sample_count / 2]
+                                         : (per_op[sample_count / 2 - 1] + per_op[sample_count / 2]) / 2;
+    SDL_free(per_op);
+
+    printf("%-32s %9.0f %12.1f %10.1f %6.1f%% %12.1f %12.1f\n", result->name, result->ops, result->mean_ns,
+           result->stddev_ns, result->mean_ns > 0 ? 100.0 * result->stddev_ns / result->mean_ns : 0.0,
+           result->min_ns, result->median_ns);
+}
+
+static bool write_json(const char *path) {
+    FILE *file = fopen(path, "w");
+    if(!file)
+        return false;
+    fprintf(file, "{\n");
+#ifdef TRON_BITBOARD
+    fprintf(file, "  \"bitboard\": true,\n");
+#else
+    fprintf(file, "  \"bitboard\": false,\n");
+#endif
+    fprintf(file, "  \"samples\": %d,\n", sample_count);
+    fprintf(file, "  \"renderer\": \"%s\",\n", render_driver);
+    fprintf(file, "  \"results\": [\n");
+    for(int i = 0; i < result_count; i++) {
+        const BenchResult *result = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ops_per_sample\": %.0f, \"mean_ns\": %.2f, \"stddev_ns\": %.2f, "
+                      "\"min_ns\": %.2f, \"median_ns\": %.2f}%s\n",
+                result->name, result->ops, result->mean_ns, result->stddev_ns, result->min_ns, result->median_ns,
+                i + 1 < result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// The original spawn_item, keeps drawing random cells until one is empty
+static void rejection_spawn_item(AppState *as) {
+    int x_coord = SDL_rand(as->board.width);
+    int y_coord = SDL_rand(as->board.height);
+    while(board_get(&as->board, x_coord, y_coord) != CELL_NOTHING) {
+        x_coord = SDL_rand(as->board.width);
+        y_coord = SDL_rand(as->board.height);
+    }
+    board_set(&as->board, x_coord, y_coord, CELL_ITEM_STAR);
+}
+
+// Fill the requested share of the board with random trail cells
+static void fill_board(AppState *as, int fill_percent) {
+    int target = as->board.width * as->board.height * fill_percent / 100;
+    int x;
+    int y;
+    initialize_game_board(&as->board);
+    for(int i = 0; i < target && board_random_free_cell(&as->board, &as->rng, &x, &y); i++) {
+        board_set(&as->board, x, y, CELL_PLAYER(SDL_rand(as->board.players)));
+    }
+}
+
+// Start a match of classic computer players with the bench's seed
+static bool start_match(AppState *as, int width, int height, int players, Uint64 seed) {
+    as->board_width = width;
+    as->board_height = height;
+    as->cpu_ai = AI_STRAIGHT;
+    as->seed = seed;
+    return sim_init_match(as, 0, players);
+}
+
+typedef struct
+{
+    AppState *as;
+    int width;
+    int height;
+    int players;
+} MoveBench;
+
+static Uint64 sample_move_characters(void *data, int *ops) {
+    MoveBench *bench = (MoveBench *)data;
+    AppState *as = bench->as;
+    Uint64 elapsed = 0;
+    *ops = 0;
+    for(int m = 0; m < MOVE_MATCHES; m++) {
+        start_match(as, bench->width, bench->height, bench->players, BENCH_SEED + m);
+        Uint64 start = SDL_GetTicksNS();
+        // sim_step without the items and the winner
+        while(as->remaining_players > 1) {
+            move_characters(as);
+            as->tick++;
+        }
+        elapsed += SDL_GetTicksNS() - start;
+        *ops += (int)as->tick;
+    }
+    return elapsed;
+}
+
+static void bench_move_characters(AppState *as) {
+    MoveBench classic = {as, TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS};
+    MoveBench crowd = {as, 200, 150, MAX_PLAYERS};
+    if(!start_match(as, classic.width, classic.height, classic.players, BENCH_SEED) ||
+       !start_match(as, crowd.width, crowd.height, crowd.players, BENCH_SEED)) {
+        printf("move_characters: %s\n", SDL_GetError());
+        return;
+    }
+    run_bench("move_characters/4p", sample_move_characters, &classic);
+    run_bench("move_characters/64p_200x150", sample_move_characters, &crowd);
+}
+
+typedef struct
+{
+    const Board *board;
+    int x[QUERY_COUNT];
+    int y[QUERY_COUNT];
+    CharacterDirection dir[QUERY_COUNT];
+} QueryBench;
+
+static Uint64 sample_pick_next_dir(void *data, int *ops) {
+    QueryBench *bench = (QueryBench *)data;
+    int total = 0;
+    Uint64 start = SDL_GetTicksNS();
+    for(int i = 0; i < QUERY_COUNT; i++) {
+        total += pick_next_dir(bench->board, bench->x[i], bench->y[i], bench->dir[i]);
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    sink = total;
+    *ops = QUERY_COUNT;
+    return elapsed;
+}
+
+static Uint64 sample_get_path_length(void *data, int *ops) {
+    QueryBench *bench = (QueryBench *)data;
+    int total = 0;
+    Uint64 start = SDL_GetTicksNS();
+    for(int i = 0; i < QUERY_COUNT; i++) {
+        total += get_path_length(bench->board, bench->x[i], bench->y[i], bench->dir[i]);
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    sink = total;
+    *ops = QUERY_COUNT;
+    return elapsed;
+}
+
+static void bench_queries(AppState *as) {
+    QueryBench *bench = (QueryBench *)SDL_malloc(sizeof(QueryBench));
+    if(!bench || !start_match(as, TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS, BENCH_SEED)) {
+        SDL_free(bench);
+        printf("queries: %s\n", SDL_GetError());
+        return;
+    }
+    fill_board(as, QUERY_FILL);
+    bench->board = &as->board;
+    for(int i = 0; i < QUERY_COUNT; i++) {
+        board_random_free_cell(&as->board, &as->rng, &bench->x[i], &bench->y[i]);
+        bench->dir[i] = (CharacterDirection)SDL_rand_r(&as->rng, 4);
+    }
+    run_bench("pick_next_dir", sample_pick_next_dir, bench);
+    run_bench("get_path_length", sample_get_path_length, bench);
+    SDL_free(bench);
+}
+
+typedef struct
+{
+    AppState *as;
+    Board saved;
+    CharacterContext ctx[MAX_PLAYERS];
+    int remaining_players;
+} CollisionBench;
+
+static Uint64 sample_handle_collision(void *data, int *ops) {
+    CollisionBench *bench = (CollisionBench *)data;
+    AppState *as = bench->as;
+    int players = as->total_human_players + as->total_computer_players;
+    Uint64 elapsed = 0;
+    *ops = 0;
+    for(int round = 0; round < COLLISION_ROUNDS; round++) {
+        board_copy(&as->board, &bench->saved);
+        SDL_memcpy(as->character_ctx, bench->ctx, sizeof(bench->ctx));
+        as->remaining_players = bench->remaining_players;
+        Uint64 start = SDL_GetTicksNS();
+        for(int i = 0; i < players; i++) {
+            if(as->character_ctx[i].is_alive)
+                handle_collision(as, as->character_ctx[i].player_id);
+        }
+        elapsed += SDL_GetTicksNS() - start;
+        *ops += bench->remaining_players;
+    }
+    return elapsed;
+}
+
+static void bench_handle_collision(AppState *as) {
+    CollisionBench bench = {.as = as};
+    if(!start_match(as, 2 * TRON_DEFAULT_WIDTH, 2 * TRON_DEFAULT_HEIGHT, COLLISION_PLAYERS, BENCH_SEED) ||
+       !board_init(&bench.saved, as->board.width, as->board.height, as->board.players)) {
+        printf("handle_collision: %s\n", SDL_GetError());
+        return;
+    }
+    for(int t = 0; t < COLLISION_TICKS && !sim_is_over(as); t++) {
+        sim_step(as);
+    }
+    board_copy(&bench.saved, &as->board);
+    SDL_memcpy(bench.ctx, as->character_ctx, sizeof(bench.ctx));
+    bench.remaining_players = as->remaining_players;
+    run_bench("handle_collision", sample_handle_collision, &bench);
+    board_free(&bench.saved);
+}
+
+typedef struct
+{
+    AppState *as;
+    Board *saved;
+    bool rejection;
+} SpawnBench;
+
+// Spawns run in small batches and the board is restored in between so the fill stays put
+static Uint64 sample_spawn_item(void *data, int *ops) {
+    SpawnBench *bench = (SpawnBench *)data;
+    AppState *as = bench->as;
+    Uint64 elapsed = 0;
+    for(int b = 0; b < SPAWN_BATCHES; b++) {
+        board_copy(&as->board, bench->saved);
+        Uint64 start = SDL_GetTicksNS();
+        for(int i = 0; i < SPAWN_BATCH; i++) {
+            if(bench->rejection)
+                rejection_spawn_item(as);
+            else
+                spawn_item(as);
+        }
+        elapsed += SDL_GetTicksNS() - start;
+    }
+    *ops = SPAWN_BATCHES * SPAWN_BATCH;
+    return elapsed;
+}
+
+static void bench_spawn_item(AppState *as) {
+    static const int fills[] = {0, 25, 50, 75, 90, 95, 99, 100};
+    Board saved = {0};
+    char name[64];
+    if(!start_match(as, TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS, BENCH_SEED) ||
+       !board_init(&saved, as->board.width, as->board.height, as->board.players)) {
+        printf("spawn_item: %s\n", SDL_GetError());
+        return;
+    }
+
+    for(int i = 0; i < (int)SDL_arraysize(fills); i++) {
+        SpawnBench bench = {as, &saved, false};
+        fill_board(as, fills[i]);
+        board_copy(&saved, &as->board);
+        SDL_snprintf(name, sizeof(name), "spawn_item/fill=%d", fills[i]);
+        if(as->board.free_count < SPAWN_BATCH) {
+            // not enough room for a batch, just show that a full board is reported cleanly
+            bool placed = spawn_item(as);
+            if(bench_selected(name))
+                printf("%s: %s\n", name, placed ? "placed" : "no space");
+            continue;
+        }
+        run_bench(name, sample_spawn_item, &bench);
+        bench.rejection = true;
+        SDL_snprintf(name, sizeof(name), "spawn_item_rejection/fill=%d", fills[i]);
+        run_bench(name, sample_spawn_item, &bench);
+    }
+    board_free(&saved);
+}
+
+typedef struct
+{
+    AppState *as;
+    SimSnapshot ring[SNAPSHOT_RING];
+} SnapshotBench;
+
+static Uint64 sample_sim_snapshot(void *data, int *ops) {
+    SnapshotBench *bench = (SnapshotBench *)data;
+    Uint64 start = SDL_GetTicksNS();
+    for(int i = 0; i < SNAPSHOT_COUNT; i++) {
+        sim_snapshot(bench->as, &bench->ring[i % SNAPSHOT_RING]);
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    *ops = SNAPSHOT_COUNT;
+    return elapsed;
+}
+
+static Uint64 sample_sim_restore(void *data, int *ops) {
+    SnapshotBench *bench = (SnapshotBench *)data;
+    Uint64 start = SDL_GetTicksNS();
+    for(int i = 0; i < SNAPSHOT_COUNT; i++) {
+        sim_restore(bench->as, &bench->ring[i % SNAPSHOT_RING]);
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    sink = (int)bench->as->tick;
+    *ops = SNAPSHOT_COUNT;
+    return elapsed;
+}
+
+static void bench_snapshot(AppState *as) {
+    static const int arenas[][3] = {{TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS}, {200, 150, MAX_PLAYERS}};
+    static SnapshotBench bench;
+    char name[64];
+    for(int a = 0; a < (int)SDL_arraysize(arenas); a++) {
+        bool ready = start_match(as, arenas[a][0], arenas[a][1], arenas[a][2], BENCH_SEED);
+        for(int t = 0; ready && t < SNAPSHOT_TICKS && !sim_is_over(as); t++) {
+            sim_step(as);
+        }
+        bench.as = as;
+        for(int i = 0; ready && i < SNAPSHOT_RING; i++) {
+            ready = sim_snapshot_init(&bench.ring[i], as);
+            if(ready)
+                sim_snapshot(as, &bench.ring[i]);
+        }
+        if(!ready) {
+            printf("sim_snapshot: %s\n", SDL_GetError());
+            break;
+        }
+        const char *arena = a == 0 ? "default" : "64p_200x150";
+        if(bench_selected("sim_snapshot") || bench_selected("sim_restore"))
+            printf("snapshot of the %s arena at tick %" SDL_PRIu64 ": %zu bytes\n", arena, as->tick,
+                   sizeof(MatchState) + bench.ring[0].size);
+        SDL_snprintf(name, sizeof(name), "sim_snapshot/%s", arena);
+        run_bench(name, sample_sim_snapshot, &bench);
+        SDL_snprintf(name, sizeof(name), "sim_restore/%s", arena);
+        run_bench(name, sample_sim_restore, &bench);
+    }
+    for(int i = 0; i < SNAPSHOT_RING; i++) {
+        sim_snapshot_free(&bench.ring[i]);
+    }
+}
+
+static Uint64 sample_mcts(void *data, int *ops) {
+    AppState *as = (AppState *)data;
+    MctsStats stats;
+    pick_mcts_dir(as, &as->character_ctx[0], SDL_GetTicksNS() + SDL_MS_TO_NS(MCTS_DECISION_MS), &stats);
+    *ops = (int)stats.rollouts;
+    return stats.elapsed_ns;
+}
+
+static void bench_mcts(AppState *as) {
+    static const int thread_counts[] = {1, 2, 4, 8};
+    char name[64];
+    for(int i = 0; i < (int)SDL_arraysize(thread_counts); i++) {
+        ai_set_thread_count(thread_counts[i]);
+        start_match(as, TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS, BENCH_SEED);
+        SDL_snprintf(name, sizeof(name), "mcts/threads=%d", thread_counts[i]);
+        run_bench(name, sample_mcts, as);
+    }
+    ai_shutdown();
+}
+
+typedef struct
+{
+    BoardRenderer board_renderer;
+    AppState *as;
+} DrawBench;
+
+static Uint64 sample_draw_background(void *data, int *ops) {
+    DrawBench *bench = (DrawBench *)data;
+    Uint64 elapsed = 0;
+    for(int f = 0; f < DRAW_FRAMES; f++) {
+        Uint64 start = SDL_GetTicksNS();
+        draw_background(&bench->board_renderer, bench->as->board.width, bench->as->board.height);
+        SDL_FlushRenderer(bench->board_renderer.renderer);
+        elapsed += SDL_GetTicksNS() - start;
+        SDL_RenderPresent(bench->board_renderer.renderer);
+    }
+    *ops = DRAW_FRAMES;
+    return elapsed;
+}
+
+static Uint64 sample_draw_game_board(void *data, int *ops) {
+    DrawBench *bench = (DrawBench *)data;
+    Uint64 elapsed = 0;
+    for(int f = 0; f < DRAW_FRAMES; f++) {
+        Uint64 start = SDL_GetTicksNS();
+        draw_game_board(&bench->board_renderer, bench->as);
+        SDL_FlushRenderer(bench->board_renderer.renderer);
+        elapsed += SDL_GetTicksNS() - start;
+        SDL_RenderPresent(bench->board_renderer.renderer);
+    }
+    *ops = DRAW_FRAMES;
+    return elapsed;
+}
+
+static void bench_draw(AppState *as) {
+    DrawBench bench = {{0}, as};
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    if(!start_match(as, TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, TRON_DEFAULT_PLAYERS, BENCH_SEED)) {
+        printf("draw: %s\n", SDL_GetError());
+        return;
+    }
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+    if(!SDL_InitSubSystem(SDL_INIT_VIDEO) ||
+       !(window = SDL_CreateWindow("tron_bench", TRON_DEFAULT_WIDTH * BLOCK_SIZE_IN_PIXELS,
+                                   TRON_DEFAULT_HEIGHT * BLOCK_SIZE_IN_PIXELS, 0)) ||
+       !(renderer = SDL_CreateRenderer(window, render_driver))) {
+        printf("draw: %s\n", SDL_GetError());
+        SDL_DestroyWindow(window);
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return;
+    }
+    render_init(&bench.board_renderer, renderer, BLOCK_SIZE_IN_PIXELS);
+
+    fill_board(as, DRAW_FILL);
+    for(int i = 0; i < 4; i++) {
+        spawn_item(as);
+    }
+    run_bench("draw_background", sample_draw_background, &bench);
+    run_bench("draw_game_board", sample_draw_game_board, &bench);
+
+    render_free(&bench.board_renderer);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    bool ok = true;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            sample_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if(strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+            render_driver = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--samples N] [--filter TEXT] [--json FILE] [--renderer NAME]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(sample_count < 1) {
+        fprintf(stderr, "--samples must be at least 1\n");
+        return 1;
+    }
+
+    AppState *as = (AppState *)SDL_calloc(1, sizeof(AppState));
+    if(!as) {
+        return 1;
+    }
+    SDL_srand(BENCH_SEED);
+
+    printf("%-32s %9s %12s %10s %7s %12s %12s\n", "benchmark", "ops", "ns/op", "stddev", "cv", "min", "median");
+    bench_move_characters(as);
+    bench_queries(as);
+    bench_handle_collision(as);
+    bench_spawn_item(as);
+    bench_snapshot(as);
+    bench_mcts(as);
+    bench_draw(as);
+
+    if(json_path && !write_json(json_path)) {
+        fprintf(stderr, "couldn't write %s\n", json_path);
+        ok = false;
+    }
+    SDL_free(results);
+    sim_free(as);
+    SDL_free(as);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
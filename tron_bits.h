@@ -0,0 +1,115 @@
+// Small bit twiddling helpers shared by the bitboard code, the frame profiler's histograms, the
+// varints of replays and keyframes, and the bit-packed spectator ticks
+#ifndef TRON_BITS_H
+#define TRON_BITS_H
+
+#include <SDL3/SDL_stdinc.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, v must not be 0
+static inline int lowest_bit(Uint64 v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return (int)index;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// index of the highest set bit, v must not be 0
+static inline int highest_bit(Uint64 v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+// number of set bits
+static inline int count_bits(Uint64 v) {
+#ifdef _MSC_VER
+    return (int)__popcnt64(v);
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+#define VARINT_MAX_BYTES 10
+
+// LEB128: 7 bits per byte starting with the lowest, the top bit says another byte follows.
+// Returns how many bytes were written
+static inline size_t put_varint(Uint8 *out, Uint64 v) {
+    size_t n = 0;
+    while(v >= 0x80) {
+        out[n++] = (Uint8)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (Uint8)v;
+    return n;
+}
+
+// Reads a varint at *pos and moves past it, false if it runs past size
+static inline bool get_varint(const Uint8 *data, size_t size, size_t *pos, Uint64 *v) {
+    Uint64 value = 0;
+    for(int shift = 0; *pos < size && shift < 64; shift += 7) {
+        Uint8 byte = data[(*pos)++];
+        value |= (Uint64)(byte & 0x7F) << shift;
+        if(!(byte & 0x80)) {
+            *v = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bits written lowest first into bytes, out has to have room for them
+typedef struct
+{
+    Uint8 *out;
+    size_t bits; // written so far
+} BitWriter;
+
+static inline void put_bits(BitWriter *writer, Uint64 value, int count) {
+    for(int i = 0; i < count; i++, writer->bits++) {
+        Uint8 *byte = &writer->out[writer->bits >> 3];
+        if((writer->bits & 7) == 0)
+            *byte = 0;
+        *byte |= (Uint8)(((value >> i) & 1) << (writer->bits & 7));
+    }
+}
+
+// Bytes the bits written take
+static inline size_t bit_bytes(const BitWriter *writer) {
+    return (writer->bits + 7) >> 3;
+}
+
+typedef struct
+{
+    const Uint8 *data;
+    size_t size; // bytes
+    size_t bits; // read so far
+} BitReader;
+
+// Reads count bits into *value, false if they run past the data
+static inline bool get_bits(BitReader *reader, int count, Uint64 *value) {
+    if(reader->bits + count > reader->size * 8)
+        return false;
+    *value = 0;
+    for(int i = 0; i < count; i++, reader->bits++) {
+        *value |= (Uint64)((reader->data[reader->bits >> 3] >> (reader->bits & 7)) & 1) << i;
+    }
+    return true;
+}
+
+// Bits it takes to write any number below n
+static inline int bits_for(Uint64 n) {
+    return n > 1 ? highest_bit(n - 1) + 1 : 0;
+}
+
+#endif // TRON_BITS_H
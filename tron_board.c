@@ -0,0 +1,444 @@
+// Board storage and queries. See tron_board.h
+#include <SDL3/SDL.h>
+#include "tron_board.h"
+#include "tron_bits.h"
+
+#ifdef TRON_BITBOARD
+static Uint64 *bitboard_layer(Board *board, Cell cell) {
+    if(cell_is_player(cell))
+        return &board->player_rows[(cell - CELL_P1) * board->height];
+    if(cell == CELL_DEAD)
+        return board->dead_rows;
+    if(cell == CELL_ITEM_STAR || cell == CELL_ITEM_BOMB)
+        return board->item_rows;
+    return NULL;
+}
+
+// rebuild the blocked masks for a single cell, dead and player cells both block
+static void bitboard_update_blocked(Board *board, int x, int y) {
+    if(cell_blocks(board->cells[board_index(board, x, y)])) {
+        board->blocked_rows[y] |= (Uint64)1 << x;
+        board->blocked_cols[x] |= (Uint64)1 << y;
+    } else {
+        board->blocked_rows[y] &= ~((Uint64)1 << x);
+        board->blocked_cols[x] &= ~((Uint64)1 << y);
+    }
+}
+
+static int bitboard_get_path_length(const Board *board, int x, int y, CharacterDirection direction) {
+    Uint64 mask;
+    switch (direction) {
+    case DIR_RIGHT:
+        mask = x + 1 < 64 ? board->blocked_rows[y] >> (x + 1) : 0;
+        return mask ? lowest_bit(mask) : board->width - 1 - x;
+    case DIR_LEFT:
+        mask = board->blocked_rows[y] & (((Uint64)1 << x) - 1);
+        return mask ? x - 1 - highest_bit(mask) : x;
+    case DIR_DOWN:
+        mask = y + 1 < 64 ? board->blocked_cols[x] >> (y + 1) : 0;
+        return mask ? lowest_bit(mask) : board->height - 1 - y;
+    case DIR_UP:
+        mask = board->blocked_cols[x] & (((Uint64)1 << y) - 1);
+        return mask ? y - 1 - highest_bit(mask) : y;
+    default:
+        SDL_Log("ERROR - Invalid direction");
+        return 0;
+    }
+}
+#endif // TRON_BITBOARD
+
+static inline Uint32 free_slot_get(const Board *board, int index) {
+    return board->narrow ? ((const Uint16 *)board->free_slot)[index] : ((const Uint32 *)board->free_slot)[index];
+}
+
+// free_cells[slot] = index and free_slot[index] = slot
+static inline void free_cells_place(Board *board, Uint32 slot, Uint32 index) {
+    if(board->narrow) {
+        ((Uint16 *)board->free_cells)[slot] = (Uint16)index;
+        ((Uint16 *)board->free_slot)[index] = (Uint16)slot;
+    } else {
+        ((Uint32 *)board->free_cells)[slot] = index;
+        ((Uint32 *)board->free_slot)[index] = slot;
+    }
+}
+
+static void free_cells_add(Board *board, int index) {
+    free_cells_place(board, (Uint32)board->free_count++, (Uint32)index);
+}
+
+// swap the last free cell into the removed one's slot
+static void free_cells_remove(Board *board, int index) {
+    Uint32 slot = free_slot_get(board, index);
+    Uint32 last = board_free_cell(board, --board->free_count);
+    free_cells_place(board, slot, last);
+}
+
+#ifndef TRON_BITBOARD
+// run of the cell behind one with the given run
+static inline Uint8 run_after(Uint8 run) {
+    return run < RUN_SATURATED ? run + 1 : RUN_SATURATED;
+}
+
+// Rebuild every free run from scratch, sweeping against each direction so the neighbour is always done first
+static void initialize_runs(Board *board) {
+    for(int dir = 0; dir < 4; dir++) {
+        int step = board->step[dir];
+        Uint8 *run = board->runs[dir];
+        for(int n = 0; n < board->cell_count; n++) {
+            int i = step > 0 ? board->cell_count - 1 - n : n;
+            int next = i + step;
+            run[i] = (next < 0 || next >= board->cell_count || cell_blocks(board->cells[next])) ? 0 : run_after(run[next]);
+        }
+    }
+}
+
+// A cell switched between free and blocked, fix the runs of the cells behind it in every direction.
+// The walk stops after the first blocked cell, at the latest on the border.
+SDL_FORCE_INLINE void update_runs_kernel(Board *board, int width, int height, int index) {
+    const int stride = width + 2;
+    const int steps[4] = { 1, -stride, -1, stride };
+    // locals, the byte stores to run could otherwise alias the board's pointers
+    const Uint8 *cells = board->cells;
+    bool blocked = cell_blocks(cells[index]);
+    for(int dir = 0; dir < 4; dir++) {
+        int step = steps[dir];
+        Uint8 *run = board->runs[dir];
+        int i = index - step;
+        if(width <= RUN_SATURATED && height <= RUN_SATURATED) {
+            // no run can get to RUN_SATURATED, the usual case and the default arena's only one
+            Uint8 length = blocked ? 0 : run[index] + 1;
+            run[i] = length;
+            while(!cell_blocks(cells[i])) {
+                i -= step;
+                run[i] = ++length;
+            }
+        } else {
+            int length = blocked ? 0 : run[index] + 1;
+            run[i] = (Uint8)SDL_min(length, RUN_SATURATED);
+            while(!cell_blocks(cells[i])) {
+                i -= step;
+                length++;
+                run[i] = (Uint8)SDL_min(length, RUN_SATURATED);
+            }
+        }
+    }
+}
+
+static void update_runs(Board *board, int index) {
+    BOARD_SPECIALIZE(board, update_runs_kernel, index);
+}
+#endif // TRON_BITBOARD
+
+// Build an empty board with the border filled with wall
+static void build_empty_board(Board *board) {
+    SDL_memset(board->storage, 0, board->storage_size);
+    SDL_memset(board->cells, CELL_WALL, board->stride);
+    for(int j = 0; j < board->height; j++) {
+        Uint8 *row = &board->cells[board_index(board, -1, j)];
+        row[0] = CELL_WALL;
+        SDL_memset(row + 1, CELL_NOTHING, board->width);
+        row[board->width + 1] = CELL_WALL;
+    }
+    SDL_memset(&board->cells[board_index(board, -1, board->height)], CELL_WALL, board->stride);
+    board->dead_players = 0;
+    board->free_count = 0;
+    for(int j = 0; j < board->height; j++) {
+        for(int i = 0; i < board->width; i++) {
+            free_cells_add(board, board_index(board, i, j));
+        }
+    }
+#ifndef TRON_BITBOARD
+    initialize_runs(board);
+#endif
+}
+
+// Hand out the next array of the board from base, 8 byte aligned. base may be NULL to only add up the size
+static void *carve(Uint8 *base, size_t *offset, size_t size) {
+    void *array = base ? base + *offset : NULL;
+    *offset += (size + 7) & ~(size_t)7;
+    return array;
+}
+
+// Point every array of the board into base and return how many bytes they take
+static size_t board_layout(Board *board, Uint8 *base) {
+    size_t offset = 0;
+    size_t cells = (size_t)board->cell_count;
+    board->cells = (Uint8 *)carve(base, &offset, cells);
+    size_t index_size = board->narrow ? sizeof(Uint16) : sizeof(Uint32);
+    board->free_cells = carve(base, &offset, (size_t)board->width * board->height * index_size);
+    board->free_slot = carve(base, &offset, cells * index_size);
+#ifndef TRON_BITBOARD
+    for(int dir = 0; dir < 4; dir++) {
+        board->runs[dir] = (Uint8 *)carve(base, &offset, cells);
+    }
+#else
+    board->player_rows = (Uint64 *)carve(base, &offset, (size_t)board->players * board->height * sizeof(Uint64));
+    board->dead_rows = (Uint64 *)carve(base, &offset, board->height * sizeof(Uint64));
+    board->item_rows = (Uint64 *)carve(base, &offset, board->height * sizeof(Uint64));
+    board->blocked_rows = (Uint64 *)carve(base, &offset, board->height * sizeof(Uint64));
+    board->blocked_cols = (Uint64 *)carve(base, &offset, board->width * sizeof(Uint64));
+#endif
+    return offset;
+}
+
+bool board_init(Board *board, int width, int height, int players) {
+    if(board->storage && board->width == width && board->height == height && board->players == players) {
+        initialize_game_board(board);
+        return true;
+    }
+    board_free(board);
+
+    if(width < BOARD_MIN_SIZE || width > BOARD_MAX_SIZE || height < BOARD_MIN_SIZE || height > BOARD_MAX_SIZE)
+        return SDL_SetError("Board size %dx%d out of range, sides go from %d to %d", width, height, BOARD_MIN_SIZE, BOARD_MAX_SIZE);
+    if(players < 1 || players > MAX_PLAYERS)
+        return SDL_SetError("%d players out of range, at most %d", players, MAX_PLAYERS);
+#ifdef TRON_BITBOARD
+    if(width > 64 || height > 64)
+        return SDL_SetError("The bitboard build only takes boards up to 64x64");
+#endif
+
+    board->width = width;
+    board->height = height;
+    board->stride = width + 2;
+    board->cell_count = board->stride * (height + 2);
+    board->narrow = board->cell_count <= BOARD_NARROW_CELLS;
+    board->players = players;
+    board->step[DIR_RIGHT] = 1;
+    board->step[DIR_UP] = -board->stride;
+    board->step[DIR_LEFT] = -1;
+    board->step[DIR_DOWN] = board->stride;
+
+    board->storage_size = board_layout(board, NULL);
+    board->storage = SDL_malloc(board->storage_size);
+    board->empty_storage = SDL_malloc(board->storage_size);
+    if(!board->storage || !board->empty_storage) {
+        board_free(board);
+        return false;
+    }
+    board_layout(board, (Uint8 *)board->storage);
+    build_empty_board(board);
+    SDL_memcpy(board->empty_storage, board->storage, board->storage_size);
+    return true;
+}
+
+void board_free(Board *board) {
+    SDL_free(board->storage);
+    SDL_free(board->empty_storage);
+    SDL_zerop(board);
+}
+
+void board_copy(Board *dst, const Board *src) {
+    SDL_assert(dst->storage_size == src->storage_size && dst->width == src->width && dst->height == src->height);
+    SDL_memcpy(dst->storage, src->storage, src->storage_size);
+    dst->dead_players = src->dead_players;
+    dst->free_count = src->free_count;
+}
+
+// Reset the game board so that each cell is empty and the border is wall
+void initialize_game_board(Board *board) {
+    SDL_memcpy(board->storage, board->empty_storage, board->storage_size);
+    board->dead_players = 0;
+    board->free_count = board->width * board->height;
+}
+
+void board_set(Board *board, int x, int y, Cell cell) {
+    int index = board_index(board, x, y);
+    Uint8 *slot = &board->cells[index];
+    if(*slot == CELL_NOTHING && cell != CELL_NOTHING)
+        free_cells_remove(board, index);
+    else if(*slot != CELL_NOTHING && cell == CELL_NOTHING)
+        free_cells_add(board, index);
+#ifdef TRON_BITBOARD
+    Uint64 *old_layer = bitboard_layer(board, board_resolve(board, *slot));
+    Uint64 *new_layer = bitboard_layer(board, cell);
+    if(old_layer)
+        old_layer[y] &= ~((Uint64)1 << x);
+    if(new_layer)
+        new_layer[y] |= (Uint64)1 << x;
+    *slot = (Uint8)cell;
+    bitboard_update_blocked(board, x, y);
+#else
+    bool was_blocked = cell_blocks(*slot);
+    *slot = (Uint8)cell;
+    if(was_blocked != cell_blocks(*slot))
+        update_runs(board, index);
+#endif
+}
+
+// Turn every cell of a player's tail into a dead cell, the cells are left as is and read back as dead
+void board_kill_player(Board *board, Cell player) {
+    board->dead_players |= (Uint64)1 << (player - CELL_P1);
+#ifdef TRON_BITBOARD
+    // the cells stay blocked, they only move from the player's layer to the dead one
+    Uint64 *rows = bitboard_layer(board, player);
+    for(int j = 0; j < board->height; j++) {
+        board->dead_rows[j] |= rows[j];
+        rows[j] = 0;
+    }
+#endif
+}
+
+size_t board_pack_bound(const Board *board) {
+    // a run of one cell takes 2 bytes, a free cell index at most 5
+    return 2 * VARINT_MAX_BYTES + (size_t)board->cell_count * 2 + (size_t)board->width * board->height * 5;
+}
+
+size_t board_pack(const Board *board, Uint8 *out) {
+    size_t size = put_varint(out, board->dead_players);
+    // mostly in order, the deltas (zigzag encoded) fit a byte
+    size += put_varint(&out[size], (Uint64)board->free_count);
+    Sint64 previous = 0;
+    for(int i = 0; i < board->free_count; i++) {
+        Sint64 delta = (Sint64)board_free_cell(board, i) - previous;
+        size += put_varint(&out[size], ((Uint64)delta << 1) ^ (Uint64)(delta >> 63));
+        previous = board_free_cell(board, i);
+    }
+    for(int i = 0; i < board->cell_count; ) {
+        int start = i;
+        while(i < board->cell_count && board->cells[i] == board->cells[start])
+            i++;
+        size += put_varint(&out[size], (Uint64)(i - start));
+        out[size++] = board->cells[start];
+    }
+    return size;
+}
+
+bool board_unpack(Board *board, const Uint8 *data, size_t size) {
+    size_t pos = 0;
+    Uint64 value;
+    Uint64 free_count;
+    if(!get_varint(data, size, &pos, &board->dead_players) || !get_varint(data, size, &pos, &free_count) ||
+       free_count > (Uint64)board->width * board->height)
+        return SDL_SetError("damaged board snapshot");
+    board->free_count = (int)free_count;
+    Sint64 previous = 0;
+    for(int i = 0; i < board->free_count; i++) {
+        if(!get_varint(data, size, &pos, &value))
+            return SDL_SetError("damaged board snapshot");
+        previous += (Sint64)(value >> 1) ^ -(Sint64)(value & 1);
+        if(previous < 0 || previous >= board->cell_count)
+            return SDL_SetError("damaged board snapshot");
+        free_cells_place(board, (Uint32)i, (Uint32)previous);
+    }
+    for(int i = 0; i < board->cell_count; ) {
+        if(!get_varint(data, size, &pos, &value) || value == 0 || value > (Uint64)(board->cell_count - i) || pos >= size)
+            return SDL_SetError("damaged board snapshot");
+        SDL_memset(&board->cells[i], data[pos++], (size_t)value);
+        i += (int)value;
+    }
+#ifndef TRON_BITBOARD
+    initialize_runs(board);
+#else
+    SDL_memset(board->player_rows, 0, (size_t)board->players * board->height * sizeof(Uint64));
+    for(int y = 0; y < board->height; y++) {
+        board->dead_rows[y] = board->item_rows[y] = board->blocked_rows[y] = 0;
+    }
+    for(int x = 0; x < board->width; x++) {
+        board->blocked_cols[x] = 0;
+    }
+    for(int y = 0; y < board->height; y++) {
+        for(int x = 0; x < board->width; x++) {
+            Uint64 *layer = bitboard_layer(board, board_resolve(board, board->cells[board_index(board, x, y)]));
+            if(layer)
+                layer[y] |= (Uint64)1 << x;
+            bitboard_update_blocked(board, x, y);
+        }
+    }
+#endif
+    return true;
+}
+
+// Picks a uniformly random empty cell, returns false when the board is full
+bool board_random_free_cell(const Board *board, Uint64 *rng, int *x, int *y) {
+    if(board->free_count == 0)
+        return false;
+    int index = (int)board_free_cell(board, SDL_rand_r(rng, board->free_count));
+    *x = board_index_x(board, index);
+    *y = board_index_y(board, index);
+    return true;
+}
+
+// Returns the number of empty cells in a single direction from a particular location
+static int matrix_get_path_length(const Board *board, int x, int y, CharacterDirection direction) {
+    int path_length = 0;
+    if(direction < DIR_RIGHT || direction > DIR_DOWN) {
+        SDL_Log("ERROR - Invalid direction");
+        return 0;
+    }
+    int increment = board->step[direction];
+
+    // the walk always ends on the border at the latest
+    const Uint8 *cell = &board->cells[board_index(board, x, y) + increment];
+    while(!cell_blocks(*cell)) {
+        path_length++;
+        cell += increment;
+    }
+    return path_length;
+}
+
+int get_path_length(const Board *board, int x, int y, CharacterDirection direction) {
+#ifdef TRON_BITBOARD
+    return bitboard_get_path_length(board, x, y, direction);
+#else
+    int run = board->runs[direction][board_index(board, x, y)];
+    // only on boards bigger than RUN_SATURATED, the rest of the run is walked
+    if(run == RUN_SATURATED)
+        return matrix_get_path_length(board, x, y, direction);
+    return run;
+#endif
+}
+
+bool board_verify(const Board *board) {
+    int free_count = 0;
+    for(int x = 0; x < board->width; x++) {
+        for(int y = 0; y < board->height; y++) {
+            int index = board_index(board, x, y);
+            Cell cell = board_get(board, x, y);
+            if(cell == CELL_NOTHING) {
+                free_count++;
+                Uint32 slot = free_slot_get(board, index);
+                if(slot >= (Uint32)board->free_count || board_free_cell(board, (int)slot) != (Uint32)index) {
+                    SDL_Log("ERROR - empty cell (%d,%d) missing from the free cells\n", x, y);
+                    return false;
+                }
+            }
+            for(int dir = DIR_RIGHT; dir <= DIR_DOWN; dir++) {
+                int expected = matrix_get_path_length(board, x, y, (CharacterDirection)dir);
+#ifndef TRON_BITBOARD
+                if(board->runs[dir][index] != SDL_min(expected, RUN_SATURATED)) {
+                    SDL_Log("ERROR - free run mismatch at (%d,%d) dir %d: walk %d, table %d\n", x, y, dir, expected, board->runs[dir][index]);
+                    return false;
+                }
+#else
+                int actual = bitboard_get_path_length(board, x, y, (CharacterDirection)dir);
+                if(expected != actual) {
+                    SDL_Log("ERROR - bitboard path length mismatch at (%d,%d) dir %d: matrix %d, bitboard %d\n", x, y, dir, expected, actual);
+                    return false;
+                }
+#endif
+            }
+#ifdef TRON_BITBOARD
+            // stars and bombs share the item layer, so CELL_ITEM_STAR is covered by CELL_ITEM_BOMB
+            for(int layer = CELL_ITEM_BOMB; layer < CELL_P1 + board->players; layer++) {
+                if(layer == CELL_WALL)
+                    continue;
+                bool expected = cell == (Cell)layer || (layer == CELL_ITEM_BOMB && cell == CELL_ITEM_STAR);
+                bool actual = (bitboard_layer((Board *)board, (Cell)layer)[y] >> x) & 1;
+                if(expected != actual) {
+                    SDL_Log("ERROR - bitboard layer %d mismatch at (%d,%d), cell: %d\n", layer, x, y, cell);
+                    return false;
+                }
+            }
+            if(is_collision(board, x, y) != cell_blocks(board->cells[index])) {
+                SDL_Log("ERROR - bitboard collision mismatch at (%d,%d), cell: %d\n", x, y, cell);
+                return false;
+            }
+#endif
+        }
+    }
+    if(free_count != board->free_count) {
+        SDL_Log("ERROR - %d empty cells on the board but %d in the free cells\n", free_count, board->free_count);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,218 @@
+/*
+  The game board: what occupies every cell of the arena, plus the queries the rules and the AI
+  run against it (collisions and free path lengths).
+
+  The arena size and the number of players are picked at runtime (board_init), anywhere from
+  BOARD_MIN_SIZE to BOARD_MAX_SIZE cells a side and up to MAX_PLAYERS players. Every array of the
+  board lives in one allocation, along with a copy of the same arrays for an empty board so a new
+  match is a single memcpy.
+
+  Cells are stored one byte each, row-major, with a one cell border around the arena that is
+  pre-filled with CELL_WALL. Anything a head can reach in a single move is therefore a valid index
+  and the matrix backend's collision check is a single load without any bounds checking.
+
+  Loops over the whole board (or a whole row or column of it) are written as kernels taking the
+  width and height as arguments and called through BOARD_SPECIALIZE, which passes constants for the
+  default 60x40 arena. The compiler then builds a copy of the kernel with fixed strides and loop
+  bounds for that arena and a generic one for every other size.
+
+  The board also keeps every empty cell in a sparse set (free_cells is a dense list of cell
+  indices, free_slot maps a cell back to its position in that list), updated by every board_set.
+  Picking a random empty cell is a single draw no matter how full the board is. The indices are
+  Uint16 on boards of up to BOARD_NARROW_CELLS padded cells (anything up to 254x254, the usual
+  arenas) and Uint32 past that, which keeps the storage of the default arena small enough for a
+  snapshot to be a memcpy that stays in L1 (sim_snapshot).
+
+  When a player crashes their cells are not rewritten. The player is flagged in dead_players and
+  every read through board_get reports the cells they still own as CELL_DEAD, so a death costs the
+  same no matter how long the tail is. Collisions don't care, both are obstacles.
+
+  Free runs: runs[dir][cell] is the number of free cells from a cell up to the nearest obstacle
+  in that direction, i.e. get_path_length. Cells only ever change between free and blocked one at
+  a time, so board_set only has to touch the stretch of the row and column in front of and
+  behind the changed cell. Runs are bytes so the tables of the usual arenas stay in L1, a run
+  of RUN_SATURATED means "at least that long" and get_path_length walks the rest of it. The
+  bitboard backend answers path lengths from its masks and doesn't keep the runs.
+
+  Two backends are available for the collision and path length queries, picked at build time:
+   * the default matrix backend, collisions are a load of the cell and path lengths are a lookup
+     in the free run tables
+   * the bitboard backend (TRON_BITBOARD, cmake -DTRON_BITBOARD=ON) which also keeps every
+     layer (each player's trail, dead trails and items) as one 64-bit mask per row. Collision is a
+     single bit test of the blocked row and path lengths are a count leading/trailing zeros on a
+     row or column mask. A row or column has to fit in a mask, so this backend only takes arenas
+     up to 64x64.
+  All writes have to go through board_set / board_kill_player so both stay in sync.
+*/
+#ifndef TRON_BOARD_H
+#define TRON_BOARD_H
+
+#include <SDL3/SDL_stdinc.h>
+#include <stdbool.h>
+
+// the arena and player count a match gets unless asked otherwise
+#define TRON_DEFAULT_WIDTH   60
+#define TRON_DEFAULT_HEIGHT  40
+#define TRON_DEFAULT_PLAYERS 4
+
+#define MAX_PLAYERS    64   // dead_players has a bit per player
+#define BOARD_MIN_SIZE 8
+#define BOARD_MAX_SIZE 2048 // a board this size takes about 110MB
+#define RUN_SATURATED  255
+#define BOARD_NARROW_CELLS 65536 // most padded cells with Uint16 free cell indices
+
+// Cell on the game board - shows if any player occupies that square.
+// Player cells start at CELL_P1, player i (0 based) is CELL_PLAYER(i)
+typedef enum
+{
+    CELL_NOTHING   = 0U,
+    CELL_ITEM_STAR = 1U,
+    CELL_ITEM_BOMB = 2U,
+    CELL_WALL      = 3U, // only in the border around the arena
+    CELL_DEAD      = 4U,
+    CELL_P1        = 5U
+} Cell;
+
+#define CELL_PLAYER(index) ((Cell)(CELL_P1 + (index)))
+
+// possible direction
+typedef enum
+{
+    DIR_RIGHT,
+    DIR_UP,
+    DIR_LEFT,
+    DIR_DOWN
+} CharacterDirection;
+
+static inline bool is_reverse(CharacterDirection curr_dir, CharacterDirection dir) {
+    return ((curr_dir + 2) & 3) == dir;
+}
+
+typedef struct
+{
+    int width;
+    int height;
+    int stride;     // width + 2, cells in a padded row
+    int cell_count; // padded cells, stride * (height + 2)
+    int players;
+    int step[4];    // how far apart neighbouring cells are, indexed by CharacterDirection
+    Uint8 *cells;
+    Uint64 dead_players; // bit (player - CELL_P1) is set once that player crashed
+    void *free_cells;    // indices of every CELL_NOTHING cell, first free_count are valid (board_free_cell)
+    void *free_slot;     // position of an empty cell in free_cells
+    int free_count;
+    bool narrow;         // free_cells and free_slot hold Uint16, see the top of the file
+#ifndef TRON_BITBOARD
+    Uint8 *runs[4];      // free cells up to the nearest obstacle (RUN_SATURATED or more), indexed by CharacterDirection then cell
+#else
+    Uint64 *player_rows;  // height masks per player, bit x of player_rows[p * height + y] is set when p occupies (x,y)
+    Uint64 *dead_rows;
+    Uint64 *item_rows;
+    Uint64 *blocked_rows; // everything a player crashes into (players + dead), by row
+    Uint64 *blocked_cols; // same as blocked_rows but transposed, bit y of column x
+#endif
+    void *storage;        // all of the arrays above
+    void *empty_storage;  // the arrays of an empty board, copied over storage by initialize_game_board
+    size_t storage_size;
+} Board;
+
+// Index of a cell in a board with the given stride, x and y may be -1 or width/height to reach the border
+static inline int board_index_in(int stride, int x, int y) {
+    return (y + 1) * stride + x + 1;
+}
+
+static inline int board_index(const Board *board, int x, int y) {
+    return board_index_in(board->stride, x, y);
+}
+
+static inline int board_index_x(const Board *board, int index) {
+    return index % board->stride - 1;
+}
+
+static inline int board_index_y(const Board *board, int index) {
+    return index / board->stride - 1;
+}
+
+// The i-th of the free cells, i below free_count
+static inline Uint32 board_free_cell(const Board *board, int i) {
+    return board->narrow ? ((const Uint16 *)board->free_cells)[i] : ((const Uint32 *)board->free_cells)[i];
+}
+
+static inline bool board_is_default(const Board *board) {
+    return board->width == TRON_DEFAULT_WIDTH && board->height == TRON_DEFAULT_HEIGHT;
+}
+
+// Call kernel(board, width, height, ...) with constant geometry for the default arena, see the top of the file
+#define BOARD_SPECIALIZE(board, kernel, ...)                                                              \
+    (board_is_default(board) ? kernel((board), TRON_DEFAULT_WIDTH, TRON_DEFAULT_HEIGHT, __VA_ARGS__) \
+                             : kernel((board), (board)->width, (board)->height, __VA_ARGS__))
+
+// Set the board up for an arena and player count, returns false (with SDL_GetError set) when they
+// are out of range or out of memory. The board is left empty, same as initialize_game_board.
+bool board_init(Board *board, int width, int height, int players);
+void board_free(Board *board);
+// Copy the contents of a board into another one with the same geometry
+void board_copy(Board *dst, const Board *src);
+
+void initialize_game_board(Board *board);
+void board_set(Board *board, int x, int y, Cell cell);
+void board_kill_player(Board *board, Cell player);
+// Compact copy of a board's contents for replay keyframes: the cells run-length encoded, the order
+// of the free cells (board_random_free_cell depends on it) and the dead players. The free runs, free
+// slots and bitboards are rebuilt by board_unpack. out needs board_pack_bound bytes
+size_t board_pack_bound(const Board *board);
+size_t board_pack(const Board *board, Uint8 *out);
+// board must have the packed board's geometry, returns false when data doesn't fit it
+bool board_unpack(Board *board, const Uint8 *data, size_t size);
+// rng is an SDL_rand_r state, the match passes its own so the pick is reproducible
+bool board_random_free_cell(const Board *board, Uint64 *rng, int *x, int *y);
+
+static inline bool cell_is_player(Uint8 cell) {
+    return cell >= CELL_P1;
+}
+
+// What a stored cell value currently means, cells owned by a crashed player read as CELL_DEAD
+static inline Cell board_resolve(const Board *board, Uint8 cell) {
+    if(cell_is_player(cell) && (board->dead_players >> (cell - CELL_P1)) & 1)
+        return CELL_DEAD;
+    return (Cell)cell;
+}
+
+static inline Cell board_get(const Board *board, int x, int y) {
+    return board_resolve(board, board->cells[board_index(board, x, y)]);
+}
+
+// wall, dead and player cells are at the top of the range so anything that stops a player is a single compare
+static inline bool cell_blocks(Uint8 cell) {
+    return cell >= CELL_WALL;
+}
+
+// Check if player collided with a wall
+static inline bool collides_with_wall(const Board *board, int x, int y) {
+    return board->cells[board_index(board, x, y)] == CELL_WALL;
+}
+
+// checks if player collided with another player
+static inline bool collides_with_player(const Board *board, int x, int y) {
+    return board->cells[board_index(board, x, y)] >= CELL_DEAD;
+}
+
+// Checks if player collided with a wall or another player's tail
+static inline bool is_collision(const Board *board, int x, int y) {
+#ifdef TRON_BITBOARD
+    // the border isn't in the masks, the unsigned compares catch -1 as well
+    if((unsigned)x >= (unsigned)board->width || (unsigned)y >= (unsigned)board->height)
+        return true;
+    return (board->blocked_rows[y] >> x) & 1;
+#else
+    return cell_blocks(board->cells[board_index(board, x, y)]);
+#endif
+}
+
+int get_path_length(const Board *board, int x, int y, CharacterDirection direction);
+
+// Cross check the free cells and the free runs (or the bitboard) against a walk of the board,
+// logs and returns false on the first mismatch
+bool board_verify(const Board *board);
+
+#endif // TRON_BOARD_H
@@ -0,0 +1,333 @@
+/*
+  Plays tron matches back to back without a window, renderer or audio device.
+
+  usage: tron_headless [--matches N] [--width N] [--height N] [--players N] [--humans N] [--ai TYPE[,TYPE...]]
+                       [--ai-budget-ms N] [--ai-threads N] [--seed N] [--verify] [--record DIR]
+       tron_headless --replay FILE
+
+  --width and --height pick the arena (60x40 by default) and --players how many take part (4 by
+  default, up to 64), --humans of them are "human".
+
+  --ai sets the strategy of the computer players (classic, voronoi, search or mcts). A comma separated
+  list gives each computer player its own, the last entry is used for any player left over.
+
+  --ai-budget-ms is the thinking time all computer players share per tick (half a step by
+  default). The search and MCTS AIs use all of it, so it sets how fast those matches run.
+  --ai-threads sets how many threads MCTS runs on (one per core by default).
+
+  Computer players use their normal AI. "Human" slots are fed a random turn every few ticks so
+  that the input path gets exercised too.
+
+  Match m is played with seed --seed + m (0 by default). Everything random in a match comes from
+  its seed, so any single match can be played again on its own with --seed N --matches 1, as long
+  as the computer players didn't run out of thinking time (search and MCTS always do).
+
+  --record saves every match to DIR/<seed>.trpl (tron_replay.h). --replay plays a saved match
+  back and checks it ends the way it was recorded. Replays carry the match hash (tron_sim.h) so a
+  replay that goes another way is caught on the tick it does, the match is then written to
+  FILE.desync.txt (sim_dump).
+
+  --verify cross checks the board's free cells, free run tables, the running match hash and (when
+  built with TRON_BITBOARD) the bitboard against a walk of the board after every tick of every
+  match, and exits with an error on the first mismatch. Recorded and replayed matches are also seeked to
+  random ticks through their keyframes, and every seek has to land on the same state as playing
+  straight through.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+#include "tron_ai.h"
+#include "tron_replay.h"
+
+// Feed random inputs to the human controlled players
+static void feed_random_inputs(AppState *as, Uint64 *rng) {
+    for(int i = 0; i < as->total_human_players; i++) {
+        if(SDL_rand_r(rng, 8) == 0) {
+            sim_set_input(as, i, (CharacterDirection)SDL_rand_r(rng, 4));
+        }
+    }
+}
+
+#define SEEK_CHECKS 64
+
+static Uint64 *fingerprints; // of every tick of the match being verified
+static size_t fingerprint_capacity;
+
+// Hash of the board, the item RNG and the players, what a seek has to get back exactly
+static Uint64 match_fingerprint(const AppState *as) {
+    Uint64 hash = 14695981039346656037ULL ^ as->rng ^ as->tick << 32;
+    for(int i = 0; i < as->board.cell_count; i++) {
+        hash = (hash ^ as->board.cells[i]) * 1099511628211ULL;
+    }
+    for(int i = 0; i < as->board.free_count; i++) {
+        hash = (hash ^ board_free_cell(&as->board, i)) * 1099511628211ULL;
+    }
+    for(int i = 0; i < as->total_human_players + as->total_computer_players; i++) {
+        const CharacterContext *ctx = &as->character_ctx[i];
+        Uint64 player = (Uint64)ctx->head_xpos | (Uint64)ctx->head_ypos << 16 | (Uint64)ctx->next_dir << 32 |
+                        (Uint64)ctx->is_alive << 40 | (Uint64)ctx->is_invinsible << 41;
+        hash = (hash ^ player) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool keep_fingerprint(const AppState *as) {
+    if(as->tick >= fingerprint_capacity) {
+        size_t capacity = SDL_max(fingerprint_capacity * 2, 1024);
+        Uint64 *grown = (Uint64 *)SDL_realloc(fingerprints, capacity * sizeof(Uint64));
+        if(!grown)
+            return false;
+        fingerprints = grown;
+        fingerprint_capacity = capacity;
+    }
+    fingerprints[as->tick] = match_fingerprint(as);
+    return true;
+}
+
+// Seek around the replay's match and compare with the fingerprints of playing it straight through,
+// the last seek goes back to the end
+static bool check_seeks(AppState *as, Replay *replay, Uint64 seed) {
+    Uint64 rng = seed;
+    for(int i = 0; i < SEEK_CHECKS; i++) {
+        Uint64 tick = i == SEEK_CHECKS - 1 ? replay->header.ticks : (Uint64)SDL_rand_r(&rng, (Sint32)replay->header.ticks + 1);
+        if(!replay_seek(replay, as, tick)) {
+            fprintf(stderr, "seek to tick %" SDL_PRIu64 " failed: %s\n", tick, SDL_GetError());
+            return false;
+        }
+        if(as->tick != tick || match_fingerprint(as) != fingerprints[tick] || !board_verify(&as->board) ||
+           as->hash != sim_compute_hash(as)) {
+            fprintf(stderr, "seek to tick %" SDL_PRIu64 " of seed %" SDL_PRIu64 " landed somewhere else\n", tick, replay->header.seed);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Play one match to completion, returns the number of ticks it took or 0 if verification failed.
+// rec is NULL when the match isn't recorded
+static Uint64 play_match(AppState *as, int players, int humans, const AiType *ais, int ai_count, bool verify, ReplayRecorder *rec) {
+    Uint64 input_rng = as->seed; // the "humans" get their own stream so the match's stays the simulation's
+    as->scripted = false;
+    if(!sim_init_match(as, humans, players - humans)) {
+        fprintf(stderr, "couldn't start a match: %s\n", SDL_GetError());
+        return 0;
+    }
+    for(int i = humans; i < players; i++) {
+        as->character_ctx[i].ai = ais[SDL_min(i - humans, ai_count - 1)];
+    }
+    if(rec)
+        replay_record_begin(rec, as);
+    if(verify && !keep_fingerprint(as))
+        return 0;
+    while(!sim_is_over(as)) {
+        feed_random_inputs(as, &input_rng);
+        sim_step(as);
+        if(rec)
+            replay_record_tick(rec, as);
+        if(verify && (!board_verify(&as->board) || as->hash != sim_compute_hash(as) || !keep_fingerprint(as))) {
+            fprintf(stderr, "board verification failed at tick %" SDL_PRIu64 " of seed %" SDL_PRIu64 "\n", as->tick, as->seed);
+            return 0;
+        }
+    }
+    if(rec) {
+        replay_record_end(rec, as);
+        if(verify) {
+            Replay view;
+            replay_view_recording(&view, rec);
+            bool seeks_ok = check_seeks(as, &view, as->seed);
+            replay_close(&view);
+            if(!seeks_ok)
+                return 0;
+        }
+    }
+    return as->tick;
+}
+
+// Write the match next to the replay it went wrong in
+static void dump_match(const AppState *as, const char *replay_path) {
+    char path[1024];
+    SDL_snprintf(path, sizeof(path), "%s.desync.txt", replay_path);
+    SDL_IOStream *io = SDL_IOFromFile(path, "w");
+    bool written = io && sim_dump(as, io);
+    if(io && !SDL_CloseIO(io))
+        written = false;
+    if(written)
+        fprintf(stderr, "the match as played is in %s\n", path);
+    else
+        fprintf(stderr, "couldn't write %s: %s\n", path, SDL_GetError());
+}
+
+// Play a saved match back, returns the process exit code
+static int play_replay(AppState *as, const char *path, bool verify) {
+    Replay replay;
+    ReplayTimeline timeline = {0};
+    if(!replay_open(&replay, path)) {
+        fprintf(stderr, "%s: %s\n", path, SDL_GetError());
+        return 1;
+    }
+    if(!replay_begin(&replay, as)) {
+        fprintf(stderr, "couldn't start the match: %s\n", SDL_GetError());
+        replay_close(&replay);
+        return 1;
+    }
+    replay.timeline = &timeline;
+    SDL_ClearError();
+    bool fingerprinted = !verify || keep_fingerprint(as);
+    while(replay_step(&replay, as)) {
+        fingerprinted = fingerprinted && (!verify || keep_fingerprint(as));
+    }
+
+    const ReplayHeader *header = &replay.header;
+    int winner = replay_match_winner(as);
+    bool same = *SDL_GetError() == '\0' && sim_is_over(as) && as->tick == header->ticks && winner == header->winner;
+    printf("seed:    %" SDL_PRIu64 "\n", header->seed);
+    printf("arena:   %dx%d, %d players\n", header->width, header->height, header->players);
+    printf("ticks:   %" SDL_PRIu64 "\n", as->tick);
+    char name[PLAYER_NAME_SIZE];
+    printf("winner:  %s\n", winner < header->players ? sim_player_name(as, winner, name) : "draw");
+    printf("size:    %zu bytes\n", replay.file_size);
+    if(!same) {
+        fprintf(stderr, "replay diverged: %s\n", *SDL_GetError() ? SDL_GetError() : "different result");
+        dump_match(as, path);
+    }
+    else if(verify)
+        same = fingerprinted && check_seeks(as, &replay, header->seed);
+    printf("seeks:   %s\n", !verify ? "not checked" : same ? "ok" : "FAILED");
+    replay_close(&replay);
+    replay_timeline_free(&timeline);
+    return same ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    int matches = 1000;
+    int players = TRON_DEFAULT_PLAYERS;
+    int humans = 0;
+    Uint64 seed = 0;
+    bool verify = false;
+    const char *record_dir = NULL;
+    const char *replay_path = NULL;
+    ReplayRecorder rec = {0};
+    ReplayTimeline timeline = {0};
+    AiType ais[MAX_PLAYERS] = {AI_STRAIGHT};
+    int ai_count = 1;
+    Uint64 ai_budget_ns = 0;
+    int wins[MAX_PLAYERS + 1] = {0}; // slot players counts draws
+    Uint64 total_ticks = 0;
+    Uint64 start_time;
+    double elapsed;
+
+    AppState *as = (AppState *)SDL_calloc(1, sizeof(AppState));
+    if(!as) {
+        return 1;
+    }
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--matches") == 0 && i + 1 < argc) {
+            matches = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            as->board_width = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            as->board_height = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--humans") == 0 && i + 1 < argc) {
+            humans = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--ai") == 0 && i + 1 < argc) {
+            ai_count = ai_parse_types(argv[++i], ais, MAX_PLAYERS);
+            if(ai_count == 0) {
+                fprintf(stderr, "%s\n", SDL_GetError());
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--ai-budget-ms") == 0 && i + 1 < argc) {
+            ai_budget_ns = SDL_MS_TO_NS(strtoull(argv[++i], NULL, 10));
+        } else if(strcmp(argv[i], "--ai-threads") == 0 && i + 1 < argc) {
+            ai_set_thread_count(atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_dir = argv[++i];
+        } else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--matches N] [--width N] [--height N] [--players N] [--humans N] [--ai TYPE[,TYPE...]] [--ai-budget-ms N] [--ai-threads N] [--seed N] [--verify] [--record DIR]\n"
+                            "       %s --replay FILE\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if(players < 1 || players > MAX_PLAYERS) {
+        fprintf(stderr, "--players must be between 1 and %d\n", MAX_PLAYERS);
+        return 1;
+    }
+    if(humans < 0 || humans > players) {
+        fprintf(stderr, "--humans must be between 0 and %d\n", players);
+        return 1;
+    }
+
+    if(replay_path) {
+        int result = play_replay(as, replay_path, verify);
+        SDL_free(fingerprints);
+        sim_free(as);
+        SDL_free(as);
+        return result;
+    }
+    as->ai_budget_ns = ai_budget_ns;
+    if(verify)
+        rec.timeline = &timeline;
+
+    start_time = SDL_GetTicksNS();
+    for(int m = 0; m < matches; m++) {
+        as->seed = seed + (Uint64)m;
+        Uint64 ticks = play_match(as, players, humans, ais, ai_count, verify, record_dir || verify ? &rec : NULL);
+        if(ticks != 0 && record_dir) {
+            char path[1024];
+            SDL_snprintf(path, sizeof(path), "%s/%" SDL_PRIu64 ".trpl", record_dir, as->seed);
+            if(!replay_save(&rec, path)) {
+                fprintf(stderr, "couldn't save %s: %s\n", path, SDL_GetError());
+                ticks = 0;
+            }
+        }
+        if(ticks == 0) {
+            replay_record_free(&rec);
+            replay_timeline_free(&timeline);
+            SDL_free(fingerprints);
+            sim_free(as);
+            SDL_free(as);
+            ai_shutdown();
+            return 1;
+        }
+        total_ticks += ticks;
+
+        int winner = players;
+        for(int i = 0; i < players; i++) {
+            if(as->character_ctx[i].is_alive) {
+                winner = i;
+            }
+        }
+        wins[winner]++;
+    }
+    elapsed = (double)(SDL_GetTicksNS() - start_time) / SDL_NS_PER_SECOND;
+
+    printf("matches:         %d\n", matches);
+    printf("avg match ticks: %.1f\n", matches ? (double)total_ticks / matches : 0.0);
+    printf("matches/sec:     %.0f\n", elapsed > 0 ? matches / elapsed : 0.0);
+    printf("ticks/sec:       %.0f\n", elapsed > 0 ? total_ticks / elapsed : 0.0);
+    for(int i = 0; i < players; i++) {
+        char name[PLAYER_NAME_SIZE];
+        printf("%-6s wins:     %d (%s)\n", sim_player_name(as, i, name), wins[i],
+               as->character_ctx[i].is_human ? "random" : ai_type_name(as->character_ctx[i].ai));
+    }
+    printf("draws:           %d\n", wins[players]);
+
+    replay_record_free(&rec);
+    replay_timeline_free(&timeline);
+    SDL_free(fingerprints);
+    sim_free(as);
+    SDL_free(as);
+    ai_shutdown();
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,574 @@
+// UDP netplay with rollback. See tron_net.h
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "tron_net.h"
+
+#define NET_MAGIC   "TRNP"
+#define NET_VERSION 2
+#define NET_HEADER  6  // magic, type, version
+
+#define NET_INPUT_HEADER (NET_HEADER + 4 + 8 + 8 + 1 + 8 + 1 + 8 + 8)
+#define NET_START_SIZE   (NET_HEADER + 4 + 8 + 2 + 2 + 1)
+
+typedef enum
+{
+    PACKET_HELLO = 1U,  // client to host until it gets a welcome
+    PACKET_WELCOME,     // host to client
+    PACKET_START,       // host to client: Uint32 match, Uint64 seed, Uint16 width, Uint16 height, Uint8 players
+    PACKET_INPUT        // both ways: Uint32 match, Uint64 tick, Uint64 ack, Sint8 advantage,
+                        //            Uint64 first, Uint8 count, Uint64 hash tick, Uint64 hash,
+                        //            count directions
+} PacketType;
+
+static void put_le(Uint8 *out, Uint64 value, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        out[i] = (Uint8)(value >> (8 * i));
+    }
+}
+
+static Uint64 get_le(const Uint8 *in, int bytes) {
+    Uint64 value = 0;
+    for(int i = 0; i < bytes; i++) {
+        value |= (Uint64)in[i] << (8 * i);
+    }
+    return value;
+}
+
+bool net_init(void) {
+#ifdef _WIN32
+    WSADATA data;
+    if(WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        return SDL_SetError("WSAStartup failed");
+#endif
+    return true;
+}
+
+void net_quit(void) {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static int last_socket_error(void) {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool net_resolve(const char *text, NetAddress *address) {
+    char host[256];
+    const char *colon = SDL_strrchr(text, ':');
+    size_t length = colon ? (size_t)(colon - text) : SDL_strlen(text);
+    int port = colon ? SDL_atoi(colon + 1) : NET_DEFAULT_PORT;
+    struct addrinfo hints;
+    struct addrinfo *found = NULL;
+    if(length == 0 || length >= sizeof(host) || port <= 0 || port > 65535)
+        return SDL_SetError("Expected HOST:PORT, got %s", text);
+    SDL_memcpy(host, text, length);
+    host[length] = '\0';
+    SDL_zero(hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(host, NULL, &hints, &found) != 0 || !found)
+        return SDL_SetError("Couldn't find %s", host);
+    address->host = SDL_Swap32BE(((struct sockaddr_in *)found->ai_addr)->sin_addr.s_addr);
+    address->port = (Uint16)port;
+    freeaddrinfo(found);
+    return true;
+}
+
+bool net_socket_open(NetSocket *sock, Uint16 port, const NetConditions *conditions) {
+    struct sockaddr_in bound;
+    socklen_t bound_size = sizeof(bound);
+    SDL_zerop(sock);
+    sock->fd = -1;
+    if(conditions)
+        sock->conditions = *conditions;
+    sock->rng = SDL_GetPerformanceCounter();
+
+#ifdef _WIN32
+    SOCKET fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    u_long nonblocking = 1;
+    if(fd == INVALID_SOCKET)
+        return SDL_SetError("Couldn't open a UDP socket: %d", last_socket_error());
+#else
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(fd < 0)
+        return SDL_SetError("Couldn't open a UDP socket: %s", strerror(errno));
+#endif
+    sock->fd = (Sint64)fd;
+
+    SDL_zero(bound);
+    bound.sin_family = AF_INET;
+    bound.sin_addr.s_addr = SDL_Swap32BE(INADDR_ANY);
+    bound.sin_port = SDL_Swap16BE(port);
+    if(bind(fd, (struct sockaddr *)&bound, sizeof(bound)) != 0) {
+        SDL_SetError("Couldn't bind UDP port %d: %d", port, last_socket_error());
+        net_socket_close(sock);
+        return false;
+    }
+#ifdef _WIN32
+    ioctlsocket(fd, FIONBIO, &nonblocking);
+#else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    if(getsockname(fd, (struct sockaddr *)&bound, &bound_size) == 0)
+        sock->port = SDL_Swap16BE(bound.sin_port);
+    return true;
+}
+
+void net_socket_close(NetSocket *sock) {
+    if(sock->fd < 0)
+        return;
+#ifdef _WIN32
+    closesocket((SOCKET)sock->fd);
+#else
+    close((int)sock->fd);
+#endif
+    sock->fd = -1;
+    sock->delayed_count = 0;
+}
+
+static void send_now(NetSocket *sock, const NetAddress *to, const void *data, int size) {
+    struct sockaddr_in address;
+    SDL_zero(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = SDL_Swap32BE(to->host);
+    address.sin_port = SDL_Swap16BE(to->port);
+    // a full buffer loses the datagram like the network would
+    sendto(sock->fd, (const char *)data, size, 0, (struct sockaddr *)&address, sizeof(address));
+    sock->sent++;
+}
+
+void net_socket_send(NetSocket *sock, const NetAddress *to, const void *data, int size) {
+    const NetConditions *conditions = &sock->conditions;
+    if(sock->fd < 0 || size > NET_MAX_PACKET)
+        return;
+    if(conditions->loss_percent > 0 && SDL_rand_r(&sock->rng, 100) < conditions->loss_percent) {
+        sock->dropped++;
+        return;
+    }
+    if(conditions->latency_ms <= 0 && conditions->jitter_ms <= 0) {
+        send_now(sock, to, data, size);
+        return;
+    }
+    if(sock->delayed_count == NET_MAX_DELAYED) {
+        sock->dropped++;
+        return;
+    }
+    int delay_ms = conditions->latency_ms + (conditions->jitter_ms > 0 ? SDL_rand_r(&sock->rng, conditions->jitter_ms + 1) : 0);
+    NetDelayed *delayed = &sock->delayed[sock->delayed_count++];
+    delayed->to = *to;
+    delayed->release_ns = SDL_GetTicksNS() + (Uint64)delay_ms * SDL_NS_PER_MS;
+    delayed->size = size;
+    SDL_memcpy(delayed->data, data, size);
+}
+
+void net_socket_flush(NetSocket *sock) {
+    Uint64 now = SDL_GetTicksNS();
+    int kept = 0;
+    for(int i = 0; i < sock->delayed_count; i++) {
+        NetDelayed *delayed = &sock->delayed[i];
+        if(delayed->release_ns <= now)
+            send_now(sock, &delayed->to, delayed->data, delayed->size);
+        else if(kept++ != i)
+            sock->delayed[kept - 1] = *delayed;
+    }
+    sock->delayed_count = kept;
+}
+
+int net_socket_receive(NetSocket *sock, NetAddress *from, void *data, int capacity) {
+    struct sockaddr_in address;
+    socklen_t address_size = sizeof(address);
+    if(sock->fd < 0)
+        return 0;
+    for(;;) {
+        int size = (int)recvfrom(sock->fd, (char *)data, capacity, 0, (struct sockaddr *)&address, &address_size);
+        // errors (would block, or an ICMP unreachable from a peer that isn't there yet) read as nothing
+        if(size <= 0)
+            return 0;
+        if(address.sin_family != AF_INET)
+            continue;
+        from->host = SDL_Swap32BE(address.sin_addr.s_addr);
+        from->port = SDL_Swap16BE(address.sin_port);
+        sock->received++;
+        return size;
+    }
+}
+
+static int put_header(Uint8 *out, PacketType type) {
+    SDL_memcpy(out, NET_MAGIC, 4);
+    out[4] = (Uint8)type;
+    out[5] = NET_VERSION;
+    return NET_HEADER;
+}
+
+static void send_packet(NetSession *session, PacketType type) {
+    Uint8 packet[NET_HEADER];
+    net_socket_send(&session->socket, &session->peer, packet, put_header(packet, type));
+}
+
+static void send_start(NetSession *session) {
+    Uint8 packet[NET_START_SIZE];
+    int size = put_header(packet, PACKET_START);
+    put_le(&packet[size], session->start.match, 4);
+    put_le(&packet[size + 4], session->start.seed, 8);
+    put_le(&packet[size + 12], (Uint64)session->start.width, 2);
+    put_le(&packet[size + 14], (Uint64)session->start.height, 2);
+    packet[size + 16] = (Uint8)session->start.players;
+    net_socket_send(&session->socket, &session->peer, packet, NET_START_SIZE);
+    session->last_resend_ns = SDL_GetTicksNS();
+}
+
+// The local inputs the peer doesn't have yet, along with what it needs to keep the clocks together
+static void send_inputs(NetSession *session, const AppState *as) {
+    Uint8 packet[NET_INPUT_HEADER + NET_PACKET_INPUTS];
+    Uint64 first = SDL_max(session->peer_acked, as->tick > NET_INPUT_TICKS ? as->tick - NET_INPUT_TICKS : 0);
+    int count = (int)SDL_min(as->tick - first, (Uint64)NET_PACKET_INPUTS);
+    int size = put_header(packet, PACKET_INPUT);
+    Sint64 advantage = SDL_clamp((Sint64)as->tick - (Sint64)session->remote_tick, -127, 127);
+    put_le(&packet[size], session->start.match, 4);
+    put_le(&packet[size + 4], as->tick, 8);
+    put_le(&packet[size + 12], session->remote_count, 8);
+    packet[size + 20] = (Uint8)(Sint8)advantage;
+    put_le(&packet[size + 21], first, 8);
+    packet[size + 29] = (Uint8)count;
+    // the newest tick played with every input there is, its hash is final
+    Uint64 settled = SDL_min(as->tick, session->remote_count);
+    put_le(&packet[size + 30], settled, 8);
+    put_le(&packet[size + 38], session->hashes[settled & (NET_INPUT_TICKS - 1)], 8);
+    for(int i = 0; i < count; i++) {
+        packet[NET_INPUT_HEADER + i] = session->local_dirs[(first + i) & (NET_INPUT_TICKS - 1)];
+    }
+    net_socket_send(&session->socket, &session->peer, packet, NET_INPUT_HEADER + count);
+}
+
+static void save_snapshot(NetSession *session, const AppState *as) {
+    sim_snapshot(as, &session->snapshots[as->tick % NET_ROLLBACK_TICKS]);
+}
+
+static void restore_snapshot(const NetSession *session, AppState *as, Uint64 tick) {
+    const SimSnapshot *snapshot = &session->snapshots[tick % NET_ROLLBACK_TICKS];
+    SDL_assert(snapshot->match.tick == tick);
+    sim_restore(as, snapshot);
+}
+
+// Save the state and play as->tick with the local input it was first played with and the remote one
+// if it is known, the remote player's last known direction if not
+static void play_tick(NetSession *session, AppState *as) {
+    Uint64 tick = as->tick;
+    int slot = (int)(tick & (NET_INPUT_TICKS - 1));
+    Uint8 remote = session->remote_initial;
+    if(tick < session->remote_count)
+        remote = session->remote_dirs[slot];
+    else if(session->remote_count > 0)
+        remote = session->remote_dirs[(session->remote_count - 1) & (NET_INPUT_TICKS - 1)];
+    session->predicted[slot] = remote;
+    save_snapshot(session, as);
+    sim_set_direction(as, session->local_player, (CharacterDirection)session->local_dirs[slot]);
+    sim_set_direction(as, session->remote_player, (CharacterDirection)remote);
+    sim_step(as);
+    session->hashes[as->tick & (NET_INPUT_TICKS - 1)] = sim_hash(as);
+}
+
+// Go back to tick and play up to where the match was again
+static void roll_back(NetSession *session, AppState *as, Uint64 tick) {
+    Uint64 start = SDL_GetTicksNS();
+    Uint64 until = as->tick;
+    restore_snapshot(session, as, tick);
+    while(as->tick < until && as->state == RUNNING) {
+        play_tick(session, as);
+    }
+    int played = (int)(until - tick);
+    session->stats.rollbacks++;
+    session->stats.resimulated += played;
+    session->stats.max_rollback = SDL_max(session->stats.max_rollback, played);
+    session->stats.rollback_ns += SDL_GetTicksNS() - start;
+}
+
+// Take the remote inputs of a packet, returns the first tick that was played with a wrong guess or
+// as->tick when there was none
+static Uint64 receive_inputs(NetSession *session, const AppState *as, const Uint8 *packet, int size) {
+    Uint64 mispredicted = as->tick;
+    Uint32 match = (Uint32)get_le(&packet[NET_HEADER], 4);
+    Uint64 tick = get_le(&packet[NET_HEADER + 4], 8);
+    Uint64 ack = get_le(&packet[NET_HEADER + 12], 8);
+    Uint64 first = get_le(&packet[NET_HEADER + 21], 8);
+    int count = packet[NET_HEADER + 29];
+    Uint64 hash_tick = get_le(&packet[NET_HEADER + 30], 8);
+    if(!session->playing || match != session->start.match || size < NET_INPUT_HEADER + count)
+        return mispredicted;
+    if(!session->remote_hash_pending || hash_tick > session->remote_hash_tick) {
+        session->remote_hash_tick = hash_tick;
+        session->remote_hash = get_le(&packet[NET_HEADER + 38], 8);
+        session->remote_hash_pending = true;
+    }
+
+    session->start_acked = true;
+    // the newest packet says where the peer is now, reordered ones are older news
+    if(tick >= session->remote_tick) {
+        session->remote_tick = tick;
+        session->remote_advantage = (Sint8)packet[NET_HEADER + 20];
+    }
+    session->peer_acked = SDL_max(session->peer_acked, SDL_min(ack, as->tick));
+    // inputs are only taken in order, every packet starts at the peer's last ack so a gap gets filled
+    // by the next one
+    if(first > session->remote_count)
+        return mispredicted;
+    for(int i = (int)(session->remote_count - first); i < count; i++) {
+        Uint64 input_tick = first + i;
+        // would overwrite history a rollback still needs, the peer stalls long before this
+        if(input_tick >= as->tick + NET_INPUT_TICKS - NET_ROLLBACK_TICKS)
+            break;
+        int slot = (int)(input_tick & (NET_INPUT_TICKS - 1));
+        Uint8 dir = packet[NET_INPUT_HEADER + i] & 3;
+        session->remote_dirs[slot] = dir;
+        if(input_tick < as->tick && session->predicted[slot] != dir)
+            mispredicted = SDL_min(mispredicted, input_tick);
+        session->remote_count = input_tick + 1;
+    }
+    return mispredicted;
+}
+
+// Compare the peer's hash with ours once this side played that tick with every input too. True the
+// first time in a match they differ
+static bool check_hash(NetSession *session, const AppState *as) {
+    Uint64 tick = session->remote_hash_tick;
+    if(!session->remote_hash_pending || tick > as->tick || tick > session->remote_count)
+        return false;
+    session->remote_hash_pending = false;
+    if(as->tick - tick >= NET_INPUT_TICKS)
+        return false; // ours is long gone, a newer one comes with the next packet
+    session->stats.hash_checks++;
+    if(session->hashes[tick & (NET_INPUT_TICKS - 1)] == session->remote_hash)
+        return false;
+    session->stats.desyncs++;
+    if(session->desynced)
+        return false;
+    session->desynced = true;
+    session->desync_tick = tick;
+    return true;
+}
+
+static bool open_session(NetSession *session, Uint16 port, const NetConditions *conditions) {
+    SDL_zerop(session);
+    return net_socket_open(&session->socket, port, conditions);
+}
+
+bool net_host(NetSession *session, Uint16 port, const NetConditions *conditions) {
+    if(!open_session(session, port, conditions))
+        return false;
+    session->is_host = true;
+    session->local_player = 0;
+    session->remote_player = 1;
+    return true;
+}
+
+bool net_join(NetSession *session, const NetAddress *host, const NetConditions *conditions) {
+    if(!open_session(session, 0, conditions))
+        return false;
+    session->peer = *host;
+    session->local_player = 1;
+    session->remote_player = 0;
+    send_packet(session, PACKET_HELLO);
+    session->last_resend_ns = SDL_GetTicksNS();
+    return true;
+}
+
+void net_close(NetSession *session) {
+    net_socket_close(&session->socket);
+    for(int i = 0; i < NET_ROLLBACK_TICKS; i++) {
+        sim_snapshot_free(&session->snapshots[i]);
+    }
+}
+
+NetEvent net_poll(NetSession *session, AppState *as) {
+    Uint8 packet[NET_MAX_PACKET];
+    NetAddress from;
+    NetEvent event = NET_EVENT_NONE;
+    Uint64 mispredicted = as->tick;
+    Uint64 now = SDL_GetTicksNS();
+    int size;
+
+    while((size = net_socket_receive(&session->socket, &from, packet, sizeof(packet))) > 0) {
+        if(size < NET_HEADER || SDL_memcmp(packet, NET_MAGIC, 4) != 0 || packet[5] != NET_VERSION)
+            continue;
+        // once connected only the peer is listened to
+        if(session->connected && (from.host != session->peer.host || from.port != session->peer.port))
+            continue;
+        switch(packet[4]) {
+        case PACKET_HELLO:
+            if(!session->is_host)
+                break;
+            session->peer = from;
+            send_packet(session, PACKET_WELCOME);
+            if(!session->connected)
+                event = NET_EVENT_JOINED;
+            session->connected = true;
+            break;
+        case PACKET_WELCOME:
+            if(session->is_host || session->connected)
+                break;
+            session->connected = true;
+            event = NET_EVENT_JOINED;
+            break;
+        case PACKET_START: {
+            Uint32 match = (Uint32)get_le(&packet[NET_HEADER], 4);
+            // resent until the client plays it, only the first one counts
+            if(session->is_host || size < NET_START_SIZE || match == session->start.match)
+                break;
+            session->start.match = match;
+            session->start.seed = get_le(&packet[NET_HEADER + 4], 8);
+            session->start.width = (int)get_le(&packet[NET_HEADER + 12], 2);
+            session->start.height = (int)get_le(&packet[NET_HEADER + 14], 2);
+            session->start.players = packet[NET_HEADER + 16];
+            session->playing = false;
+            event = NET_EVENT_START;
+            break;
+        }
+        case PACKET_INPUT:
+            if(size >= NET_INPUT_HEADER) {
+                Uint64 wrong = receive_inputs(session, as, packet, size);
+                mispredicted = SDL_min(mispredicted, wrong);
+            }
+            break;
+        default:
+            break;
+        }
+        session->last_heard_ns = now;
+    }
+
+    if(mispredicted < as->tick)
+        roll_back(session, as, mispredicted);
+    if(session->playing && check_hash(session, as) && event == NET_EVENT_NONE)
+        event = NET_EVENT_DESYNC;
+
+    if(session->connected && now - session->last_heard_ns > NET_TIMEOUT_NS) {
+        session->connected = false;
+        session->playing = false;
+        event = NET_EVENT_LOST;
+    }
+    if(now - session->last_resend_ns > NET_RESEND_NS) {
+        if(!session->is_host && !session->connected) {
+            send_packet(session, PACKET_HELLO);
+            session->last_resend_ns = now;
+        } else if(session->is_host && session->playing && !session->start_acked) {
+            send_start(session);
+        } else if(session->playing) {
+            // keep the peer up to date while the match is over or stalled
+            send_inputs(session, as);
+            session->last_resend_ns = now;
+        }
+    }
+    net_socket_flush(&session->socket);
+    return event;
+}
+
+bool net_start_match(NetSession *session, AppState *as, int players) {
+    if(!session->connected)
+        return SDL_SetError("Nobody to play with yet");
+    if(session->is_host) {
+        session->start.match++;
+        session->start.seed = as->seed;
+        session->start.width = as->board_width > 0 ? as->board_width : TRON_DEFAULT_WIDTH;
+        session->start.height = as->board_height > 0 ? as->board_height : TRON_DEFAULT_HEIGHT;
+        session->start.players = players;
+    } else if(session->start.players != players) {
+        return SDL_SetError("The host plays with %d players, this side with %d", session->start.players, players);
+    }
+
+    as->seed = session->start.seed;
+    as->board_width = session->start.width;
+    as->board_height = session->start.height;
+    as->scripted = false;
+    as->cpu_ai = AI_STRAIGHT;
+    as->ai_budget_ns = SDL_MAX_UINT64 / 2; // never runs out, see the top of tron_net.h
+    if(!sim_init_match(as, 2, players - 2))
+        return false;
+    for(int i = 0; i < NET_ROLLBACK_TICKS; i++) {
+        if(!sim_snapshot_init(&session->snapshots[i], as))
+            return false;
+    }
+
+    session->playing = true;
+    session->start_acked = !session->is_host;
+    session->remote_count = 0;
+    session->peer_acked = 0;
+    session->remote_tick = 0;
+    session->remote_advantage = 0;
+    session->queued_count = 0;
+    session->local_dir = (Uint8)as->character_ctx[session->local_player].next_dir;
+    session->hashes[0] = sim_hash(as);
+    session->remote_hash_pending = false;
+    session->desynced = false;
+    session->remote_initial = (Uint8)as->character_ctx[session->remote_player].next_dir;
+    if(session->is_host)
+        send_start(session);
+    return true;
+}
+
+bool net_local_input(NetSession *session, CharacterDirection dir) {
+    CharacterDirection heading = (CharacterDirection)session->local_dir;
+    if(!session->playing)
+        return false;
+    if(session->queued_count)
+        heading = (CharacterDirection)session->queued_dirs[(session->queued_first + session->queued_count - 1) & (INPUT_QUEUE_SIZE - 1)];
+    if(dir == heading || is_reverse(heading, dir) || session->queued_count == INPUT_QUEUE_SIZE)
+        return false;
+    session->queued_dirs[(session->queued_first + session->queued_count) & (INPUT_QUEUE_SIZE - 1)] = (char)dir;
+    session->queued_count++;
+    return true;
+}
+
+bool net_step(NetSession *session, AppState *as) {
+    if(!session->playing || as->state != RUNNING)
+        return false;
+    if(as->tick >= session->remote_count + NET_ROLLBACK_TICKS) {
+        session->stats.stalls++;
+        return false;
+    }
+    if(session->queued_count) {
+        session->local_dir = (Uint8)session->queued_dirs[session->queued_first];
+        session->queued_first = (session->queued_first + 1) & (INPUT_QUEUE_SIZE - 1);
+        session->queued_count--;
+    }
+    session->local_dirs[as->tick & (NET_INPUT_TICKS - 1)] = session->local_dir;
+    play_tick(session, as);
+    send_inputs(session, as);
+    session->last_resend_ns = SDL_GetTicksNS();
+    return true;
+}
+
+int net_ticks_ahead(const NetSession *session, const AppState *as) {
+    if(!session->playing || session->remote_tick == 0)
+        return 0;
+    int advantage = (int)SDL_clamp((Sint64)as->tick - (Sint64)session->remote_tick, -127, 127);
+    return (advantage - session->remote_advantage) / 2;
+}
+
+bool net_match_at(const NetSession *session, const AppState *as, Uint64 tick, AppState *out) {
+    const SimSnapshot *snapshot = &session->snapshots[tick % NET_ROLLBACK_TICKS];
+    if(tick != as->tick && (tick > as->tick || snapshot->match.tick != tick))
+        return SDL_SetError("tick %" SDL_PRIu64 " is no longer kept", tick);
+    *out = *as;
+    SDL_zero(out->board);
+    SDL_zero(out->analysis);
+    if(!board_init(&out->board, as->board.width, as->board.height, as->board.players))
+        return false;
+    board_copy(&out->board, &as->board);
+    if(tick != as->tick)
+        sim_restore(out, snapshot);
+    return true;
+}
@@ -0,0 +1,204 @@
+/*
+  PVP across machines: a UDP link between two copies of the game, with rollback.
+
+  The host (--host PORT) plays player 1 and the client (--join HOST:PORT) player 2, computer players
+  make up the rest of the arena on both sides. The client says hello until the host answers, then
+  the host starts every match by sending its seed and arena (net_start_match). From then on both
+  sides step on their own clock and send the direction their player took on every tick.
+
+  Nobody waits for the other side's input. A tick is played right away with the remote player
+  predicted to keep going the way they went last, so a key press is felt on the next tick whatever
+  the round trip is. The match before every tick is saved (sim_snapshot). When a remote direction
+  arrives that differs from the one predicted for that tick, net_poll restores the match before it
+  and plays the ticks since again with what is now known, so what is drawn is always the best guess
+  and becomes final once the remote inputs catch up. The local side stops stepping (a stall) when the remote
+  inputs are NET_ROLLBACK_TICKS behind. Every packet repeats the inputs the peer hasn't acknowledged
+  yet, so a lost packet is covered by the next one and nothing is resent on a timer.
+
+  Both sides have to play the same match from the same inputs, so netplay computer players are
+  AI_STRAIGHT with no thinking budget to run out of (the other AIs depend on the machine's speed,
+  tron_ai.h). Human turns go through the session's own queue (net_local_input) with the rules of
+  sim_set_input, and each tick's directions are forced with sim_set_direction before the step.
+
+  The two clocks are kept together by each side reporting how far ahead of the other it thinks it
+  is, net_ticks_ahead is half the difference and the side that is ahead slows down a little.
+
+  Every input packet also carries the match hash (sim_hash) of the newest tick the sender played
+  with all of both players' inputs. The receiver compares it with its own hash of that tick once it
+  has it too, so two sides that stopped playing the same match (a bug, the build or a machine
+  difference) find out within a round trip instead of at the end. net_poll then returns
+  NET_EVENT_DESYNC once per match, and net_match_at gets the match as it was on that tick from the
+  rollback snapshots so both sides can dump the same tick (sim_dump).
+
+  NetConditions hold outgoing datagrams back (latency plus up to jitter, so they can arrive out of
+  order) or drop them, for testing over loopback: tron_netplay runs a host and a client in one
+  process and checks they end every match the same.
+
+    net_init();
+    net_join(&session, &host, &conditions); // or net_host
+    ...every frame
+    switch(net_poll(&session, as)) { case NET_EVENT_START: net_start_match(&session, as, players); ... }
+    if(step is due && net_ticks_ahead(&session, as) <= 0)
+        net_step(&session, as);
+*/
+#ifndef TRON_NET_H
+#define TRON_NET_H
+
+#include "tron_sim.h"
+
+#define NET_DEFAULT_PORT   7777
+#define NET_MAX_PACKET     256
+#define NET_MAX_DELAYED    256 // datagrams NetConditions can hold back
+#define NET_ROLLBACK_TICKS 16  // ticks played ahead of the remote inputs before stalling, a second at 60 ms
+#define NET_INPUT_TICKS    64  // input history kept, a power of two above NET_ROLLBACK_TICKS + NET_PACKET_INPUTS
+#define NET_PACKET_INPUTS  32  // local inputs repeated in a packet at most
+#define NET_RESEND_NS      (100 * SDL_NS_PER_MS) // hello and start, until answered
+#define NET_TIMEOUT_NS     (5 * SDL_NS_PER_SECOND)
+
+typedef struct
+{
+    Uint32 host; // IPv4, host byte order
+    Uint16 port;
+} NetAddress;
+
+// What the link does to outgoing datagrams
+typedef struct
+{
+    int latency_ms;
+    int jitter_ms;    // extra 0 to jitter_ms on top of latency_ms, picked per datagram
+    int loss_percent;
+} NetConditions;
+
+typedef struct
+{
+    NetAddress to;
+    Uint64 release_ns; // SDL_GetTicksNS() it goes out at
+    int size;
+    Uint8 data[NET_MAX_PACKET];
+} NetDelayed;
+
+typedef struct
+{
+    Sint64 fd;  // -1 when closed
+    Uint16 port; // bound to
+    NetConditions conditions;
+    Uint64 rng;
+    NetDelayed delayed[NET_MAX_DELAYED];
+    int delayed_count;
+    Uint64 sent;
+    Uint64 dropped; // by the conditions
+    Uint64 received;
+} NetSocket;
+
+// A match as the host announced it
+typedef struct
+{
+    Uint32 match;
+    Uint64 seed;
+    int width;
+    int height;
+    int players;
+} NetStart;
+
+typedef struct
+{
+    Uint64 rollbacks;
+    Uint64 resimulated;  // ticks played again
+    int max_rollback;    // most ticks played again at once
+    Uint64 rollback_ns;  // spent restoring and playing again
+    Uint64 stalls;       // steps that waited for remote inputs
+    Uint64 hash_checks;  // ticks compared with the peer's hash
+    Uint64 desyncs;      // of which differed
+} NetStats;
+
+typedef enum
+{
+    NET_EVENT_NONE = 0U,
+    NET_EVENT_JOINED, // the other side answered
+    NET_EVENT_START,  // client: the host started a match, see NetSession.start
+    NET_EVENT_LOST,   // nothing heard for NET_TIMEOUT_NS
+    NET_EVENT_DESYNC  // the peer's match hash differs from ours at NetSession.desync_tick
+} NetEvent;
+
+typedef struct
+{
+    NetSocket socket;
+    bool is_host;
+    bool connected;
+    NetAddress peer;
+    int local_player;  // 0 on the host, 1 on the client
+    int remote_player;
+    NetStart start;    // of the match being played
+    bool playing;      // a match was started and not stopped
+    bool start_acked;  // host: the client plays the match too
+    Uint64 last_heard_ns;
+    Uint64 last_resend_ns;
+
+    // the directions of every tick, indexed by tick & (NET_INPUT_TICKS - 1)
+    Uint8 local_dirs[NET_INPUT_TICKS];
+    Uint8 remote_dirs[NET_INPUT_TICKS];
+    Uint8 predicted[NET_INPUT_TICKS]; // remote direction the tick was played with
+    Uint64 remote_count;  // remote inputs known, every tick before this one
+    Uint64 peer_acked;    // local inputs the peer has
+    Uint8 remote_initial; // what the remote player heads at the start
+    Uint64 remote_tick;   // newest tick the peer reported
+    int remote_advantage; // how far ahead of us the peer thinks it is
+
+    // local turns waiting for a tick, same rules as sim_set_input
+    char queued_dirs[INPUT_QUEUE_SIZE];
+    Uint8 queued_first;
+    Uint8 queued_count;
+    Uint8 local_dir; // the local player's direction on the last tick played
+
+    SimSnapshot snapshots[NET_ROLLBACK_TICKS]; // the match before tick t at t % NET_ROLLBACK_TICKS
+
+    // sim_hash of the match at tick t, indexed by t & (NET_INPUT_TICKS - 1). Final once every
+    // input before t is known
+    Uint64 hashes[NET_INPUT_TICKS];
+    Uint64 remote_hash_tick; // newest tick the peer sent a hash of, not compared yet
+    Uint64 remote_hash;
+    bool remote_hash_pending;
+    bool desynced;           // this match, reported once
+    Uint64 desync_tick;
+    NetStats stats;
+} NetSession;
+
+// Functions returning bool set SDL_GetError on failure
+bool net_init(void);
+void net_quit(void);
+// "host:port" or "host", which gets NET_DEFAULT_PORT
+bool net_resolve(const char *text, NetAddress *address);
+
+// port 0 takes any free port, see NetSocket.port
+bool net_socket_open(NetSocket *sock, Uint16 port, const NetConditions *conditions);
+void net_socket_close(NetSocket *sock);
+void net_socket_send(NetSocket *sock, const NetAddress *to, const void *data, int size);
+// Size of the datagram received, 0 when there is none waiting
+int net_socket_receive(NetSocket *sock, NetAddress *from, void *data, int capacity);
+// Send the held back datagrams that are due
+void net_socket_flush(NetSocket *sock);
+
+bool net_host(NetSession *session, Uint16 port, const NetConditions *conditions);
+bool net_join(NetSession *session, const NetAddress *host, const NetConditions *conditions);
+void net_close(NetSession *session);
+// Handle everything received, rolling as back when a remote input wasn't the one predicted, and
+// send what is due. Call every frame
+NetEvent net_poll(NetSession *session, AppState *as);
+// Host: start a new match on as->board_width x as->board_height with as->seed and tell the client.
+// Client: start the match the host announced. Either way players take part, the two humans first
+bool net_start_match(NetSession *session, AppState *as, int players);
+// Queue a turn of the local player, false when sim_set_input would have dropped it
+bool net_local_input(NetSession *session, CharacterDirection dir);
+// Play the next tick and send its input. False when it has to wait for the remote inputs
+bool net_step(NetSession *session, AppState *as);
+// Ticks this side should fall back to meet the other one, 0 or less when it's behind
+int net_ticks_ahead(const NetSession *session, const AppState *as);
+// The match as it was on tick (as->tick or one of the last NET_ROLLBACK_TICKS before it) into out,
+// which gets its own board to sim_free. False when that tick is gone
+bool net_match_at(const NetSession *session, const AppState *as, Uint64 tick, AppState *out);
+// Every tick played so far was played with the remote player's real inputs
+static inline bool net_confirmed(const NetSession *session, const AppState *as) {
+    return session->remote_count >= as->tick;
+}
+
+#endif // TRON_NET_H
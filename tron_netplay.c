@@ -0,0 +1,265 @@
+/*
+  Plays netplay matches between a host and a client in the same process, over loopback UDP through a
+  simulated bad link, and checks that both sides finish every match in the same state.
+
+  usage: tron_netplay [--matches N] [--players N] [--seed N] [--latency MS] [--jitter MS] [--loss PERCENT]
+                      [--step-ms N] [--port N]
+
+  Each side sends through NetConditions (tron_net.h), so a round trip takes twice --latency plus up
+  to twice --jitter, and --loss percent of the datagrams (each way) never arrive. Both players turn
+  at random every few ticks. --step-ms sets the tick length (60 ms like the game by default), a
+  shorter one plays faster, keep the latency in proportion to test the same thing.
+
+  A match is over once both sides have played it to the end with all of the other side's inputs. At
+  that point their boards, players and random state have to be identical, anything else is reported
+  and the exit code is 1. The rollback stats of both sides are printed after every match.
+
+  Both sides also compare match hashes while they play (tron_net.h). The first tick either side finds
+  different fails the match too, and both sides' matches on that tick are written to
+  desync-MATCH-host.txt and desync-MATCH-client.txt (sim_dump) in the current directory.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+#include "tron_net.h"
+
+#define MATCH_TIMEOUT_NS (120 * SDL_NS_PER_SECOND)
+
+typedef struct
+{
+    const char *name;
+    NetSession session;
+    AppState as;
+    Uint64 last_step;  // SDL_GetTicksNS() the last tick was due at
+    Uint64 rng;        // for the random turns
+    int max_unconfirmed; // most ticks played ahead of the remote inputs
+    bool desynced;       // this match, the hashes differed
+} Peer;
+
+static Peer host = {.name = "host"};
+static Peer client = {.name = "client"};
+static Uint64 step_ns = STEP_RATE_IN_NS;
+static bool dumped; // this match's desync
+
+// Step a side in real time, turning at random. The side that is ahead waits a little
+static void run_peer(Peer *peer, Uint64 now) {
+    AppState *as = &peer->as;
+    if(!peer->session.playing || as->state != RUNNING || now < peer->last_step + step_ns)
+        return;
+    if(net_ticks_ahead(&peer->session, as) > 0) {
+        peer->last_step += step_ns / 8;
+        return;
+    }
+    if(SDL_rand_r(&peer->rng, 8) == 0)
+        net_local_input(&peer->session, (CharacterDirection)SDL_rand_r(&peer->rng, 4));
+    if(net_step(&peer->session, as)) {
+        peer->last_step += step_ns;
+        peer->max_unconfirmed = SDL_max(peer->max_unconfirmed, (int)(as->tick - peer->session.remote_count));
+    } else {
+        // stalled, don't make up for the time waited all at once
+        peer->last_step = SDL_max(peer->last_step, now - step_ns);
+    }
+}
+
+// The match as this side had it on tick
+static void dump_match(Peer *peer, Uint64 tick) {
+    AppState then;
+    char path[64];
+    if(!net_match_at(&peer->session, &peer->as, tick, &then)) {
+        fprintf(stderr, "%s: tick %" SDL_PRIu64 " is gone: %s\n", peer->name, tick, SDL_GetError());
+        return;
+    }
+    SDL_snprintf(path, sizeof(path), "desync-%" SDL_PRIu32 "-%s.txt", peer->session.start.match, peer->name);
+    SDL_IOStream *io = SDL_IOFromFile(path, "w");
+    bool written = io && sim_dump(&then, io);
+    if(io && !SDL_CloseIO(io))
+        written = false;
+    if(written)
+        fprintf(stderr, "%s: wrote %s\n", peer->name, path);
+    else
+        fprintf(stderr, "%s: couldn't write %s: %s\n", peer->name, path, SDL_GetError());
+    sim_free(&then);
+}
+
+static bool poll_peer(Peer *peer, int players) {
+    switch(net_poll(&peer->session, &peer->as)) {
+    case NET_EVENT_START:
+        if(!net_start_match(&peer->session, &peer->as, players)) {
+            fprintf(stderr, "%s couldn't start the match: %s\n", peer->name, SDL_GetError());
+            return false;
+        }
+        peer->last_step = SDL_GetTicksNS();
+        peer->max_unconfirmed = 0;
+        peer->desynced = false;
+        return true;
+    case NET_EVENT_DESYNC:
+        fprintf(stderr, "%s: the hashes differ at tick %" SDL_PRIu64 "\n", peer->name, peer->session.desync_tick);
+        peer->desynced = true;
+        if(!dumped) {
+            dumped = true;
+            dump_match(&host, peer->session.desync_tick);
+            dump_match(&client, peer->session.desync_tick);
+        }
+        return true;
+    case NET_EVENT_LOST:
+        fprintf(stderr, "%s lost the connection\n", peer->name);
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Played match to the end with all of the other side's inputs
+static bool finished(const Peer *peer, Uint32 match) {
+    return peer->session.playing && peer->session.start.match == match && sim_is_over(&peer->as) &&
+           net_confirmed(&peer->session, &peer->as);
+}
+
+// Everything a match is made of has to match on both sides
+static bool same_match(const AppState *a, const AppState *b) {
+    int players = a->total_human_players + a->total_computer_players;
+    if(a->tick != b->tick || a->rng != b->rng || a->state != b->state || a->remaining_players != b->remaining_players) {
+        fprintf(stderr, "tick %" SDL_PRIu64 "/%" SDL_PRIu64 ", rng, state or players left differ\n", a->tick, b->tick);
+        return false;
+    }
+    for(int i = 0; i < players; i++) {
+        const CharacterContext *x = &a->character_ctx[i];
+        const CharacterContext *y = &b->character_ctx[i];
+        if(x->head_xpos != y->head_xpos || x->head_ypos != y->head_ypos || x->next_dir != y->next_dir ||
+           x->is_alive != y->is_alive || x->is_invinsible != y->is_invinsible || x->invinsible_tick != y->invinsible_tick) {
+            fprintf(stderr, "player %d differs: (%d,%d) vs (%d,%d)\n", i, x->head_xpos, x->head_ypos, y->head_xpos, y->head_ypos);
+            return false;
+        }
+    }
+    if(a->board.dead_players != b->board.dead_players || a->board.free_count != b->board.free_count ||
+       memcmp(a->board.cells, b->board.cells, a->board.cell_count) != 0) {
+        fprintf(stderr, "the boards differ\n");
+        return false;
+    }
+    for(int i = 0; i < a->board.free_count; i++) {
+        if(board_free_cell(&a->board, i) != board_free_cell(&b->board, i)) {
+            fprintf(stderr, "the free cells differ\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_stats(const Peer *peer) {
+    const NetStats *stats = &peer->session.stats;
+    printf("  %-6s %5" SDL_PRIu64 " rollbacks, %6" SDL_PRIu64 " ticks played again (at most %2d at once, %6.1f us each),"
+           " %4" SDL_PRIu64 " stalls, up to %2d ticks ahead of the remote inputs, %" SDL_PRIu64 " of %" SDL_PRIu64
+           " hash checks failed\n",
+           peer->name, stats->rollbacks, stats->resimulated, stats->max_rollback,
+           stats->rollbacks ? stats->rollback_ns / 1000.0 / stats->rollbacks : 0.0, stats->stalls, peer->max_unconfirmed,
+           stats->desyncs, stats->hash_checks);
+}
+
+int main(int argc, char *argv[]) {
+    int matches = 5;
+    int players = TRON_DEFAULT_PLAYERS;
+    Uint64 seed = 0;
+    int port = 0;
+    NetConditions conditions = {40, 10, 5};
+    NetAddress address;
+    int failures = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--matches") == 0 && i + 1 < argc) {
+            matches = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            conditions.latency_ms = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            conditions.jitter_ms = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            conditions.loss_percent = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--step-ms") == 0 && i + 1 < argc) {
+            int step_ms = atoi(argv[++i]);
+            step_ns = (Uint64)SDL_max(step_ms, 1) * SDL_NS_PER_MS;
+        } else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--matches N] [--players N] [--seed N] [--latency MS] [--jitter MS] [--loss PERCENT] [--step-ms N] [--port N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(players < 2 || players > MAX_PLAYERS) {
+        fprintf(stderr, "--players must be between 2 and %d\n", MAX_PLAYERS);
+        return 1;
+    }
+
+    if(!net_init() || !net_host(&host.session, (Uint16)port, &conditions)) {
+        fprintf(stderr, "Couldn't host: %s\n", SDL_GetError());
+        return 1;
+    }
+    address.host = 0x7F000001; // 127.0.0.1
+    address.port = host.session.socket.port;
+    if(!net_join(&client.session, &address, &conditions)) {
+        fprintf(stderr, "Couldn't join: %s\n", SDL_GetError());
+        return 1;
+    }
+    printf("loopback port %d, %d ms latency, %d ms jitter, %d%% loss each way, %" SDL_PRIu64 " ms ticks\n",
+           address.port, conditions.latency_ms, conditions.jitter_ms, conditions.loss_percent, step_ns / SDL_NS_PER_MS);
+
+    Uint64 connecting = SDL_GetTicksNS();
+    while(!host.session.connected || !client.session.connected) {
+        if(!poll_peer(&host, players) || !poll_peer(&client, players) || SDL_GetTicksNS() - connecting > NET_TIMEOUT_NS) {
+            fprintf(stderr, "Couldn't connect\n");
+            return 1;
+        }
+        SDL_Delay(1);
+    }
+
+    for(int m = 0; m < matches; m++) {
+        host.as.seed = seed + m;
+        host.rng = seed + m;
+        client.rng = ~(seed + m);
+        SDL_zero(host.session.stats);
+        SDL_zero(client.session.stats);
+        if(!net_start_match(&host.session, &host.as, players)) {
+            fprintf(stderr, "Couldn't start match %d: %s\n", m, SDL_GetError());
+            return 1;
+        }
+        host.last_step = SDL_GetTicksNS();
+        host.max_unconfirmed = 0;
+        host.desynced = false;
+        dumped = false;
+
+        Uint64 started = SDL_GetTicksNS();
+        while(!finished(&host, host.session.start.match) || !finished(&client, host.session.start.match)) {
+            if(!poll_peer(&host, players) || !poll_peer(&client, players))
+                return 1;
+            Uint64 now = SDL_GetTicksNS();
+            run_peer(&host, now);
+            run_peer(&client, now);
+            if(now - started > MATCH_TIMEOUT_NS) {
+                fprintf(stderr, "match %d didn't finish\n", m);
+                return 1;
+            }
+            SDL_Delay(1);
+        }
+
+        bool same = same_match(&host.as, &client.as) && !host.desynced && !client.desynced;
+        printf("match %d: seed %" SDL_PRIu64 ", %" SDL_PRIu64 " ticks, %s\n", m, seed + m, host.as.tick,
+               same ? "both sides agree" : "DESYNC");
+        print_stats(&host);
+        print_stats(&client);
+        failures += !same;
+    }
+    printf("%" SDL_PRIu64 " datagrams sent, %" SDL_PRIu64 " dropped\n",
+           host.session.socket.sent + client.session.socket.sent, host.session.socket.dropped + client.session.socket.dropped);
+
+    net_close(&host.session);
+    net_close(&client.session);
+    sim_free(&host.as);
+    sim_free(&client.as);
+    net_quit();
+    SDL_Quit();
+    return failures ? 1 : 0;
+}
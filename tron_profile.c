@@ -0,0 +1,261 @@
+// Frame phase timings. See tron_profile.h
+#include "tron_profile.h"
+#include "tron_bits.h"
+
+#define OVERLAY_MARGIN 4.0f
+#define OVERLAY_LINE   (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2)
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+    "audio", "step", "background", "board", "menu", "overlay", "present", "other"
+};
+
+static const SDL_Color OVERLAY_BG_COLOR   = {0, 0, 0, 192};
+static const SDL_Color OVERLAY_TEXT_COLOR = {255, 255, 255, SDL_ALPHA_OPAQUE};
+
+const char *profile_phase_name(FramePhase phase) {
+    return phase < PHASE_COUNT ? PHASE_NAMES[phase] : "frame";
+}
+
+// Quarter octaves: the top bit picks the octave and the two bits under it the quarter
+static int bucket_of(Uint64 ns) {
+    if(ns < 4)
+        return (int)ns;
+    int top = highest_bit(ns);
+    return 4 * (top - 1) + (int)((ns >> (top - 2)) & 3);
+}
+
+// Middle of a bucket's range
+static Uint64 bucket_ns(int bucket) {
+    if(bucket < 4)
+        return (Uint64)bucket;
+    int shift = bucket / 4 - 1;
+    Uint64 low = (Uint64)(4 + bucket % 4) << shift;
+    return low + ((Uint64)1 << shift) / 2;
+}
+
+static int SDLCALL compare_ns(const void *a, const void *b) {
+    Uint64 x = *(const Uint64 *)a;
+    Uint64 y = *(const Uint64 *)b;
+    return (x > y) - (x < y);
+}
+
+static void count_frame(FrameProfiler *profiler, const FrameTimes *frame, int delta) {
+    for(int phase = 0; phase < PHASE_COUNT; phase++) {
+        profiler->histogram[phase][bucket_of(frame->phase_ns[phase])] += delta;
+    }
+    profiler->histogram[PHASE_COUNT][bucket_of(frame->frame_ns)] += delta;
+}
+
+static void write_csv(FrameProfiler *profiler, const FrameTimes *frame) {
+    if(!SDL_IOprintf(profiler->csv, "%" SDL_PRIu64 ",%" SDL_PRIu64 ",%d", profiler->closed, frame->tick, frame->ticks))
+        goto failed;
+    for(int phase = 0; phase < PHASE_COUNT; phase++) {
+        if(!SDL_IOprintf(profiler->csv, ",%" SDL_PRIu64, frame->phase_ns[phase]))
+            goto failed;
+    }
+    if(SDL_IOprintf(profiler->csv, ",%" SDL_PRIu64 "\n", frame->frame_ns))
+        return;
+failed:
+    SDL_Log("Couldn't write the frame profile, stopping it: %s", SDL_GetError());
+    profile_close_csv(profiler);
+}
+
+void profile_frame_begin(FrameProfiler *profiler, Uint64 tick) {
+    if(profiler->mark) {
+        // close the previous frame, the time since its last mark was spent outside of SDL_AppIterate
+        FrameTimes *frame = &profiler->current;
+        profile_mark(profiler, PHASE_OTHER);
+        frame->frame_ns = 0;
+        for(int phase = 0; phase < PHASE_COUNT; phase++) {
+            frame->frame_ns += frame->phase_ns[phase];
+        }
+        if(profiler->count == PROFILE_FRAMES)
+            count_frame(profiler, &profiler->frames[profiler->next], -1);
+        else
+            profiler->count++;
+        profiler->frames[profiler->next] = *frame;
+        count_frame(profiler, frame, 1);
+        profiler->next = (profiler->next + 1) % PROFILE_FRAMES;
+        if(profiler->csv)
+            write_csv(profiler, frame);
+        profiler->closed++;
+    } else {
+        profiler->mark = SDL_GetTicksNS();
+    }
+    SDL_zero(profiler->current);
+    profiler->current.tick = tick;
+}
+
+bool profile_open_csv(FrameProfiler *profiler, const char *path) {
+    profile_close_csv(profiler);
+    profiler->csv = SDL_IOFromFile(path, "w");
+    if(!profiler->csv)
+        return false;
+    SDL_IOprintf(profiler->csv, "frame,tick,ticks");
+    for(int phase = 0; phase < PHASE_COUNT; phase++) {
+        SDL_IOprintf(profiler->csv, ",%s_ns", PHASE_NAMES[phase]);
+    }
+    if(!SDL_IOprintf(profiler->csv, ",frame_ns\n")) {
+        profile_close_csv(profiler);
+        return false;
+    }
+    return true;
+}
+
+void profile_close_csv(FrameProfiler *profiler) {
+    if(profiler->csv && !SDL_CloseIO(profiler->csv))
+        SDL_Log("Couldn't finish the frame profile: %s", SDL_GetError());
+    profiler->csv = NULL;
+}
+
+Uint64 profile_percentile_ns(const FrameProfiler *profiler, int phase, int percentile) {
+    // the frame of rank ceil(count * percentile / 100), counting from 1
+    int rank = SDL_max((profiler->count * percentile + 99) / 100, 1);
+    int seen = 0;
+    if(profiler->count == 0)
+        return 0;
+    for(int bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+        seen += (int)profiler->histogram[phase][bucket];
+        if(seen >= rank)
+            return bucket_ns(bucket);
+    }
+    return 0;
+}
+
+static Uint64 frame_phase_ns(const FrameTimes *frame, int phase) {
+    return phase < PHASE_COUNT ? frame->phase_ns[phase] : frame->frame_ns;
+}
+
+void profile_draw_overlay(const FrameProfiler *profiler, SDL_Renderer *renderer) {
+    char line[96];
+    float y = OVERLAY_MARGIN;
+    int last = (profiler->next + PROFILE_FRAMES - 1) % PROFILE_FRAMES;
+    SDL_FRect backdrop = {0, 0, 60 * SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2 * OVERLAY_MARGIN,
+                          (PHASE_COUNT + 7) * OVERLAY_LINE + 2 * OVERLAY_MARGIN};
+    if(profiler->count == 0)
+        return;
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, OVERLAY_BG_COLOR.r, OVERLAY_BG_COLOR.g, OVERLAY_BG_COLOR.b, OVERLAY_BG_COLOR.a);
+    SDL_RenderFillRect(renderer, &backdrop);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(renderer, OVERLAY_TEXT_COLOR.r, OVERLAY_TEXT_COLOR.g, OVERLAY_TEXT_COLOR.b, OVERLAY_TEXT_COLOR.a);
+
+    Uint64 p50_frame = profile_percentile_ns(profiler, PHASE_COUNT, 50);
+    SDL_snprintf(line, sizeof(line), "last %d frames, %.1f fps at the median", profiler->count,
+                 p50_frame ? (double)SDL_NS_PER_SECOND / p50_frame : 0.0);
+    SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+    y += OVERLAY_LINE;
+    SDL_snprintf(line, sizeof(line), "steps %" SDL_PRIu64 ", %" SDL_PRIu64 " late, %" SDL_PRIu64 " dropped",
+                 profiler->played_ticks, profiler->late_ticks, profiler->dropped_ticks);
+    SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+    y += OVERLAY_LINE;
+    SDL_snprintf(line, sizeof(line), "%-10s %9s %9s %9s %9s %9s", "us", "last", "avg", "p50", "p99", "max");
+    SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+    y += OVERLAY_LINE;
+    for(int phase = 0; phase <= PHASE_COUNT; phase++) {
+        Uint64 total = 0;
+        Uint64 max = 0;
+        for(int i = 0; i < profiler->count; i++) {
+            Uint64 ns = frame_phase_ns(&profiler->frames[i], phase);
+            total += ns;
+            max = SDL_max(max, ns);
+        }
+        SDL_snprintf(line, sizeof(line), "%-10s %9.1f %9.1f %9.1f %9.1f %9.1f", profile_phase_name((FramePhase)phase),
+                     frame_phase_ns(&profiler->frames[last], phase) / 1000.0, (double)total / profiler->count / 1000.0,
+                     profile_percentile_ns(profiler, phase, 50) / 1000.0,
+                     profile_percentile_ns(profiler, phase, 99) / 1000.0, max / 1000.0);
+        SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+        y += OVERLAY_LINE;
+    }
+
+    y += OVERLAY_LINE;
+    SDL_snprintf(line, sizeof(line), "%-10s %9s %9s %9s %9s %9s", "key to, us", "turns", "p50", "p90", "p99", "max");
+    SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+    y += OVERLAY_LINE;
+    for(int i = 0; i < 2; i++) {
+        const LatencySamples *samples = i == 0 ? &profiler->latency.key_to_move : &profiler->latency.key_to_present;
+        SDL_snprintf(line, sizeof(line), "%-10s %9d %9.1f %9.1f %9.1f %9.1f", i == 0 ? "move" : "present", samples->count,
+                     latency_percentile_ns(samples, 50) / 1000.0, latency_percentile_ns(samples, 90) / 1000.0,
+                     latency_percentile_ns(samples, 99) / 1000.0, latency_percentile_ns(samples, 100) / 1000.0);
+        SDL_RenderDebugText(renderer, OVERLAY_MARGIN, y, line);
+        y += OVERLAY_LINE;
+    }
+}
+
+void profile_count_ticks(FrameProfiler *profiler, int played, int late, Uint64 dropped) {
+    profiler->current.ticks += played;
+    profiler->played_ticks += played;
+    profiler->late_ticks += late;
+    profiler->dropped_ticks += dropped;
+}
+
+void profile_log_ticks(const FrameProfiler *profiler) {
+    if(profiler->late_ticks == 0 && profiler->dropped_ticks == 0)
+        return;
+    SDL_Log("%" SDL_PRIu64 " steps played, %" SDL_PRIu64 " of them late, %" SDL_PRIu64 " dropped",
+            profiler->played_ticks, profiler->late_ticks, profiler->dropped_ticks);
+}
+
+static void add_latency(LatencySamples *samples, Uint64 ns) {
+    samples->ns[samples->next] = ns;
+    samples->next = (samples->next + 1) % LATENCY_SAMPLES;
+    samples->count = SDL_min(samples->count + 1, LATENCY_SAMPLES);
+}
+
+void latency_turn_queued(LatencyProbe *probe, int player, Uint64 key_ns) {
+    // the sim's queue holds INPUT_QUEUE_SIZE turns, so does this one
+    if(player < 0 || player >= LATENCY_PLAYERS || probe->queued_count[player] == INPUT_QUEUE_SIZE)
+        return;
+    int slot = (probe->queued_first[player] + probe->queued_count[player]) % INPUT_QUEUE_SIZE;
+    probe->queued[player][slot] = key_ns;
+    probe->queued_count[player]++;
+}
+
+void latency_turns_taken(LatencyProbe *probe, int player, int turns, Uint64 now_ns) {
+    if(player < 0 || player >= LATENCY_PLAYERS)
+        return;
+    for(; turns > 0 && probe->queued_count[player] > 0; turns--) {
+        Uint64 key_ns = probe->queued[player][probe->queued_first[player]];
+        probe->queued_first[player] = (probe->queued_first[player] + 1) % INPUT_QUEUE_SIZE;
+        probe->queued_count[player]--;
+        add_latency(&probe->key_to_move, now_ns - key_ns);
+        if(probe->taken_count < LATENCY_WAITING)
+            probe->taken[probe->taken_count++] = key_ns;
+    }
+}
+
+void latency_presented(LatencyProbe *probe, Uint64 now_ns) {
+    for(int i = 0; i < probe->taken_count; i++) {
+        add_latency(&probe->key_to_present, now_ns - probe->taken[i]);
+    }
+    probe->taken_count = 0;
+}
+
+void latency_reset(LatencyProbe *probe) {
+    SDL_zeroa(probe->queued_count);
+    probe->taken_count = 0;
+}
+
+Uint64 latency_percentile_ns(const LatencySamples *samples, int percentile) {
+    Uint64 sorted[LATENCY_SAMPLES];
+    if(samples->count == 0)
+        return 0;
+    SDL_memcpy(sorted, samples->ns, samples->count * sizeof(Uint64));
+    SDL_qsort(sorted, samples->count, sizeof(Uint64), compare_ns);
+    // nearest rank
+    int rank = SDL_max((samples->count * percentile + 99) / 100, 1);
+    return sorted[rank - 1];
+}
+
+void latency_log(const LatencyProbe *probe) {
+    for(int i = 0; i < 2; i++) {
+        const LatencySamples *samples = i == 0 ? &probe->key_to_move : &probe->key_to_present;
+        if(samples->count == 0)
+            continue;
+        SDL_Log("key to %s over the last %d turns: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms",
+                i == 0 ? "move" : "present", samples->count,
+                latency_percentile_ns(samples, 50) / 1e6, latency_percentile_ns(samples, 90) / 1e6,
+                latency_percentile_ns(samples, 99) / 1e6, latency_percentile_ns(samples, 100) / 1e6);
+    }
+}
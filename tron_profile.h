@@ -0,0 +1,135 @@
+/*
+  Where the time of a frame goes.
+
+  SDL_AppIterate marks the end of every phase of its frame as it goes, everything since the
+  previous mark is put on that phase:
+
+    profile_frame_begin(&profiler, as->tick); // top of the frame
+    ...refill the music...
+    profile_mark(&profiler, PHASE_AUDIO);
+    ...
+    SDL_RenderPresent(renderer);
+    profile_mark(&profiler, PHASE_PRESENT);
+
+  A frame is closed by the next profile_frame_begin, which puts whatever happened between the two
+  frames (events, the OS) on PHASE_OTHER, so the phases of a frame always add up to the time from
+  its start to the next one. A mark is one SDL_GetTicksNS and an add.
+
+  The last PROFILE_FRAMES frames are kept in a ring, next to a histogram per phase of the same
+  frames: a frame's times are added when it comes in and taken out again when the ring overwrites
+  it. Buckets are quarter octaves of nanoseconds, so the percentiles are within 25% whatever the
+  scale. profile_draw_overlay shows the ring's numbers with the renderer's debug text (no fonts, no
+  textures to build). With a CSV open every frame is written out as it is closed.
+
+  The latency probe follows human turns from the key press to the step that takes them
+  (key-to-move) and on to the SDL_RenderPresent that shows them (key-to-present). Key presses are
+  timed by their event's timestamp, so the time the event spent waiting to be handled counts. A
+  turn is followed from the moment the simulation queues it (latency_turn_queued) until a step
+  takes it (latency_turns_taken), the sim takes a player's turns in order so a FIFO of key
+  timestamps per player is all it needs. The last LATENCY_SAMPLES of each are kept.
+
+  The frame loop also reports the steps it played (profile_count_ticks): how many in the frame, and
+  over the whole run the ones that ran late, a step or more after they were due, and the ones it
+  dropped because it had fallen too far behind (see run_due_steps in tron.c).
+*/
+#ifndef TRON_PROFILE_H
+#define TRON_PROFILE_H
+
+#include <SDL3/SDL.h>
+#include "tron_sim.h" // INPUT_QUEUE_SIZE
+
+#define PROFILE_FRAMES  256
+#define PROFILE_BUCKETS 256 // 4 per octave covers all of Uint64
+#define LATENCY_SAMPLES 256
+#define LATENCY_PLAYERS 2   // humans, see player_keys
+#define LATENCY_WAITING 16  // turns taken but not presented yet
+
+typedef enum
+{
+    PHASE_AUDIO = 0U,  // refilling the music
+    PHASE_STEP,        // the ticks due this frame, their items and sound effects
+    PHASE_BACKGROUND,  // draw_background
+    PHASE_BOARD,       // draw_game_board
+    PHASE_MENU,        // menus and their text
+    PHASE_OVERLAY,     // the profiler's own overlay
+    PHASE_PRESENT,     // SDL_RenderPresent
+    PHASE_OTHER,       // between frames
+    PHASE_COUNT
+} FramePhase;
+
+typedef struct
+{
+    Uint64 tick;                 // AppState.tick when the frame began
+    int ticks;                   // steps played in the frame
+    Uint64 phase_ns[PHASE_COUNT];
+    Uint64 frame_ns;             // all phases
+} FrameTimes;
+
+typedef struct
+{
+    Uint64 ns[LATENCY_SAMPLES]; // ring
+    int next;
+    int count;
+} LatencySamples;
+
+typedef struct
+{
+    Uint64 queued[LATENCY_PLAYERS][INPUT_QUEUE_SIZE]; // key timestamps of the turns in the sim's queues
+    int queued_first[LATENCY_PLAYERS];
+    int queued_count[LATENCY_PLAYERS];
+    Uint64 taken[LATENCY_WAITING]; // key timestamps of the turns taken since the last present
+    int taken_count;
+    LatencySamples key_to_move;
+    LatencySamples key_to_present;
+} LatencyProbe;
+
+typedef struct
+{
+    FrameTimes frames[PROFILE_FRAMES]; // ring of the closed frames
+    int next;                          // where the next closed frame goes
+    int count;
+    Uint32 histogram[PHASE_COUNT + 1][PROFILE_BUCKETS]; // of the frames in the ring, the frame total last
+    FrameTimes current;
+    Uint64 mark;     // SDL_GetTicksNS of the last mark, 0 before the first frame
+    Uint64 closed;   // frames closed so far
+    Uint64 played_ticks;
+    Uint64 late_ticks;    // played a step or more after they were due
+    Uint64 dropped_ticks; // never played, the clock skipped them
+    SDL_IOStream *csv;
+    LatencyProbe latency;
+} FrameProfiler;
+
+const char *profile_phase_name(FramePhase phase);
+void profile_frame_begin(FrameProfiler *profiler, Uint64 tick);
+
+// Everything since the previous mark (or the frame's start) was phase
+static inline void profile_mark(FrameProfiler *profiler, FramePhase phase) {
+    Uint64 now = SDL_GetTicksNS();
+    profiler->current.phase_ns[phase] += now - profiler->mark;
+    profiler->mark = now;
+}
+
+// Write every frame closed from now on to path, replacing it. Sets SDL_GetError on failure
+bool profile_open_csv(FrameProfiler *profiler, const char *path);
+void profile_close_csv(FrameProfiler *profiler);
+// Percentile (0-100) of a phase's time over the ring, PHASE_COUNT for whole frames
+Uint64 profile_percentile_ns(const FrameProfiler *profiler, int phase, int percentile);
+void profile_draw_overlay(const FrameProfiler *profiler, SDL_Renderer *renderer);
+// The frame played played steps, late of them late, and dropped dropped ones
+void profile_count_ticks(FrameProfiler *profiler, int played, int late, Uint64 dropped);
+// The late and dropped steps with SDL_Log, when there were any
+void profile_log_ticks(const FrameProfiler *profiler);
+
+// A turn of player's, pressed at key_ns (SDL_GetTicksNS time), went into the simulation's queue
+void latency_turn_queued(LatencyProbe *probe, int player, Uint64 key_ns);
+// A step at now_ns took turns of player's queued turns
+void latency_turns_taken(LatencyProbe *probe, int player, int turns, Uint64 now_ns);
+// Everything taken so far made it to the screen at now_ns
+void latency_presented(LatencyProbe *probe, Uint64 now_ns);
+// Forget the turns in flight, for a new match
+void latency_reset(LatencyProbe *probe);
+Uint64 latency_percentile_ns(const LatencySamples *samples, int percentile);
+// Percentiles of both latencies with SDL_Log
+void latency_log(const LatencyProbe *probe);
+
+#endif // TRON_PROFILE_H
@@ -0,0 +1,224 @@
+// Drawing the arena. See tron_render.h
+#include <SDL3_image/SDL_image.h>
+#include "tron_render.h"
+
+// Colors
+static const SDL_Color COLOR_BG                   = {8, 12, 20, SDL_ALPHA_OPAQUE};     // Deep faded blue
+static const SDL_Color COLOR_BG_OUTLINE           = {18, 24, 35, SDL_ALPHA_OPAQUE};    // Subtle grid outline
+static const SDL_Color COLOR_P1                   = {0, 255, 255, SDL_ALPHA_OPAQUE};    // Cyan (classic Tron)
+static const SDL_Color COLOR_P2                   = {255, 0, 255, SDL_ALPHA_OPAQUE};    // Magenta (cyberpunky)
+static const SDL_Color COLOR_P3                   = {255, 165, 0, SDL_ALPHA_OPAQUE};    // Orange (warm neon)
+static const SDL_Color COLOR_P4                   = {0, 255, 128, SDL_ALPHA_OPAQUE};    // Mint green (futuristic)
+static const SDL_Color COLOR_CRASHED              = {90, 100, 110, SDL_ALPHA_OPAQUE};
+static const SDL_Color COLOR_INVINSIBLE           = {0, 255, 255, SDL_ALPHA_OPAQUE};
+
+// COLOR_P1..COLOR_P4 and then generated colors for everybody after them (init_player_colors)
+static SDL_Color player_colors[MAX_PLAYERS];
+
+// helper to create rectangle objects, x and y coords will be the position on the 2d matrix,
+// but has to be scaled for the window size
+static void set_rect_xy(const BoardRenderer *board_renderer, SDL_FRect *r, int x, int y, float w, float h)
+{
+    r->x = x * board_renderer->block_size;
+    r->y = y * board_renderer->block_size;
+    r->w = w;
+    r->h = h;
+}
+
+// The first four players keep their colors, everybody after them gets a fully saturated hue
+// stepped by the golden angle so neighbouring players never look alike
+static void init_player_colors(void) {
+    player_colors[0] = COLOR_P1;
+    player_colors[1] = COLOR_P2;
+    player_colors[2] = COLOR_P3;
+    player_colors[3] = COLOR_P4;
+    for(int i = 4; i < MAX_PLAYERS; i++) {
+        float hue = SDL_fmodf(i * 137.508f, 360.0f) / 60.0f;
+        float fall = 1.0f - SDL_fabsf(SDL_fmodf(hue, 2.0f) - 1.0f);
+        Uint8 second = (Uint8)(255.0f * fall);
+        SDL_Color color = {0, 0, 0, SDL_ALPHA_OPAQUE};
+        switch((int)hue) {
+            case 0:  color.r = 255;    color.g = second; break;
+            case 1:  color.r = second; color.g = 255;    break;
+            case 2:  color.g = 255;    color.b = second; break;
+            case 3:  color.g = second; color.b = 255;    break;
+            case 4:  color.r = second; color.b = 255;    break;
+            default: color.r = 255;    color.b = second; break;
+        }
+        player_colors[i] = color;
+    }
+}
+
+void render_init(BoardRenderer *board_renderer, SDL_Renderer *renderer, float block_size) {
+    init_player_colors();
+    board_renderer->renderer = renderer;
+    board_renderer->block_size = block_size;
+    // loaded once, drawing an item is then just a copy of the texture
+    board_renderer->star = IMG_LoadTexture(renderer, STAR_SPRITE_PATH);
+    if(!board_renderer->star) {
+        SDL_Log("Could not load file: %s", SDL_GetError());
+    }
+}
+
+void render_free(BoardRenderer *board_renderer) {
+    if(board_renderer->star)
+        SDL_DestroyTexture(board_renderer->star);
+    board_renderer->star = NULL;
+}
+
+// cell in a matrix will be mapped to a player. This maps each player to a sepcific color.
+static const SDL_Color get_color_for_cell(Cell cell) {
+    if(cell_is_player(cell))
+        return player_colors[cell - CELL_P1];
+    if(cell == CELL_DEAD)
+        return COLOR_CRASHED;
+    return COLOR_BG;
+}
+
+// Helper function to set the rendering color instead of manually type RGB values everytime
+void set_sdl_color(SDL_Renderer *renderer, const SDL_Color *color) {
+    SDL_SetRenderDrawColor(renderer, color->r, color->g, color->b, color->a);
+}
+
+// Draw background, first thing that will get drawn on every game cycle
+void draw_background(const BoardRenderer *board_renderer, int width, int height) {
+    SDL_Renderer *renderer = board_renderer->renderer;
+    float block_size = board_renderer->block_size;
+    SDL_FRect r;
+    set_sdl_color(renderer, &COLOR_BG);
+    SDL_RenderClear(renderer);
+    if(block_size < MIN_GRID_BLOCK_SIZE)
+        return;
+    set_sdl_color(renderer, &COLOR_BG_OUTLINE);
+    for(int i = 0; i < width; i += BACKGROUND_SCALE) {
+        for(int j = 0; j < height; j += BACKGROUND_SCALE) {
+            set_rect_xy(board_renderer, &r, i, j, block_size*BACKGROUND_SCALE, block_size*BACKGROUND_SCALE);
+            SDL_RenderRect(renderer, &r);
+        }
+    }
+}
+
+static void draw_item(const BoardRenderer *board_renderer, int x, int y) {
+    SDL_FRect r;
+    if(!board_renderer->star)
+        return;
+    set_rect_xy(board_renderer, &r, x, y, board_renderer->block_size, board_renderer->block_size);
+    SDL_RenderTexture(board_renderer->renderer, board_renderer->star, NULL, &r);
+}
+
+static void draw_cell(const BoardRenderer *board_renderer, Cell cell, int x, int y, Effect effect) {
+    SDL_Renderer *renderer = board_renderer->renderer;
+    SDL_FRect r;
+    if(cell_is_player(cell) || cell == CELL_DEAD) {
+        SDL_Color cell_color = get_color_for_cell(cell);
+        set_sdl_color(renderer, &cell_color);
+        set_rect_xy(board_renderer, &r, x, y, board_renderer->block_size, board_renderer->block_size);
+        if(effect == INVINSIBLE)
+            SDL_RenderRect(renderer, &r);
+        else
+            SDL_RenderFillRect(renderer, &r);
+        return;
+    }
+    switch(cell) {
+        case CELL_NOTHING:
+            break;
+        case CELL_ITEM_STAR:
+            draw_item(board_renderer,x,y);
+            break;
+        case CELL_ITEM_BOMB:
+            draw_item(board_renderer,x,y);
+            break;
+        default:
+            SDL_Log("ERROR - unexpected cell: %d\n", cell);
+    }
+}
+
+static Effect get_cell_effect(const AppState *as, Cell cell) {
+    Effect effect = NONE;
+    if(cell_is_player(cell)) {
+        if(as->character_ctx[cell - CELL_P1].is_invinsible)
+            return effect = INVINSIBLE;
+    }
+    return effect;
+}
+
+SDL_FORCE_INLINE void draw_board_kernel(const Board *board, int width, int height, const BoardRenderer *board_renderer, const AppState *as) {
+    Cell cell;
+    Effect effect = NONE;
+    for (int j = 0; j < height; j++) {
+        const Uint8 *row = &board->cells[board_index_in(width + 2, 0, j)];
+        for (int i = 0; i < width; i++) {
+            if(row[i] == CELL_NOTHING)
+                continue;
+            cell = board_resolve(board, row[i]);
+            effect = get_cell_effect(as, cell);
+            draw_cell(board_renderer,cell,i,j,effect);
+        }
+    }
+}
+
+// Draw each character and their tails on the game board
+void draw_game_board(const BoardRenderer *board_renderer, const AppState *as) {
+    BOARD_SPECIALIZE(&as->board, draw_board_kernel, board_renderer, as);
+}
+
+void render_remember_heads(HeadMotion *motion, const AppState *as) {
+    int players = as->total_human_players + as->total_computer_players;
+    for(int i = 0; i < players; i++) {
+        motion->head_xpos[i] = as->character_ctx[i].head_xpos;
+        motion->head_ypos[i] = as->character_ctx[i].head_ypos;
+    }
+    motion->tick = as->tick;
+}
+
+// Put a cell back the way draw_background left it
+static void clear_cell(const BoardRenderer *board_renderer, int x, int y) {
+    SDL_Renderer *renderer = board_renderer->renderer;
+    float block_size = board_renderer->block_size;
+    SDL_FRect r;
+    set_rect_xy(board_renderer, &r, x, y, block_size, block_size);
+    set_sdl_color(renderer, &COLOR_BG);
+    SDL_RenderFillRect(renderer, &r);
+    if(block_size < MIN_GRID_BLOCK_SIZE)
+        return;
+    set_sdl_color(renderer, &COLOR_BG_OUTLINE);
+    SDL_RenderRect(renderer, &r);
+}
+
+void draw_moving_heads(const BoardRenderer *board_renderer, const AppState *as, const HeadMotion *motion, float fraction) {
+    SDL_Renderer *renderer = board_renderer->renderer;
+    float block_size = board_renderer->block_size;
+    int players = as->total_human_players + as->total_computer_players;
+    if(motion->tick + 1 != as->tick || fraction >= 1.0f)
+        return;
+    float grown = SDL_max(fraction, 0.0f) * block_size;
+    for(int i = 0; i < players; i++) {
+        const CharacterContext *ctx = &as->character_ctx[i];
+        int x = ctx->head_xpos;
+        int y = ctx->head_ypos;
+        int dx = x - motion->head_xpos[i];
+        int dy = y - motion->head_ypos[i];
+        // crashed heads stay where they hit, anything but a one cell move (a seek) is drawn as it is
+        if(!ctx->is_alive || SDL_abs(dx) + SDL_abs(dy) != 1)
+            continue;
+
+        SDL_FRect r;
+        set_rect_xy(board_renderer, &r, x, y, block_size, block_size);
+        clear_cell(board_renderer, x, y);
+        // grow from the edge shared with the previous cell
+        if(dx) {
+            r.w = grown;
+            if(dx < 0)
+                r.x += block_size - grown;
+        } else {
+            r.h = grown;
+            if(dy < 0)
+                r.y += block_size - grown;
+        }
+        set_sdl_color(renderer, &player_colors[i]);
+        if(ctx->is_invinsible)
+            SDL_RenderRect(renderer, &r);
+        else
+            SDL_RenderFillRect(renderer, &r);
+    }
+}
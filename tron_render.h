@@ -0,0 +1,67 @@
+/*
+  Drawing the arena: the background grid, the trails and the items.
+
+  The game and tron_bench share this, everything on top of the arena (menus, text) stays in
+  tron.c. A BoardRenderer holds what drawing needs besides the match: the renderer, how many
+  pixels a cell takes and the item sprite, which render_init loads once.
+
+    render_init(&board_renderer, renderer, block_size); // after the renderer is created
+    draw_background(&board_renderer, as->board.width, as->board.height);
+    draw_game_board(&board_renderer, as);
+    render_free(&board_renderer);
+
+  The match only moves once a step, drawing just the board would show motion at the step rate
+  whatever the display does. Between two steps the heads are drawn part of the way instead: the
+  front end remembers where the heads were before each step (render_remember_heads) and, over the
+  board, draw_moving_heads grows every head that moved from its previous cell into its new one by
+  the fraction of the step that has gone by. That shows the match a step late, in exchange a frame
+  never guesses at a turn or a crash that hasn't happened yet.
+
+    render_remember_heads(&motion, as);
+    sim_step(as);
+    ...
+    draw_game_board(&board_renderer, as);
+    draw_moving_heads(&board_renderer, as, &motion, fraction); // 0 just after the step, 1 when the next one is due
+*/
+#ifndef TRON_RENDER_H
+#define TRON_RENDER_H
+
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+
+#define BLOCK_SIZE_IN_PIXELS 16 // cells of the default arena, big arenas get smaller ones
+#define STAR_SPRITE_PATH    "ressources/sprites/star.png"
+#define MIN_GRID_BLOCK_SIZE 4.0f // the background grid is left out below this
+#define BACKGROUND_SCALE    1
+
+typedef struct
+{
+    SDL_Renderer *renderer;
+    float block_size;  // pixels per cell
+    SDL_Texture *star; // item sprite, NULL when it couldn't be loaded (items aren't drawn then)
+} BoardRenderer;
+
+// The heads before the last step
+typedef struct
+{
+    int head_xpos[MAX_PLAYERS];
+    int head_ypos[MAX_PLAYERS];
+    Uint64 tick; // AppState.tick they were at
+} HeadMotion;
+
+// Also sets up the player colors. A missing sprite is logged and not fatal
+void render_init(BoardRenderer *board_renderer, SDL_Renderer *renderer, float block_size);
+void render_free(BoardRenderer *board_renderer);
+
+void set_sdl_color(SDL_Renderer *renderer, const SDL_Color *color);
+// First thing that gets drawn on every frame, width x height cells
+void draw_background(const BoardRenderer *board_renderer, int width, int height);
+// Every character, their tails and the items
+void draw_game_board(const BoardRenderer *board_renderer, const AppState *as);
+// Right before a step
+void render_remember_heads(HeadMotion *motion, const AppState *as);
+// Over draw_game_board: the cells the heads moved into on the last step, fraction (0-1) of the way
+// in. Draws nothing when motion isn't from the step before as->tick
+void draw_moving_heads(const BoardRenderer *board_renderer, const AppState *as, const HeadMotion *motion, float fraction);
+
+#endif // TRON_RENDER_H
@@ -0,0 +1,411 @@
+// Match replays. See tron_replay.h
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "tron_replay.h"
+#include "tron_bits.h"
+
+#define REPLAY_MAGIC       "TRPL"
+#define REPLAY_FIXED_BYTES 29 // header bytes before the per player AI types
+#define REPLAY_HASH_BYTES  4
+
+int replay_match_winner(const AppState *as) {
+    int players = as->total_human_players + as->total_computer_players;
+    int winner = players;
+    for(int i = 0; i < players; i++) {
+        if(as->character_ctx[i].is_alive)
+            winner = i;
+    }
+    return winner;
+}
+
+// The AppState fields a match changes as it plays, besides the board and the characters
+typedef struct
+{
+    Uint64 tick;
+    Uint64 rng;
+    State state;
+    int remaining_players;
+    int winner;
+    Uint64 hash;
+} MatchFields;
+
+// Keep a keyframe when as is at the next REPLAY_KEYFRAME_TICKS boundary. record and played say where
+// the inputs of as->tick are. Running out of memory only costs later seeks some speed
+static void add_keyframe(ReplayTimeline *timeline, const AppState *as, size_t record, Uint64 played) {
+    if(!timeline || as->tick % REPLAY_KEYFRAME_TICKS != 0 || as->tick == 0)
+        return;
+    if(as->tick != (Uint64)(timeline->count + 1) * REPLAY_KEYFRAME_TICKS)
+        return; // already have it, or a gap before it
+    int players = as->total_human_players + as->total_computer_players;
+    size_t characters = (size_t)players * sizeof(CharacterContext);
+    size_t bound = sizeof(MatchFields) + characters + board_pack_bound(&as->board);
+    if(timeline->count == timeline->capacity) {
+        int capacity = SDL_max(timeline->capacity * 2, 16);
+        ReplayKeyframe *keyframes = (ReplayKeyframe *)SDL_realloc(timeline->keyframes, capacity * sizeof(ReplayKeyframe));
+        if(!keyframes)
+            return;
+        timeline->keyframes = keyframes;
+        timeline->capacity = capacity;
+    }
+    if(timeline->size + bound > timeline->capacity_bytes) {
+        size_t capacity = SDL_max(timeline->capacity_bytes * 2, timeline->size + bound);
+        Uint8 *snapshots = (Uint8 *)SDL_realloc(timeline->snapshots, capacity);
+        if(!snapshots)
+            return;
+        timeline->snapshots = snapshots;
+        timeline->capacity_bytes = capacity;
+    }
+
+    MatchFields fields;
+    SDL_zero(fields);
+    fields.tick = as->tick;
+    fields.rng = as->rng;
+    fields.state = as->state;
+    fields.remaining_players = as->remaining_players;
+    fields.winner = as->winner;
+    fields.hash = as->hash;
+
+    Uint8 *out = &timeline->snapshots[timeline->size];
+    SDL_memcpy(out, &fields, sizeof(fields));
+    SDL_memcpy(out + sizeof(fields), as->character_ctx, characters);
+    size_t size = sizeof(fields) + characters + board_pack(&as->board, out + sizeof(fields) + characters);
+
+    ReplayKeyframe *keyframe = &timeline->keyframes[timeline->count++];
+    keyframe->tick = as->tick;
+    keyframe->record = record;
+    keyframe->played = played;
+    keyframe->offset = timeline->size;
+    keyframe->size = size;
+    timeline->size += size;
+}
+
+void replay_timeline_clear(ReplayTimeline *timeline) {
+    timeline->count = 0;
+    timeline->size = 0;
+}
+
+void replay_timeline_free(ReplayTimeline *timeline) {
+    SDL_free(timeline->keyframes);
+    SDL_free(timeline->snapshots);
+    SDL_zerop(timeline);
+}
+
+static bool reserve(ReplayRecorder *rec, size_t bytes) {
+    if(rec->size + bytes <= rec->capacity)
+        return true;
+    size_t capacity = SDL_max(rec->capacity * 2, 256);
+    while(capacity < rec->size + bytes)
+        capacity *= 2;
+    Uint8 *data = (Uint8 *)SDL_realloc(rec->data, capacity);
+    if(!data) {
+        rec->failed = true;
+        return false;
+    }
+    rec->data = data;
+    rec->capacity = capacity;
+    return true;
+}
+
+// Append the pending record: its run as a varint, the directions and the hash
+static void flush_record(ReplayRecorder *rec) {
+    if(rec->run == 0 || !reserve(rec, VARINT_MAX_BYTES + rec->dir_bytes + REPLAY_HASH_BYTES))
+        return;
+    rec->size += put_varint(&rec->data[rec->size], rec->run);
+    for(int i = 0; i < rec->dir_bytes; i++) {
+        rec->data[rec->size++] = (Uint8)(rec->dirs[i / 8] >> (i % 8 * 8));
+    }
+    for(int i = 0; i < REPLAY_HASH_BYTES; i++) {
+        rec->data[rec->size++] = (Uint8)(rec->hash >> (8 * i));
+    }
+    rec->run = 0;
+}
+
+void replay_record_begin(ReplayRecorder *rec, const AppState *as) {
+    ReplayHeader *header = &rec->header;
+    rec->size = 0;
+    rec->run = 0;
+    rec->failed = false;
+    header->width = as->board.width;
+    header->height = as->board.height;
+    header->players = as->total_human_players + as->total_computer_players;
+    header->humans = as->total_human_players;
+    header->seed = as->seed;
+    header->ticks = 0;
+    header->winner = header->players;
+    for(int i = 0; i < header->players; i++) {
+        header->ai[i] = as->character_ctx[i].ai;
+    }
+    rec->dir_bytes = (header->players + 3) / 4;
+    if(rec->timeline)
+        replay_timeline_clear(rec->timeline);
+}
+
+// Runs every tick, so it only packs the directions and compares them with the pending record
+void replay_record_tick(ReplayRecorder *rec, const AppState *as) {
+    Uint64 dirs[REPLAY_DIR_WORDS] = {0};
+    bool same = rec->run != 0;
+    for(int i = 0; i < rec->header.players; i++) {
+        dirs[i >> 5] |= (Uint64)(as->character_ctx[i].next_dir & 3) << ((i & 31) * 2);
+    }
+    for(int w = 0; w < REPLAY_DIR_WORDS; w++) {
+        same &= dirs[w] == rec->dirs[w];
+    }
+    rec->header.ticks++;
+    if(same) {
+        rec->run++;
+    } else {
+        flush_record(rec);
+        for(int w = 0; w < REPLAY_DIR_WORDS; w++) {
+            rec->dirs[w] = dirs[w];
+        }
+        rec->run = 1;
+    }
+    rec->hash = (Uint32)sim_hash(as);
+    // the pending record lands at rec->size once flushed
+    if(rec->timeline)
+        add_keyframe(rec->timeline, as, rec->size, rec->run);
+}
+
+void replay_record_end(ReplayRecorder *rec, const AppState *as) {
+    flush_record(rec);
+    rec->header.winner = replay_match_winner(as);
+}
+
+bool replay_save(const ReplayRecorder *rec, const char *path) {
+    const ReplayHeader *header = &rec->header;
+    if(rec->failed)
+        return SDL_SetError("out of memory while recording");
+    SDL_IOStream *io = SDL_IOFromFile(path, "wb");
+    if(!io)
+        return false;
+    bool ok = SDL_WriteIO(io, REPLAY_MAGIC, 4) == 4 &&
+              SDL_WriteU16LE(io, REPLAY_VERSION) &&
+              SDL_WriteU16LE(io, (Uint16)header->width) &&
+              SDL_WriteU16LE(io, (Uint16)header->height) &&
+              SDL_WriteU8(io, (Uint8)header->players) &&
+              SDL_WriteU8(io, (Uint8)header->humans) &&
+              SDL_WriteU64LE(io, header->seed) &&
+              SDL_WriteU64LE(io, header->ticks) &&
+              SDL_WriteU8(io, (Uint8)header->winner);
+    for(int i = 0; ok && i < header->players; i++) {
+        ok = SDL_WriteU8(io, (Uint8)header->ai[i]);
+    }
+    ok = ok && SDL_WriteIO(io, rec->data, rec->size) == rec->size;
+    return SDL_CloseIO(io) && ok;
+}
+
+// The timeline belongs to the caller
+void replay_record_free(ReplayRecorder *rec) {
+    SDL_free(rec->data);
+    SDL_zerop(rec);
+}
+
+// Map the file read only, or read it into memory where there is no mmap
+static bool load_file(Replay *replay, const char *path) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return SDL_SetError("%s", strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *file = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(file != MAP_FAILED) {
+            madvise(file, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            replay->file = (const Uint8 *)file;
+            replay->file_size = (size_t)st.st_size;
+            replay->mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    size_t size;
+    void *file = SDL_LoadFile(path, &size);
+    if(!file)
+        return false;
+    replay->file = (const Uint8 *)file;
+    replay->file_size = size;
+    replay->mapped = false;
+    return true;
+}
+
+static bool parse_header(Replay *replay) {
+    ReplayHeader *header = &replay->header;
+    SDL_IOStream *io = SDL_IOFromConstMem(replay->file, replay->file_size);
+    char magic[4];
+    Uint16 version = 0, width = 0, height = 0;
+    Uint8 players = 0, humans = 0, winner = 0;
+    if(!io)
+        return false;
+    bool ok = SDL_ReadIO(io, magic, 4) == 4 && SDL_memcmp(magic, REPLAY_MAGIC, 4) == 0 &&
+              SDL_ReadU16LE(io, &version) && SDL_ReadU16LE(io, &width) && SDL_ReadU16LE(io, &height) &&
+              SDL_ReadU8(io, &players) && SDL_ReadU8(io, &humans) &&
+              SDL_ReadU64LE(io, &header->seed) && SDL_ReadU64LE(io, &header->ticks) &&
+              SDL_ReadU8(io, &winner) &&
+              version >= 1 && version <= REPLAY_VERSION && players >= 1 && players <= MAX_PLAYERS && humans <= players &&
+              winner <= players;
+    for(int i = 0; ok && i < players; i++) {
+        Uint8 ai;
+        ok = SDL_ReadU8(io, &ai) && ai < AI_TYPE_COUNT;
+        header->ai[i] = (AiType)ai;
+    }
+    SDL_CloseIO(io);
+    if(!ok)
+        return SDL_SetError("not a version 1 to %d replay", REPLAY_VERSION);
+
+    header->width = width;
+    header->height = height;
+    header->players = players;
+    header->humans = humans;
+    header->winner = winner;
+    replay->records = REPLAY_FIXED_BYTES + (size_t)players;
+    replay->hashed = version >= 2;
+    return true;
+}
+
+bool replay_open(Replay *replay, const char *path) {
+    SDL_zerop(replay);
+    if(!load_file(replay, path))
+        return false;
+    if(!parse_header(replay)) {
+        replay_close(replay);
+        return false;
+    }
+    return true;
+}
+
+// The timeline belongs to the caller, a view's file to its recorder
+void replay_close(Replay *replay) {
+#ifndef _WIN32
+    if(replay->mapped)
+        munmap((void *)replay->file, replay->file_size);
+    else
+#endif
+    if(!replay->view)
+        SDL_free((void *)replay->file);
+    SDL_zerop(replay);
+}
+
+void replay_view_recording(Replay *view, ReplayRecorder *rec) {
+    flush_record(rec);
+    SDL_zerop(view);
+    view->header = rec->header;
+    view->timeline = rec->timeline;
+    view->file = rec->data;
+    view->file_size = rec->size;
+    view->view = true;
+    view->hashed = true;
+    // the view is at the end of what was recorded, the same tick as the match
+    view->tick = rec->header.ticks;
+    view->record = view->pos = rec->size;
+}
+
+bool replay_begin(Replay *replay, AppState *as) {
+    const ReplayHeader *header = &replay->header;
+    as->board_width = header->width;
+    as->board_height = header->height;
+    as->seed = header->seed;
+    as->scripted = true;
+    if(!sim_init_match(as, header->humans, header->players - header->humans))
+        return false;
+    for(int i = 0; i < header->players; i++) {
+        as->character_ctx[i].ai = header->ai[i];
+    }
+    replay->record = replay->pos = replay->records;
+    replay->run = replay->played = 0;
+    replay->tick = 0;
+    return true;
+}
+
+// Make the record at offset the current one, false if the file ends in the middle of it
+static bool load_record(Replay *replay, size_t offset) {
+    size_t dir_bytes = (size_t)(replay->header.players + 3) / 4;
+    size_t hash_bytes = replay->hashed ? REPLAY_HASH_BYTES : 0;
+    size_t pos = offset;
+    Uint64 run;
+    if(!get_varint(replay->file, replay->file_size, &pos, &run) || run == 0 ||
+       replay->file_size - pos < dir_bytes + hash_bytes)
+        return SDL_SetError("replay is cut short at tick %" SDL_PRIu64, replay->tick);
+    replay->record = offset;
+    replay->dirs = &replay->file[pos];
+    replay->hash = 0;
+    for(size_t i = 0; i < hash_bytes; i++) {
+        replay->hash |= (Uint32)replay->file[pos + dir_bytes + i] << (8 * i);
+    }
+    replay->pos = pos + dir_bytes + hash_bytes;
+    replay->run = run;
+    replay->played = 0;
+    return true;
+}
+
+bool replay_step(Replay *replay, AppState *as) {
+    if(replay->tick >= replay->header.ticks)
+        return false;
+    if(replay->played == replay->run && !load_record(replay, replay->pos))
+        return false;
+    for(int i = 0; i < replay->header.players; i++) {
+        sim_set_input(as, i, (CharacterDirection)((replay->dirs[i >> 2] >> ((i & 3) * 2)) & 3));
+    }
+    sim_step(as);
+    replay->played++;
+    replay->tick++;
+    if(replay->hashed && replay->played == replay->run && (Uint32)sim_hash(as) != replay->hash)
+        return SDL_SetError("the match went another way than recorded by tick %" SDL_PRIu64, replay->tick);
+    add_keyframe(replay->timeline, as, replay->record, replay->played);
+    return true;
+}
+
+// Put the match back the way it was at a keyframe
+static bool restore_keyframe(Replay *replay, AppState *as, const ReplayKeyframe *keyframe) {
+    const Uint8 *snapshot = &replay->timeline->snapshots[keyframe->offset];
+    size_t characters = (size_t)replay->header.players * sizeof(CharacterContext);
+    MatchFields fields;
+    SDL_memcpy(&fields, snapshot, sizeof(fields));
+    if(!board_unpack(&as->board, snapshot + sizeof(fields) + characters, keyframe->size - sizeof(fields) - characters))
+        return false;
+    SDL_memcpy(as->character_ctx, snapshot + sizeof(fields), characters);
+    as->tick = fields.tick;
+    as->rng = fields.rng;
+    as->state = fields.state;
+    as->remaining_players = fields.remaining_players;
+    as->winner = fields.winner;
+    as->hash = fields.hash;
+    as->analysis.valid = false;
+
+    replay->tick = keyframe->tick;
+    if(!load_record(replay, keyframe->record))
+        return false;
+    replay->played = keyframe->played;
+    return true;
+}
+
+bool replay_seek(Replay *replay, AppState *as, Uint64 tick) {
+    const ReplayKeyframe *keyframe = NULL;
+    tick = SDL_min(tick, replay->header.ticks);
+    // keyframes are contiguous, the one for tick k * REPLAY_KEYFRAME_TICKS is at k - 1
+    if(replay->timeline) {
+        Uint64 index = SDL_min(tick / REPLAY_KEYFRAME_TICKS, (Uint64)replay->timeline->count);
+        if(index > 0)
+            keyframe = &replay->timeline->keyframes[index - 1];
+    }
+
+    // playing on from where the replay is beats going back to the keyframe
+    Uint64 from = keyframe ? keyframe->tick : 0;
+    if(replay->tick < from || replay->tick > tick) {
+        if(keyframe ? !restore_keyframe(replay, as, keyframe) : !replay_begin(replay, as))
+            return false;
+    }
+    as->scripted = true;
+    while(replay->tick < tick) {
+        if(!replay_step(replay, as))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,137 @@
+/*
+  Match replays.
+
+  A match is fully decided by its seed (tron_sim.h) and the direction every player moved in on
+  every tick, so that is all a replay keeps. Computer players are recorded like humans, playing a
+  replay back never runs an AI and comes out the same no matter how much thinking time the match
+  had.
+
+  File layout, little endian:
+    "TRPL", Uint16 version, Uint16 width, Uint16 height, Uint8 players, Uint8 humans,
+    Uint64 seed, Uint64 ticks, Uint8 winner (players for a draw), players x Uint8 AiType
+  then records until ticks are covered:
+    varint run, (players + 3) / 4 bytes of directions, Uint32 hash
+  A record's directions (2 bits per player, player 0 in the low bits of the first byte) hold for
+  run ticks in a row. Players mostly go straight, so a 600 tick match with four players is a few
+  hundred bytes. Dead players keep their last direction and never break a run. The hash is the low
+  half of sim_hash once the record's last tick is played, playback checks it and stops with an
+  error on the first record that comes out different. Version 1 files have no hashes and play back
+  unchecked.
+
+  Recording:
+    replay_record_begin(&rec, as);     // after sim_init_match
+    sim_step(as);
+    replay_record_tick(&rec, as);      // after every step
+    replay_record_end(&rec, as);       // once the match is over
+    replay_save(&rec, path);
+    replay_record_free(&rec);
+
+  Playback maps the file (replay_open) and drives the simulation with it: replay_begin starts
+  the recorded match with as->scripted set, replay_step feeds one tick of inputs and steps.
+
+  Seeking: give a recorder or a replay a ReplayTimeline and it keeps a keyframe every
+  REPLAY_KEYFRAME_TICKS ticks while the match is played: the AppState's match fields, the
+  CharacterContext array and the board (board_pack), next to where the inputs of the following tick
+  are in the records. replay_seek restores the last keyframe at or before the target and plays the
+  rest of the ticks, so a seek costs at most REPLAY_KEYFRAME_TICKS steps however long the match is
+  (the first seek forward in a replay plays up to the target once). A match still being recorded is
+  seeked through replay_view_recording. Keyframes only live in memory, files stay inputs only.
+*/
+#ifndef TRON_REPLAY_H
+#define TRON_REPLAY_H
+
+#include "tron_sim.h"
+
+#define REPLAY_VERSION   2 // version 1 is still read
+#define REPLAY_DIR_WORDS (MAX_PLAYERS / 32) // Uint64s holding 2 bits per player
+#define REPLAY_KEYFRAME_TICKS 256
+
+typedef struct
+{
+    int width;
+    int height;
+    int players;
+    int humans;
+    Uint64 seed;
+    Uint64 ticks;
+    int winner; // player index, players for a draw
+    AiType ai[MAX_PLAYERS];
+} ReplayHeader;
+
+typedef struct
+{
+    Uint64 tick;
+    size_t record;  // offset of the record the keyframe's tick was played from
+    Uint64 played;  // ticks of that record played up to and including the keyframe's
+    size_t offset;  // snapshot in ReplayTimeline.snapshots
+    size_t size;
+} ReplayKeyframe;
+
+typedef struct
+{
+    ReplayKeyframe *keyframes; // by tick, every REPLAY_KEYFRAME_TICKS from the first on
+    int count;
+    int capacity;
+    Uint8 *snapshots;
+    size_t size;
+    size_t capacity_bytes;
+} ReplayTimeline;
+
+typedef struct
+{
+    ReplayHeader header;
+    ReplayTimeline *timeline; // NULL for no keyframes, set by the caller
+    int dir_bytes;
+    Uint64 dirs[REPLAY_DIR_WORDS]; // directions of the record being extended, player i at bit 2 * i
+    Uint64 run;                   // ticks the pending record covers so far, 0 before the first tick
+    Uint32 hash;                  // of the match after the pending record's last tick
+    Uint8 *data;                  // finished records
+    size_t size;
+    size_t capacity;
+    bool failed; // out of memory, replay_save refuses
+} ReplayRecorder;
+
+typedef struct
+{
+    ReplayHeader header;
+    ReplayTimeline *timeline; // NULL for no keyframes, set by the caller
+    const Uint8 *file; // the whole file, mapped
+    size_t file_size;
+    bool mapped;       // false when the file was read into memory instead
+    bool view;         // file belongs to a recorder (replay_view_recording)
+    size_t records;    // offset of the first record
+    bool hashed;       // the records end with a hash, version 2 on
+    size_t record;     // offset of the current record
+    size_t pos;        // offset of the next record
+    const Uint8 *dirs; // directions of the current record
+    Uint64 run;        // ticks the current record covers
+    Uint32 hash;       // of the match after the current record's last tick
+    Uint64 played;     // of which were played
+    Uint64 tick;       // ticks played back so far
+} Replay;
+
+// Index of the last player standing, players when nobody is
+int replay_match_winner(const AppState *as);
+
+void replay_record_begin(ReplayRecorder *rec, const AppState *as);
+void replay_record_tick(ReplayRecorder *rec, const AppState *as);
+void replay_record_end(ReplayRecorder *rec, const AppState *as);
+bool replay_save(const ReplayRecorder *rec, const char *path);
+void replay_record_free(ReplayRecorder *rec);
+
+// Functions returning bool set SDL_GetError on failure
+bool replay_open(Replay *replay, const char *path);
+void replay_close(Replay *replay);
+bool replay_begin(Replay *replay, AppState *as);
+// Plays the next recorded tick. False after the last one, and with SDL_GetError set when the file is damaged
+bool replay_step(Replay *replay, AppState *as);
+// Bring as to the given tick of the replay's match (clamped to its length), as must hold that match
+bool replay_seek(Replay *replay, AppState *as, Uint64 tick);
+// Look at what rec recorded so far as a replay, sharing rec's data and timeline. Redo it after more
+// ticks were recorded. Closing the view leaves rec alone
+void replay_view_recording(Replay *view, ReplayRecorder *rec);
+
+void replay_timeline_clear(ReplayTimeline *timeline);
+void replay_timeline_free(ReplayTimeline *timeline);
+
+#endif // TRON_REPLAY_H
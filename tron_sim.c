@@ -0,0 +1,501 @@
+// Game rules and match progression. See tron_sim.h
+#include "tron_sim.h"
+#include "tron_ai.h"
+
+// The classic starting layout, as fractions of the arena, used when there are at most four players
+static const struct
+{
+    int x_quarters;
+    int y_quarters;
+    CharacterDirection dir;
+} CLASSIC_STARTS[4] = {
+    {1, 2, DIR_RIGHT}, // Player 1
+    {3, 2, DIR_LEFT},  // Player 2
+    {1, 1, DIR_UP},    // Player 3
+    {3, 1, DIR_DOWN},  // Player 4
+};
+
+// Where player number index (of players) starts and which way they head, see tron_sim.h
+void starting_position(const Board *board, int index, int players, int *x, int *y, CharacterDirection *dir) {
+    if(players <= 4) {
+        *x = CLASSIC_STARTS[index].x_quarters * board->width / 4;
+        *y = CLASSIC_STARTS[index].y_quarters * board->height / 4;
+        *dir = CLASSIC_STARTS[index].dir;
+        return;
+    }
+
+    // evenly spaced on an ellipse, y grows downwards so the angle goes counter-clockwise on screen
+    double angle = 2.0 * SDL_PI_D * index / players;
+    double dx = SDL_cos(angle);
+    double dy = -SDL_sin(angle);
+    *x = SDL_clamp((int)SDL_lround(board->width / 2.0 + dx * board->width * 3.0 / 8.0), 0, board->width - 1);
+    *y = SDL_clamp((int)SDL_lround(board->height / 2.0 + dy * board->height * 3.0 / 8.0), 0, board->height - 1);
+    // along the tangent (dy, -dx), whichever axis it leans on more
+    if(SDL_fabs(dy) >= SDL_fabs(dx))
+        *dir = dy < 0 ? DIR_LEFT : DIR_RIGHT;
+    else
+        *dir = dx > 0 ? DIR_UP : DIR_DOWN;
+}
+
+// Spread the bits of the match seed so nearby seeds (0, 1, 2...) give unrelated matches, splitmix64's finalizer
+static Uint64 mix_seed(Uint64 seed) {
+    seed += 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    return seed ^ (seed >> 31);
+}
+
+// What a Zobrist key stands for, see AppState.hash
+typedef enum
+{
+    ZOBRIST_CELL = 1U, // a cell holding something: its index and content
+    ZOBRIST_HEAD,      // where a player's head is
+    ZOBRIST_DEAD,      // a player that crashed
+    ZOBRIST_STAR,      // the tick a player last picked up a star
+    ZOBRIST_CLOCK      // the tick and the item RNG, folded in by sim_hash
+} ZobristKind;
+
+// The key of one piece of the match, mixed from what it stands for rather than drawn into tables,
+// which would have to be sized for the biggest arena
+static inline Uint64 zobrist(ZobristKind kind, int player, Uint64 value) {
+    return mix_seed((Uint64)kind << 58 ^ (Uint64)player << 48 ^ value);
+}
+
+static inline Uint64 zobrist_cell(int index, Uint8 cell) {
+    return cell == CELL_NOTHING ? 0 : zobrist(ZOBRIST_CELL, 0, (Uint64)index << 7 | cell);
+}
+
+static inline Uint64 zobrist_head(const Board *board, const CharacterContext *ctx) {
+    return zobrist(ZOBRIST_HEAD, ctx->player_id, (Uint64)board_index(board, ctx->head_xpos, ctx->head_ypos));
+}
+
+// board_set that keeps the hash
+void sim_set_cell(AppState *as, int x, int y, Cell cell) {
+    int index = board_index(&as->board, x, y);
+    as->hash ^= zobrist_cell(index, as->board.cells[index]) ^ zobrist_cell(index, (Uint8)cell);
+    board_set(&as->board, x, y, cell);
+}
+
+// move_head that keeps the hash
+void sim_move_head(AppState *as, CharacterContext *ctx) {
+    as->hash ^= zobrist_head(&as->board, ctx);
+    move_head(ctx);
+    as->hash ^= zobrist_head(&as->board, ctx);
+}
+
+Uint64 sim_hash(const AppState *as) {
+    return as->hash ^ zobrist(ZOBRIST_CLOCK, 0, as->tick) ^ mix_seed(as->rng);
+}
+
+Uint64 sim_compute_hash(const AppState *as) {
+    const Board *board = &as->board;
+    Uint64 hash = 0;
+    for(int y = 0; y < board->height; y++) {
+        for(int x = 0; x < board->width; x++) {
+            int index = board_index(board, x, y);
+            hash ^= zobrist_cell(index, board->cells[index]);
+        }
+    }
+    for(int i = 0; i < as->total_human_players + as->total_computer_players; i++) {
+        const CharacterContext *ctx = &as->character_ctx[i];
+        hash ^= zobrist_head(board, ctx);
+        if((board->dead_players >> i) & 1)
+            hash ^= zobrist(ZOBRIST_DEAD, ctx->player_id, 0);
+        if(ctx->invinsible_tick)
+            hash ^= zobrist(ZOBRIST_STAR, ctx->player_id, ctx->invinsible_tick);
+    }
+    return hash;
+}
+
+// sets winner as the last one standing, -1 when nobody is
+void set_winner(void *appstate) {
+    AppState *as = (AppState *)appstate;
+    int total_players = as->total_human_players + as->total_computer_players;
+    as->winner = -1;
+    for(int i = 0; i < total_players; i++) {
+        if(as->character_ctx[i].is_alive) {
+            as->winner = i;
+        }
+    }
+}
+
+// Spawns an item in a randon unoccupied space, returns false if there is no space left
+bool spawn_item(void *appstate) {
+    AppState *as = (AppState *)appstate;
+    int x_coord;
+    int y_coord;
+    if(!board_random_free_cell(&as->board, &as->rng, &x_coord, &y_coord))
+        return false;
+    sim_set_cell(as, x_coord, y_coord, CELL_ITEM_STAR + SDL_rand_r(&as->rng, 1));
+    return true;
+}
+
+// Moves player forward one unit in a particular direction
+void move_head(CharacterContext *ctx) {
+    // Move head forward
+    switch (ctx->next_dir) {
+        case DIR_RIGHT:
+            ctx->head_xpos++;
+            break;
+        case DIR_UP:
+            ctx->head_ypos--;
+            break;
+        case DIR_LEFT:
+            ctx->head_xpos--;
+            break;
+        case DIR_DOWN:
+            ctx->head_ypos++;
+            break;
+        default:
+            break;
+    }
+}
+
+void handle_collision(void *appstate, int player_id) {
+    AppState *as = (AppState *)appstate;
+
+    // player ids are handed out in order starting at 1
+    int index = player_id - 1;
+    as->character_ctx[index].is_alive = false;
+    as->remaining_players--; 
+    as->hash ^= zobrist(ZOBRIST_DEAD, player_id, 0);
+
+    board_kill_player(&as->board, CELL_PLAYER(index));
+
+    as->events |= SIM_EVENT_CRASH;
+}
+
+// Handle any special events
+void on_player_touch(void *appstate, CharacterContext *ctx, Cell cell) {
+    AppState *as = (AppState *)appstate;
+    switch(cell) {
+        case CELL_NOTHING:
+            break;
+        case CELL_DEAD:
+            break;
+        case CELL_ITEM_STAR:
+            sim_set_cell(as, ctx->head_xpos, ctx->head_ypos, CELL_PLAYER(ctx->player_id - 1)); //replace star with player block
+            ctx->is_invinsible = true;
+            if(ctx->invinsible_tick)
+                as->hash ^= zobrist(ZOBRIST_STAR, ctx->player_id, ctx->invinsible_tick);
+            ctx->invinsible_tick = as->tick;
+            as->hash ^= zobrist(ZOBRIST_STAR, ctx->player_id, ctx->invinsible_tick);
+            as->events |= SIM_EVENT_STAR;
+            break;
+        default:
+            // running over a tail with star power
+            if(!cell_is_player(cell))
+                SDL_Log("ERROR - unexpected cell: %d\n", cell);
+    }
+}
+
+// Checks what direction player has inputed, updates position and checks for collision
+void move_player(CharacterContext *ctx, void *appstate) {
+    AppState *as = (AppState *)appstate;
+    
+    if (collides_with_wall(&as->board, ctx->head_xpos, ctx->head_ypos)) {
+        SDL_Log("ERROR - The player: %d moved out of bounds at an unexpected time \n", ctx->player_id);
+    }
+
+    // the next turn the player asked for, or if player is a computer, determine which direction go
+    if(ctx->queued_count) {
+        ctx->next_dir = ctx->queued_dirs[ctx->queued_first];
+        ctx->queued_first = (ctx->queued_first + 1) & (INPUT_QUEUE_SIZE - 1);
+        ctx->queued_count--;
+    } else if(!ctx->is_human && !as->scripted) {
+        ctx->next_dir = ai_pick_dir(as, ctx);
+    }
+
+    sim_move_head(as, ctx);
+
+    // check if the player crashed - when player has star power they can only crash with wall
+    bool crashed = false;
+    if(ctx->is_invinsible) {
+        crashed = collides_with_wall(&as->board, ctx->head_xpos, ctx->head_ypos);
+    } else {
+        crashed = is_collision(&as->board,ctx->head_xpos, ctx->head_ypos);
+    }
+
+    if(crashed) {
+        handle_collision(as, ctx->player_id);
+    } else {
+        // update player position on the board and handle any special cases such as items
+        Cell new_cell = board_get(&as->board, ctx->head_xpos, ctx->head_ypos);
+        sim_set_cell(as, ctx->head_xpos, ctx->head_ypos, CELL_PLAYER(ctx->player_id - 1));
+        on_player_touch(as, ctx, new_cell);
+    }
+}
+
+// star picked up at tick 100
+// now tick 150
+// 150 - 100 = 50 steps, the star lasts STAR_TIME_IN_STEPS
+// update the player status such as invulnerable
+void handle_invinsible(CharacterContext *ctx, Uint64 tick){
+    if(ctx->is_invinsible == true) {
+        if(tick - ctx->invinsible_tick > STAR_TIME_IN_STEPS) {
+            ctx->is_invinsible = false;
+        }
+    }
+}
+
+// Update the positions of all players in the game if they are still alive
+void move_characters(void *appstate) {
+    AppState *as = (AppState *)appstate;
+    CharacterContext *ctx;
+    int total_players = as->total_human_players + as->total_computer_players;
+
+    // all computer players share the thinking time for this step
+    if(!as->scripted) {
+        as->ai_deadline_ns = SDL_GetTicksNS() + as->ai_budget_ns;
+        ai_begin_step(as);
+    }
+
+    for(int i = 0; i < total_players; i++) {
+        ctx = &as->character_ctx[i];
+        if(ctx->is_alive) {
+            handle_invinsible(ctx, as->tick); //check invinsible status, and update if it should end
+            move_player(ctx, as); // update player position
+        }
+    }
+}
+
+// Create required amount of characters, determine their starting positions, directions and attributes
+void initialize_characters(void *appstate) {
+    AppState *as = (AppState *)appstate;
+    int humans_added = 0;
+    int computers_added = 0;
+    int total_players = as->total_human_players + as->total_computer_players;
+    for(int i = 0; i < total_players; i++) {
+
+        // Add the character and set is_human, the humans come first (sim_player_name)
+        if(humans_added < as->total_human_players) {
+            as->character_ctx[i].is_human = true;
+            humans_added++;
+        } else {
+            as->character_ctx[i].is_human = false;
+            as->character_ctx[i].ai = as->cpu_ai;
+            computers_added++;
+        }
+
+        // alive enabled
+        as->character_ctx[i].is_alive = true;
+
+        // Set starting position and direction, the spot may already be taken when the arena is crowded
+        int x, y;
+        CharacterDirection dir;
+        starting_position(&as->board, i, total_players, &x, &y, &dir);
+        for(int n = 0; board_get(&as->board, x, y) != CELL_NOTHING && n < as->board.width * as->board.height; n++) {
+            x = (x + 1) % as->board.width;
+            if(x == 0)
+                y = (y + 1) % as->board.height;
+        }
+        as->character_ctx[i].head_xpos = x;
+        as->character_ctx[i].head_ypos = y;
+        as->character_ctx[i].next_dir = dir;
+        as->character_ctx[i].queued_first = 0;
+        as->character_ctx[i].queued_count = 0;
+
+        // Set player IDs
+        as->character_ctx[i].player_id = computers_added + humans_added;
+        
+        // players can use items to be come temporarirly invsible
+        as->character_ctx[i].is_invinsible = false;
+        as->character_ctx[i].invinsible_tick = 0;
+
+        // mark the first spot on game board
+        sim_set_cell(as, x, y, CELL_PLAYER(i));
+        as->hash ^= zobrist_head(&as->board, &as->character_ctx[i]);
+    }
+}
+
+// Reset the board and characters for a new match and start it running. Returns false when the
+// arena or player count is out of range (or there is no memory for the board)
+bool sim_init_match(AppState *as, int human_players, int computer_players) {
+    int width = as->board_width > 0 ? as->board_width : TRON_DEFAULT_WIDTH;
+    int height = as->board_height > 0 ? as->board_height : TRON_DEFAULT_HEIGHT;
+    int players = human_players + computer_players;
+    if(human_players < 0 || computer_players < 0 || players < 1 || players > MAX_PLAYERS)
+        return SDL_SetError("%d players out of range, at most %d", players, MAX_PLAYERS);
+    if(!board_init(&as->board, width, height, players))
+        return false;
+    as->analysis.valid = false;
+    as->state = RUNNING;
+    as->tick = 0;
+    as->rng = mix_seed(as->seed);
+    as->events = SIM_EVENT_NONE;
+    as->total_human_players = human_players;
+    as->total_computer_players = computer_players;
+    as->remaining_players = as->total_human_players + as->total_computer_players;
+    as->winner = -1;
+    as->hash = 0;
+    if(as->ai_budget_ns == 0)
+        as->ai_budget_ns = AI_TICK_BUDGET_NS;
+
+    initialize_characters(as);
+    return true;
+}
+
+// Request a new direction for a human player (any player when scripted, see below). Turns are queued
+// and taken one per step, so two quick presses turn on two steps in a row instead of the second one
+// replacing the first. A turn is checked against the direction the player will be heading by then:
+// players can't reverse into their own tail, and going the way they already go, or a full queue,
+// drops the input. Returns whether the direction will be taken
+bool sim_set_input(AppState *as, int player_index, CharacterDirection dir) {
+    CharacterContext *ctx;
+    CharacterDirection heading;
+    int players = as->scripted ? as->total_human_players + as->total_computer_players : as->total_human_players;
+    if(as->state != RUNNING || player_index < 0 || player_index >= players)
+        return false;
+
+    ctx = &as->character_ctx[player_index];
+    if(as->scripted) {
+        // a replay gives the direction of every tick, as it was taken when the match was recorded
+        sim_set_direction(as, player_index, dir);
+        return true;
+    }
+    if(!ctx->is_alive)
+        return false;
+    heading = (CharacterDirection)ctx->next_dir;
+    if(ctx->queued_count)
+        heading = (CharacterDirection)ctx->queued_dirs[(ctx->queued_first + ctx->queued_count - 1) & (INPUT_QUEUE_SIZE - 1)];
+    if(dir == heading || is_reverse(heading, dir) || ctx->queued_count == INPUT_QUEUE_SIZE)
+        return false;
+    ctx->queued_dirs[(ctx->queued_first + ctx->queued_count) & (INPUT_QUEUE_SIZE - 1)] = (char)dir;
+    ctx->queued_count++;
+    return true;
+}
+
+// Turn a player right away, skipping the queue and its checks. Netplay agrees on the directions of
+// every tick before stepping it (tron_net.h)
+void sim_set_direction(AppState *as, int player_index, CharacterDirection dir) {
+    CharacterContext *ctx = &as->character_ctx[player_index];
+    ctx->queued_count = 0;
+    ctx->next_dir = (char)dir;
+}
+
+// Advance the match by a single tick, spawn the tick's item and set the winner when one player remaining
+void sim_step(AppState *as) {
+    if(as->state != RUNNING)
+        return;
+
+    move_characters(as);
+    as->tick++;
+    if(as->tick % ITEM_RATE_IN_STEPS == 0) {
+        spawn_item(as);
+    }
+    if(as->remaining_players <= 1) {
+        as->state = GAME_OVER;
+        set_winner(as);
+    }
+}
+
+bool sim_is_over(const AppState *as) {
+    return as->state == GAME_OVER;
+}
+
+// Release what the matches allocated, the AppState itself belongs to the caller
+void sim_free(AppState *as) {
+    board_free(&as->board);
+    analysis_free(&as->analysis);
+}
+
+const char *sim_player_name(const AppState *as, int player_index, char name[PLAYER_NAME_SIZE]) {
+    if(player_index < as->total_human_players)
+        SDL_snprintf(name, PLAYER_NAME_SIZE, "P%d", player_index + 1);
+    else
+        SDL_snprintf(name, PLAYER_NAME_SIZE, "CPU%d", player_index - as->total_human_players + 1);
+    return name;
+}
+
+bool sim_snapshot_init(SimSnapshot *snapshot, const AppState *as) {
+    int players = as->total_human_players + as->total_computer_players;
+    size_t size = players * sizeof(CharacterContext) + as->board.storage_size;
+    if(snapshot->size != size) {
+        Uint8 *data = (Uint8 *)SDL_realloc(snapshot->data, size);
+        if(!data)
+            return false;
+        snapshot->data = data;
+        snapshot->size = size;
+    }
+    snapshot->board_size = as->board.storage_size;
+    snapshot->match.tick = SDL_MAX_UINT64;
+    snapshot->match.players = players;
+    return true;
+}
+
+void sim_snapshot_free(SimSnapshot *snapshot) {
+    SDL_free(snapshot->data);
+    SDL_zerop(snapshot);
+}
+
+void sim_snapshot(const AppState *as, SimSnapshot *snapshot) {
+    MatchState *match = &snapshot->match;
+    size_t characters = snapshot->size - snapshot->board_size;
+    SDL_assert(snapshot->board_size == as->board.storage_size &&
+               match->players == as->total_human_players + as->total_computer_players);
+    match->tick = as->tick;
+    match->rng = as->rng;
+    match->dead_players = as->board.dead_players;
+    match->state = as->state;
+    match->remaining_players = as->remaining_players;
+    match->winner = as->winner;
+    match->free_count = as->board.free_count;
+    match->hash = as->hash;
+    SDL_memcpy(snapshot->data, as->character_ctx, characters);
+    SDL_memcpy(snapshot->data + characters, as->board.storage, snapshot->board_size);
+}
+
+void sim_restore(AppState *as, const SimSnapshot *snapshot) {
+    const MatchState *match = &snapshot->match;
+    size_t characters = snapshot->size - snapshot->board_size;
+    SDL_assert(snapshot->board_size == as->board.storage_size && match->tick != SDL_MAX_UINT64 &&
+               match->players == as->total_human_players + as->total_computer_players);
+    as->tick = match->tick;
+    as->rng = match->rng;
+    as->board.dead_players = match->dead_players;
+    as->state = match->state;
+    as->remaining_players = match->remaining_players;
+    as->winner = match->winner;
+    as->board.free_count = match->free_count;
+    as->hash = match->hash;
+    SDL_memcpy(as->character_ctx, snapshot->data, characters);
+    SDL_memcpy(as->board.storage, snapshot->data + characters, snapshot->board_size);
+    as->analysis.valid = false; // the computer players' analysis was of another tick
+}
+
+bool sim_dump(const AppState *as, SDL_IOStream *io) {
+    // a character per player in the arena, the same as in front of the player's line
+    static const char PLAYER_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz+@";
+    static const char *STATE_NAMES[] = {"START", "RUNNING", "PAUSED", "GAME_OVER"};
+    static const char *DIR_NAMES[] = {"right", "up", "left", "down"};
+    const Board *board = &as->board;
+    char name[PLAYER_NAME_SIZE];
+    bool ok = SDL_IOprintf(io, "tick %" SDL_PRIu64 ", %s, %d of %d players left, hash %016" SDL_PRIx64
+                               " (running %016" SDL_PRIx64 ", recomputed %016" SDL_PRIx64 "), rng %016" SDL_PRIx64 "\n",
+                           as->tick, STATE_NAMES[as->state & 3], as->remaining_players,
+                           as->total_human_players + as->total_computer_players, sim_hash(as), as->hash,
+                           sim_compute_hash(as), as->rng) > 0;
+    for(int i = 0; ok && i < as->total_human_players + as->total_computer_players; i++) {
+        const CharacterContext *ctx = &as->character_ctx[i];
+        ok = SDL_IOprintf(io, "%c %-5s at (%d,%d) heading %s, %s", PLAYER_CHARS[i], sim_player_name(as, i, name),
+                          ctx->head_xpos, ctx->head_ypos, DIR_NAMES[ctx->next_dir & 3],
+                          ctx->is_alive ? "alive" : "crashed") > 0;
+        if(ok && ctx->invinsible_tick)
+            ok = SDL_IOprintf(io, ", star picked up at tick %" SDL_PRIu64 "%s", ctx->invinsible_tick,
+                              ctx->is_invinsible ? " (still on)" : "") > 0;
+        ok = ok && SDL_IOprintf(io, "\n") > 0;
+    }
+    for(int y = 0; ok && y < board->height; y++) {
+        char row[BOARD_MAX_SIZE + 2];
+        for(int x = 0; x < board->width; x++) {
+            Uint8 cell = board->cells[board_index(board, x, y)];
+            if(cell_is_player(cell))
+                row[x] = PLAYER_CHARS[(cell - CELL_P1) & 63];
+            else
+                row[x] = cell == CELL_ITEM_STAR ? '*' : cell == CELL_ITEM_BOMB ? 'o' : '.';
+        }
+        row[board->width] = '\n';
+        ok = SDL_WriteIO(io, row, (size_t)board->width + 1) == (size_t)board->width + 1;
+    }
+    return ok;
+}
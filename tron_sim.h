@@ -0,0 +1,230 @@
+/*
+  Headless simulation core for tron.
+
+  Everything needed to play a match lives here: the game board, the characters, movement,
+  collisions, items and the computer players. Nothing in here touches the SDL video or audio
+  subsystems, so a match can be stepped without a window, renderer or audio device. The windowed
+  game (tron.c) and the headless tools both drive the same functions.
+
+  The arena is as->board_width x as->board_height (0 for the 60x40 default) and the number of
+  players is whatever the match is started with, up to MAX_PLAYERS. Starting positions are
+  generated for any count: up to four players get the classic layout, more are spread around an
+  ellipse in the middle of the arena heading counter-clockwise.
+
+  Game time is as->tick, the number of steps played. Star power and item spawns count ticks and
+  never look at the clock, and every random pick (items) draws from as->rng, which sim_init_match
+  seeds from as->seed. The same seed, inputs and computer players replay the same match bit for
+  bit however fast or slow it is stepped: the front end decides when to step, the headless tools
+  step as fast as they can. The one exception is thinking time: a computer player that runs out of
+  its share of AppState.ai_budget_ns falls back to AI_STRAIGHT (tron_ai.h), so search and MCTS
+  matches, which always use their whole budget, depend on the machine.
+
+  Human input is queued per player (sim_set_input) and every step takes at most one turn from the
+  queue, so a burst of key presses plays out over the next few ticks. Scripted matches (replays)
+  set each tick's direction directly.
+
+  Rollback (tron_net.h) and anything else that has to go back in time saves the match with
+  sim_snapshot and puts it back with sim_restore. A SimSnapshot is plain data: the MatchState (the
+  few AppState fields a match changes, none of the SDL handles or settings), the characters in use
+  and a copy of the board's storage, a few memcpys into a block allocated once (sim_snapshot_init).
+  Nothing has to be rebuilt on restore, the board's free cells and free runs (or bitboard masks)
+  are in the copy. On the default arena that's under 24KB and tron_bench's snapshot benchmarks take
+  well under a microsecond.
+
+  Two copies of a match that should be the same (netplay peers, a replay and the match it recorded)
+  are compared with sim_hash, a 64-bit Zobrist hash of the cells, the heads, the crashed players
+  and the star pickups, folded with the tick and the item RNG. The rules keep AppState.hash up to
+  date as they change the match (move_player, handle_collision, spawn_item, on_player_touch), every
+  change is an XOR or two so the hash is there for free on every tick. Code that changes the match
+  by other means goes through sim_set_cell and sim_move_head, or starts over with sim_compute_hash,
+  which is also what --verify checks the running hash against. sim_dump writes a match out as text
+  for comparing two that disagree.
+
+  Typical usage:
+    if(!sim_init_match(as, human_players, computer_players))
+        return; // SDL_GetError() says why
+    while(!sim_is_over(as)) {
+        sim_set_input(as, 0, DIR_UP); // optional, only affects human players
+        sim_step(as);
+    }
+    sim_free(as); // once the AppState isn't needed anymore
+*/
+#ifndef TRON_SIM_H
+#define TRON_SIM_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include "tron_board.h"
+#include "tron_analysis.h"
+
+#define STEP_RATE_IN_MILLISECONDS 60
+#define STEP_RATE_IN_NS           (STEP_RATE_IN_MILLISECONDS * SDL_NS_PER_MS)
+#define ITEM_RATE_IN_MILLISECONDS 3000
+#define STAR_TIME                 5000
+#define ITEM_RATE_IN_STEPS        (ITEM_RATE_IN_MILLISECONDS / STEP_RATE_IN_MILLISECONDS) // an item spawns every this many ticks
+#define STAR_TIME_IN_STEPS        (STAR_TIME / STEP_RATE_IN_MILLISECONDS)
+#define AI_TICK_BUDGET_NS         (STEP_RATE_IN_MILLISECONDS * SDL_NS_PER_MS / 2) // time all computer players may think per step
+#define INPUT_QUEUE_SIZE          4 // turns a player can have waiting, a power of two
+
+// possible states the game can be in
+typedef enum
+{
+    START = 0U,
+    RUNNING = 1U,
+    PAUSED = 2U,
+    GAME_OVER = 3U
+} State;
+
+// possible effects that a character or game may posses that changes game logic or visuals
+typedef enum
+{
+    NONE       = 0U,
+    INVINSIBLE = 1U
+} Effect;
+
+typedef enum
+{
+    STAR = 0U,
+    BOMB = 1U
+} Item;
+
+// Possible Game Modes
+typedef enum
+{
+    PVP = 0U,
+    PVE = 1U,
+} GameMode;
+
+// How a computer player picks its next direction
+typedef enum
+{
+    AI_STRAIGHT = 0U, // longest straight line
+    AI_VORONOI  = 1U, // most territory reached first
+    AI_SEARCH   = 2U, // alpha-beta search against the nearest opponent
+    AI_MCTS     = 3U, // parallel Monte Carlo tree search against the nearest opponent
+    AI_TYPE_COUNT
+} AiType;
+
+// Things that happened during a step that the front end may want to react to (sounds, effects).
+// The simulation only raises these flags, whoever drives it is responsible for clearing them.
+typedef enum
+{
+    SIM_EVENT_NONE  = 0U,
+    SIM_EVENT_CRASH = 1U << 0,
+    SIM_EVENT_STAR  = 1U << 1
+} SimEvent;
+
+// represents where the players car head is currently located, and its next direction
+typedef struct
+{
+    int head_xpos;
+    int head_ypos;
+    char next_dir;
+    char queued_dirs[INPUT_QUEUE_SIZE]; // turns asked for with sim_set_input, one is taken per tick
+    Uint8 queued_first;                 // oldest of them
+    Uint8 queued_count;
+    int player_id;
+    bool is_human;
+    AiType ai;
+    bool is_alive;
+    bool is_invinsible;
+    Uint64 invinsible_tick; // AppState.tick when the star was picked up
+} CharacterContext;
+
+// contains game specific data
+typedef struct
+{
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    CharacterContext character_ctx[MAX_PLAYERS];
+    Board board;
+    int board_width;  // arena for the next match, 0 picks TRON_DEFAULT_WIDTH
+    int board_height; // 0 picks TRON_DEFAULT_HEIGHT
+    State state;
+    GameMode game_mode;
+    int total_human_players;
+    int total_computer_players;
+    int remaining_players;
+    int winner; // index of the last one standing once the match is over, -1 for a draw
+    Uint64 pause_time; // SDL_GetTicksNS() when the game was paused
+    bool is_muted;
+    Uint64 last_step;  // SDL_GetTicksNS() the last step was due at, the next one is due STEP_RATE_IN_NS later
+    Uint64 seed; // seed of the next match, everything random in it comes from this
+    Uint64 rng;  // SDL_rand_r state of the running match
+    Uint64 tick; // steps played in the running match, all game timing counts these
+    bool scripted; // every player takes sim_set_input and computer players don't think, for replays
+    Uint32 events; // SimEvent flags raised since the front end last cleared them
+    AiType cpu_ai;          // strategy given to computer players when a match starts
+    Uint64 ai_budget_ns;    // how long all computer players together may think per step, 0 picks AI_TICK_BUDGET_NS
+    Uint64 ai_deadline_ns;  // SDL_GetTicksNS() by which the current step's computer players have to decide
+    BoardAnalysis analysis; // shared by the computer players, redone every step (ai_begin_step)
+    Uint64 hash;            // Zobrist hash of the match minus the clock, see sim_hash
+} AppState;
+
+// What a match changes as it plays besides the characters and the board's arrays, see SimSnapshot
+typedef struct
+{
+    Uint64 tick;
+    Uint64 rng;
+    Uint64 dead_players; // the board's
+    State state;
+    int remaining_players;
+    int winner;
+    int free_count;      // the board's
+    int players;         // characters saved
+    Uint64 hash;
+} MatchState;
+
+// A saved match: MatchState, then players CharacterContexts and the board's storage in data
+typedef struct
+{
+    MatchState match;
+    Uint8 *data;
+    size_t size;
+    size_t board_size;
+} SimSnapshot;
+
+#define PLAYER_NAME_SIZE 8
+
+// Simulation API
+bool sim_init_match(AppState *as, int human_players, int computer_players);
+bool sim_set_input(AppState *as, int player_index, CharacterDirection dir);
+void sim_set_direction(AppState *as, int player_index, CharacterDirection dir);
+void sim_step(AppState *as);
+bool sim_is_over(const AppState *as);
+void sim_free(AppState *as);
+// "P1", "P2"... for the humans and "CPU1", "CPU2"... for the computer players, written to name
+const char *sim_player_name(const AppState *as, int player_index, char name[PLAYER_NAME_SIZE]);
+
+// Size snapshot for the running match's arena and players, nothing is saved yet (match.tick is
+// SDL_MAX_UINT64). Returns false when out of memory
+bool sim_snapshot_init(SimSnapshot *snapshot, const AppState *as);
+void sim_snapshot_free(SimSnapshot *snapshot);
+// Save the running match, snapshot has to be sized for it
+void sim_snapshot(const AppState *as, SimSnapshot *snapshot);
+// Put the match saved in snapshot back, as has to be playing the same arena and players
+void sim_restore(AppState *as, const SimSnapshot *snapshot);
+
+// Hash of the match at its tick, equal on two AppStates playing the same match the same way
+Uint64 sim_hash(const AppState *as);
+// AppState.hash from scratch, walking the whole board
+Uint64 sim_compute_hash(const AppState *as);
+// board_set and move_head that keep AppState.hash
+void sim_set_cell(AppState *as, int x, int y, Cell cell);
+void sim_move_head(AppState *as, CharacterContext *ctx);
+// The match as text: the players, then the arena a row a line. False when io failed
+bool sim_dump(const AppState *as, SDL_IOStream *io);
+
+// Game logic, also used directly by the front end
+void set_winner(void *appstate);
+bool spawn_item(void *appstate);
+void move_head(CharacterContext *ctx);
+void handle_collision(void *appstate, int player_id);
+void on_player_touch(void *appstate, CharacterContext *ctx, Cell cell);
+void move_player(CharacterContext *ctx, void *appstate);
+void handle_invinsible(CharacterContext *ctx, Uint64 tick);
+void move_characters(void *appstate);
+void initialize_characters(void *appstate);
+void starting_position(const Board *board, int index, int players, int *x, int *y, CharacterDirection *dir);
+
+#endif // TRON_SIM_H
@@ -0,0 +1,660 @@
+// Spectator streams over TCP. See tron_spectate.h
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "tron_spectate.h"
+#include "tron_bits.h"
+
+#define SPECTATE_MAGIC       "TRSP"
+#define SPECTATE_VERSION     1
+#define SPECTATE_GREETING    5  // magic and version, ahead of everything a spectator gets
+#define SPECTATE_MAX_CHANGES 64 // cells a tick carries besides the heads, past that a keyframe is cheaper
+#define SPECTATE_TICK_BYTES  512
+#define CELL_BITS            7  // CELL_PLAYER(MAX_PLAYERS - 1) fits
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL // a spectator that went away is an error, not a SIGPIPE
+#else
+#define SEND_FLAGS 0
+#endif
+
+typedef enum
+{
+    SPECTATE_KEYFRAME = 1U,
+    SPECTATE_TICK
+} FrameType;
+
+static void close_socket(Sint64 fd) {
+#ifdef _WIN32
+    closesocket((SOCKET)fd);
+#else
+    close((int)fd);
+#endif
+}
+
+static void set_nonblocking(Sint64 fd) {
+#ifdef _WIN32
+    u_long nonblocking = 1;
+    ioctlsocket((SOCKET)fd, FIONBIO, &nonblocking);
+#else
+    fcntl((int)fd, F_SETFL, fcntl((int)fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static void set_socket_options(Sint64 fd) {
+    int on = 1;
+    // ticks are small and go out right away
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+// The last call failed because it would have blocked, or a connect is under way
+static bool would_block(void) {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+static bool reserve_bytes(Uint8 **data, size_t *capacity, size_t size) {
+    if(size <= *capacity)
+        return true;
+    size_t grown = SDL_max(*capacity * 2, size);
+    Uint8 *bigger = (Uint8 *)SDL_realloc(*data, grown);
+    if(!bigger)
+        return false;
+    *data = bigger;
+    *capacity = grown;
+    return true;
+}
+
+static int player_count(const AppState *as) {
+    return as->total_human_players + as->total_computer_players;
+}
+
+static size_t keyframe_bound(const AppState *as) {
+    return 16 + 8 * VARINT_MAX_BYTES + (size_t)player_count(as) * (3 * VARINT_MAX_BYTES + 1) +
+           (size_t)as->board.width * as->board.height * (1 + VARINT_MAX_BYTES);
+}
+
+// SPECTATE_KEYFRAME payload of as, see tron_spectate.h. out needs keyframe_bound bytes
+static size_t encode_keyframe(const AppState *as, Uint8 *out) {
+    const Board *board = &as->board;
+    int players = player_count(as);
+    size_t size = put_varint(out, as->tick);
+    size += put_varint(&out[size], (Uint64)board->width);
+    size += put_varint(&out[size], (Uint64)board->height);
+    size += put_varint(&out[size], (Uint64)players);
+    size += put_varint(&out[size], (Uint64)as->total_human_players);
+    size += put_varint(&out[size], (Uint64)as->state);
+    size += put_varint(&out[size], (Uint64)(as->winner + 1));
+    for(int i = 0; i < players; i++) {
+        const CharacterContext *ctx = &as->character_ctx[i];
+        size += put_varint(&out[size], (Uint64)(ctx->head_xpos + 1));
+        size += put_varint(&out[size], (Uint64)(ctx->head_ypos + 1));
+        out[size++] = (Uint8)(ctx->is_alive | ctx->is_invinsible << 1 | (ctx->next_dir & 3) << 2);
+        size += put_varint(&out[size], ctx->invinsible_tick);
+    }
+    size += put_varint(&out[size], board->dead_players);
+    // the cells of the arena row by row, runs of the same stored value (dead cells keep their player's)
+    for(int y = 0; y < board->height; y++) {
+        const Uint8 *row = &board->cells[board_index(board, 0, y)];
+        for(int x = 0; x < board->width; ) {
+            int start = x;
+            while(x < board->width && row[x] == row[start])
+                x++;
+            size += put_varint(&out[size], (Uint64)(x - start));
+            out[size++] = row[start];
+        }
+    }
+    return size;
+}
+
+static bool damaged(void) {
+    return SDL_SetError("damaged spectator stream");
+}
+
+// Make as the match a keyframe describes
+static bool decode_keyframe(AppState *as, const Uint8 *data, size_t size) {
+    Uint64 tick, width, height, players, humans, state, winner, value;
+    size_t pos = 0;
+    if(!get_varint(data, size, &pos, &tick) || !get_varint(data, size, &pos, &width) ||
+       !get_varint(data, size, &pos, &height) || !get_varint(data, size, &pos, &players) ||
+       !get_varint(data, size, &pos, &humans) || !get_varint(data, size, &pos, &state) ||
+       !get_varint(data, size, &pos, &winner) || players < 1 || players > MAX_PLAYERS || humans > players ||
+       state > GAME_OVER || winner > players)
+        return damaged();
+    if(width < BOARD_MIN_SIZE || width > BOARD_MAX_SIZE || height < BOARD_MIN_SIZE || height > BOARD_MAX_SIZE)
+        return damaged();
+    if(!board_init(&as->board, (int)width, (int)height, (int)players))
+        return false;
+
+    SDL_memset(as->character_ctx, 0, sizeof(as->character_ctx));
+    as->remaining_players = 0;
+    for(int i = 0; i < (int)players; i++) {
+        CharacterContext *ctx = &as->character_ctx[i];
+        Uint64 x, y;
+        if(!get_varint(data, size, &pos, &x) || !get_varint(data, size, &pos, &y) || pos >= size ||
+           x > width || y > height)
+            return damaged();
+        Uint8 flags = data[pos++];
+        if(!get_varint(data, size, &pos, &ctx->invinsible_tick))
+            return damaged();
+        ctx->head_xpos = (int)x - 1;
+        ctx->head_ypos = (int)y - 1;
+        ctx->is_alive = flags & 1;
+        ctx->is_invinsible = (flags >> 1) & 1;
+        ctx->next_dir = (char)((flags >> 2) & 3);
+        ctx->player_id = i + 1;
+        ctx->is_human = i < (int)humans;
+        ctx->ai = AI_STRAIGHT;
+        as->remaining_players += ctx->is_alive;
+    }
+    if(!get_varint(data, size, &pos, &value))
+        return damaged();
+    Uint64 dead = value;
+    for(int y = 0; y < (int)height; y++) {
+        for(int x = 0; x < (int)width; ) {
+            if(!get_varint(data, size, &pos, &value) || value == 0 || value > width - x || pos >= size ||
+               data[pos] == CELL_WALL || data[pos] >= CELL_PLAYER(players))
+                return damaged();
+            Cell cell = (Cell)data[pos++];
+            for(int end = x + (int)value; x < end; x++) {
+                if(cell != CELL_NOTHING)
+                    board_set(&as->board, x, y, cell);
+            }
+        }
+    }
+    for(int i = 0; i < (int)players; i++) {
+        if((dead >> i) & 1)
+            board_kill_player(&as->board, CELL_PLAYER(i));
+    }
+
+    as->board_width = (int)width;
+    as->board_height = (int)height;
+    as->total_human_players = (int)humans;
+    as->total_computer_players = (int)(players - humans);
+    as->tick = tick;
+    as->state = (State)state;
+    as->winner = (int)winner - 1;
+    as->scripted = true; // nothing thinks, the stream says where everybody goes
+    as->analysis.valid = false;
+    as->hash = sim_compute_hash(as);
+    return true;
+}
+
+// Play a tick's moves the way sim_step does: dirs is the direction every player alive went, crashed
+// has a bit for the ones that crashed
+static void apply_moves(AppState *as, const Uint8 *dirs, Uint64 crashed) {
+    for(int i = 0; i < player_count(as); i++) {
+        CharacterContext *ctx = &as->character_ctx[i];
+        if(!ctx->is_alive)
+            continue;
+        handle_invinsible(ctx, as->tick);
+        ctx->next_dir = (char)dirs[i];
+        sim_move_head(as, ctx);
+        if((crashed >> i) & 1) {
+            handle_collision(as, ctx->player_id);
+        } else {
+            Cell cell = board_get(&as->board, ctx->head_xpos, ctx->head_ypos);
+            sim_set_cell(as, ctx->head_xpos, ctx->head_ypos, CELL_PLAYER(i));
+            on_player_touch(as, ctx, cell);
+        }
+    }
+    as->tick++;
+}
+
+static void finish_tick(AppState *as) {
+    if(as->remaining_players <= 1) {
+        as->state = GAME_OVER;
+        set_winner(as);
+    }
+}
+
+// Play a SPECTATE_TICK payload on as
+static bool decode_tick(AppState *as, const Uint8 *data, size_t size) {
+    BitReader reader = {data, size, 0};
+    Uint8 dirs[MAX_PLAYERS] = {0};
+    Uint64 crashed = 0;
+    Uint64 value;
+    int cells = as->board.width * as->board.height;
+    if(as->state != RUNNING)
+        return damaged();
+    for(int i = 0; i < player_count(as); i++) {
+        if(!as->character_ctx[i].is_alive)
+            continue;
+        if(!get_bits(&reader, 2, &value))
+            return damaged();
+        dirs[i] = (Uint8)value;
+        if(!get_bits(&reader, 1, &value))
+            return damaged();
+        crashed |= value << i;
+    }
+    apply_moves(as, dirs, crashed);
+    for(;;) {
+        Uint64 index, cell;
+        if(!get_bits(&reader, 1, &value))
+            return damaged();
+        if(!value)
+            break;
+        if(!get_bits(&reader, bits_for((Uint64)cells), &index) || !get_bits(&reader, CELL_BITS, &cell) ||
+           index >= (Uint64)cells || cell == CELL_WALL || cell >= (Uint64)CELL_PLAYER(player_count(as)))
+            return damaged();
+        sim_set_cell(as, (int)index % as->board.width, (int)index / as->board.width, (Cell)cell);
+    }
+    finish_tick(as);
+    return true;
+}
+
+// The spectators see the same match as the server
+static bool same_match(const AppState *a, const AppState *b) {
+    if(a->tick != b->tick || a->state != b->state || a->remaining_players != b->remaining_players ||
+       a->board.dead_players != b->board.dead_players || a->hash != b->hash)
+        return false;
+    for(int i = 0; i < player_count(a); i++) {
+        const CharacterContext *x = &a->character_ctx[i];
+        const CharacterContext *y = &b->character_ctx[i];
+        if(x->head_xpos != y->head_xpos || x->head_ypos != y->head_ypos || x->is_alive != y->is_alive ||
+           x->is_invinsible != y->is_invinsible)
+            return false;
+    }
+    return true;
+}
+
+// Server
+
+static void write_log(SpectateServer *server, const Uint8 *data, size_t size) {
+    while(size > 0) {
+        size_t at = (size_t)(server->log_end & (SPECTATE_LOG_BYTES - 1));
+        size_t chunk = SDL_min(size, SPECTATE_LOG_BYTES - at);
+        SDL_memcpy(&server->log[at], data, chunk);
+        server->log_end += chunk;
+        server->stats.logged += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+static void write_frame(SpectateServer *server, FrameType type, const Uint8 *payload, size_t size) {
+    Uint8 header[1 + VARINT_MAX_BYTES];
+    header[0] = (Uint8)type;
+    write_log(server, header, 1 + put_varint(&header[1], size));
+    write_log(server, payload, size);
+}
+
+// Bring everybody, the mirror included, to as with a keyframe
+static void broadcast_keyframe(SpectateServer *server, const AppState *as) {
+    Uint8 *data = (Uint8 *)SDL_malloc(keyframe_bound(as));
+    if(!data)
+        return;
+    size_t size = encode_keyframe(as, data);
+    // the mirror takes the same path as the spectators so it ends up exactly where they do
+    if(decode_keyframe(&server->mirror, data, size)) {
+        write_frame(server, SPECTATE_KEYFRAME, data, size);
+        server->stats.keyframes++;
+    } else {
+        SDL_Log("Couldn't mirror the match: %s", SDL_GetError());
+        server->has_match = false;
+    }
+    SDL_free(data);
+    server->current_keyframe = -1;
+}
+
+bool spectate_open(SpectateServer *server, Uint16 port) {
+    struct sockaddr_in bound;
+    socklen_t bound_size = sizeof(bound);
+    int on = 1;
+    SDL_zerop(server);
+    server->listen_fd = -1;
+    server->current_keyframe = -1;
+    server->log = (Uint8 *)SDL_malloc(SPECTATE_LOG_BYTES);
+    if(!server->log)
+        return false;
+
+#ifdef _WIN32
+    SOCKET fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(fd == INVALID_SOCKET)
+        return SDL_SetError("Couldn't open a TCP socket: %d", WSAGetLastError());
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(fd < 0)
+        return SDL_SetError("Couldn't open a TCP socket: %s", strerror(errno));
+#endif
+    server->listen_fd = (Sint64)fd;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+    SDL_zero(bound);
+    bound.sin_family = AF_INET;
+    bound.sin_addr.s_addr = SDL_Swap32BE(INADDR_ANY);
+    bound.sin_port = SDL_Swap16BE(port);
+    if(bind(fd, (struct sockaddr *)&bound, sizeof(bound)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        SDL_SetError("Couldn't listen on TCP port %d", port);
+        spectate_close(server);
+        return false;
+    }
+    set_nonblocking(server->listen_fd);
+    if(getsockname(fd, (struct sockaddr *)&bound, &bound_size) == 0)
+        server->port = SDL_Swap16BE(bound.sin_port);
+    return true;
+}
+
+void spectate_close(SpectateServer *server) {
+    for(int i = 0; i < server->count; i++) {
+        close_socket(server->spectators[i].fd);
+    }
+    if(server->listen_fd >= 0)
+        close_socket(server->listen_fd);
+    for(int i = 0; i < SPECTATE_KEYFRAMES; i++) {
+        SDL_free(server->keyframes[i].data);
+    }
+    SDL_free(server->spectators);
+    SDL_free(server->log);
+    sim_free(&server->mirror);
+    server->spectators = NULL;
+    server->log = NULL;
+    server->count = 0;
+    server->listen_fd = -1;
+    SDL_zero(server->keyframes);
+}
+
+void spectate_begin(SpectateServer *server, const AppState *as) {
+    server->has_match = true;
+    broadcast_keyframe(server, as);
+}
+
+void spectate_tick(SpectateServer *server, const AppState *as) {
+    AppState *mirror = &server->mirror;
+    Uint8 payload[SPECTATE_TICK_BYTES];
+    BitWriter writer = {payload, 0};
+    Uint8 dirs[MAX_PLAYERS] = {0};
+    Uint64 crashed = 0;
+    int players = player_count(as);
+    int changes = 0;
+    if(!server->has_match)
+        return;
+    if(mirror->state != RUNNING || as->tick != mirror->tick + 1 || player_count(mirror) != players ||
+       mirror->board.width != as->board.width || mirror->board.height != as->board.height) {
+        broadcast_keyframe(server, as);
+        return;
+    }
+
+    for(int i = 0; i < players; i++) {
+        if(!mirror->character_ctx[i].is_alive)
+            continue;
+        dirs[i] = (Uint8)(as->character_ctx[i].next_dir & 3);
+        put_bits(&writer, dirs[i], 2);
+        put_bits(&writer, !as->character_ctx[i].is_alive, 1);
+        crashed |= (Uint64)!as->character_ctx[i].is_alive << i;
+    }
+    apply_moves(mirror, dirs, crashed);
+    // whatever the moves don't explain, the items spawned
+    if(SDL_memcmp(mirror->board.cells, as->board.cells, as->board.cell_count) != 0) {
+        for(int y = 0; y < as->board.height; y++) {
+            for(int x = 0; x < as->board.width; x++) {
+                Uint8 cell = as->board.cells[board_index(&as->board, x, y)];
+                if(mirror->board.cells[board_index(&mirror->board, x, y)] == cell)
+                    continue;
+                if(++changes > SPECTATE_MAX_CHANGES || cell == CELL_WALL) {
+                    broadcast_keyframe(server, as);
+                    return;
+                }
+                put_bits(&writer, 1, 1);
+                put_bits(&writer, (Uint64)(y * as->board.width + x), bits_for((Uint64)as->board.width * as->board.height));
+                put_bits(&writer, cell, CELL_BITS);
+                sim_set_cell(mirror, x, y, (Cell)cell);
+            }
+        }
+    }
+    put_bits(&writer, 0, 1);
+    finish_tick(mirror);
+    mirror->events = SIM_EVENT_NONE;
+    if(!same_match(mirror, as)) {
+        broadcast_keyframe(server, as);
+        return;
+    }
+    write_frame(server, SPECTATE_TICK, payload, bit_bytes(&writer));
+    server->current_keyframe = -1;
+    server->stats.ticks++;
+    server->stats.cells += changes;
+}
+
+// The keyframe new spectators start from, built once per tick. -1 when every slot is still in use
+static int join_keyframe(SpectateServer *server) {
+    if(server->current_keyframe >= 0)
+        return server->current_keyframe;
+    for(int i = 0; i < SPECTATE_KEYFRAMES; i++) {
+        SpectateKeyframe *keyframe = &server->keyframes[i];
+        if(keyframe->users > 0)
+            continue;
+        size_t bound = SPECTATE_GREETING + 1 + VARINT_MAX_BYTES + (server->has_match ? keyframe_bound(&server->mirror) : 0);
+        if(!reserve_bytes(&keyframe->data, &keyframe->capacity, bound))
+            return -1;
+        SDL_memcpy(keyframe->data, SPECTATE_MAGIC, 4);
+        keyframe->data[4] = SPECTATE_VERSION;
+        keyframe->size = SPECTATE_GREETING;
+        if(server->has_match) {
+            // the payload goes after the header, whose size depends on the payload's
+            Uint8 *payload = &keyframe->data[SPECTATE_GREETING + 1 + VARINT_MAX_BYTES];
+            size_t size = encode_keyframe(&server->mirror, payload);
+            keyframe->data[keyframe->size++] = SPECTATE_KEYFRAME;
+            keyframe->size += put_varint(&keyframe->data[keyframe->size], size);
+            SDL_memmove(&keyframe->data[keyframe->size], payload, size);
+            keyframe->size += size;
+        }
+        keyframe->position = server->log_end;
+        server->current_keyframe = i;
+        return i;
+    }
+    return -1;
+}
+
+static void accept_spectators(SpectateServer *server) {
+    for(;;) {
+        int keyframe = join_keyframe(server);
+        if(keyframe < 0)
+            return; // the rest wait in the backlog
+        if(server->count == server->capacity) {
+            int capacity = SDL_max(server->capacity * 2, 16);
+            Spectator *grown = (Spectator *)SDL_realloc(server->spectators, capacity * sizeof(Spectator));
+            if(!grown)
+                return;
+            server->spectators = grown;
+            server->capacity = capacity;
+        }
+#ifdef _WIN32
+        SOCKET fd = accept((SOCKET)server->listen_fd, NULL, NULL);
+        if(fd == INVALID_SOCKET)
+            return;
+#else
+        int fd = accept((int)server->listen_fd, NULL, NULL);
+        if(fd < 0)
+            return;
+#endif
+        set_nonblocking((Sint64)fd);
+        set_socket_options((Sint64)fd);
+        Spectator *spectator = &server->spectators[server->count++];
+        spectator->fd = (Sint64)fd;
+        spectator->keyframe = keyframe;
+        spectator->keyframe_sent = 0;
+        spectator->position = server->keyframes[keyframe].position;
+        server->keyframes[keyframe].users++;
+        server->stats.spectators++;
+    }
+}
+
+static void drop_spectator(SpectateServer *server, int index) {
+    Spectator *spectator = &server->spectators[index];
+    if(spectator->keyframe >= 0)
+        server->keyframes[spectator->keyframe].users--;
+    close_socket(spectator->fd);
+    server->spectators[index] = server->spectators[--server->count];
+    server->stats.disconnected++;
+}
+
+// Send as much as the socket takes of size bytes, the bytes sent or -1 once the spectator is gone
+static Sint64 send_some(SpectateServer *server, Sint64 fd, const Uint8 *data, size_t size) {
+    Sint64 sent = (Sint64)send(fd, (const char *)data, (int)SDL_min(size, (size_t)SDL_MAX_SINT32), SEND_FLAGS);
+    server->stats.send_calls++;
+    if(sent < 0)
+        return would_block() ? 0 : -1;
+    server->stats.sent += (Uint64)sent;
+    return sent;
+}
+
+// Everything the spectator doesn't have yet, false when it has to go
+static bool send_to(SpectateServer *server, Spectator *spectator) {
+    if(spectator->keyframe >= 0) {
+        SpectateKeyframe *keyframe = &server->keyframes[spectator->keyframe];
+        Sint64 sent = send_some(server, spectator->fd, keyframe->data + spectator->keyframe_sent,
+                                keyframe->size - spectator->keyframe_sent);
+        if(sent < 0)
+            return false;
+        spectator->keyframe_sent += (size_t)sent;
+        if(spectator->keyframe_sent < keyframe->size)
+            return true;
+        keyframe->users--;
+        spectator->keyframe = -1;
+    }
+    if(server->log_end - spectator->position > SPECTATE_LOG_BYTES) {
+        server->stats.too_slow++;
+        return false;
+    }
+    while(spectator->position < server->log_end) {
+        size_t at = (size_t)(spectator->position & (SPECTATE_LOG_BYTES - 1));
+        size_t chunk = (size_t)SDL_min(server->log_end - spectator->position, (Uint64)(SPECTATE_LOG_BYTES - at));
+        Sint64 sent = send_some(server, spectator->fd, &server->log[at], chunk);
+        if(sent < 0)
+            return false;
+        spectator->position += (Uint64)sent;
+        if((size_t)sent < chunk)
+            break; // the socket's buffer is full
+    }
+    return true;
+}
+
+void spectate_poll(SpectateServer *server) {
+    if(server->listen_fd < 0)
+        return;
+    accept_spectators(server);
+    for(int i = 0; i < server->count; ) {
+        if(send_to(server, &server->spectators[i]))
+            i++;
+        else
+            drop_spectator(server, i);
+    }
+}
+
+// Viewer
+
+bool spectate_connect(SpectateViewer *viewer, const NetAddress *address) {
+    struct sockaddr_in to;
+    SDL_zerop(viewer);
+    viewer->fd = -1;
+#ifdef _WIN32
+    SOCKET fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(fd == INVALID_SOCKET)
+        return SDL_SetError("Couldn't open a TCP socket: %d", WSAGetLastError());
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(fd < 0)
+        return SDL_SetError("Couldn't open a TCP socket: %s", strerror(errno));
+#endif
+    viewer->fd = (Sint64)fd;
+    set_nonblocking(viewer->fd);
+    set_socket_options(viewer->fd);
+    SDL_zero(to);
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = SDL_Swap32BE(address->host);
+    to.sin_port = SDL_Swap16BE(address->port);
+    if(connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0 && !would_block()) {
+        SDL_SetError("Couldn't connect to port %d", address->port);
+        spectate_disconnect(viewer);
+        return false;
+    }
+    return true;
+}
+
+void spectate_disconnect(SpectateViewer *viewer) {
+    if(viewer->fd >= 0)
+        close_socket(viewer->fd);
+    SDL_free(viewer->buffer);
+    SDL_zerop(viewer);
+    viewer->fd = -1;
+}
+
+// Play the frames that came in whole, the bytes used up or -1 when they make no sense
+static Sint64 parse_frames(SpectateViewer *viewer, AppState *as) {
+    size_t pos = 0;
+    if(!viewer->greeted) {
+        if(viewer->size < SPECTATE_GREETING)
+            return 0;
+        if(SDL_memcmp(viewer->buffer, SPECTATE_MAGIC, 4) != 0 || viewer->buffer[4] != SPECTATE_VERSION) {
+            SDL_SetError("not a version %d spectator stream", SPECTATE_VERSION);
+            return -1;
+        }
+        viewer->greeted = true;
+        pos = SPECTATE_GREETING;
+    }
+    for(;;) {
+        size_t start = pos + 1;
+        Uint64 length;
+        if(pos >= viewer->size || !get_varint(viewer->buffer, viewer->size, &start, &length) ||
+           length > viewer->size - start)
+            return (Sint64)pos; // not all there yet
+        const Uint8 *payload = &viewer->buffer[start];
+        bool played;
+        switch(viewer->buffer[pos]) {
+        case SPECTATE_KEYFRAME:
+            played = decode_keyframe(as, payload, (size_t)length);
+            viewer->has_match = viewer->has_match || played;
+            break;
+        case SPECTATE_TICK:
+            played = viewer->has_match && decode_tick(as, payload, (size_t)length);
+            break;
+        default:
+            played = damaged();
+            break;
+        }
+        if(!played)
+            return -1;
+        viewer->frames++;
+        pos = start + (size_t)length;
+    }
+}
+
+bool spectate_receive(SpectateViewer *viewer, AppState *as) {
+    if(viewer->fd < 0)
+        return false;
+    for(;;) {
+        if(!reserve_bytes(&viewer->buffer, &viewer->capacity, viewer->size + SPECTATE_RECEIVE))
+            return false;
+        Sint64 got = (Sint64)recv(viewer->fd, (char *)viewer->buffer + viewer->size, SPECTATE_RECEIVE, 0);
+        if(got == 0)
+            return SDL_SetError("The server closed the stream");
+        if(got < 0) {
+            if(would_block())
+                break;
+            return SDL_SetError("Lost the server");
+        }
+        viewer->size += (size_t)got;
+        viewer->received += (Uint64)got;
+    }
+    Sint64 used = parse_frames(viewer, as);
+    if(used < 0)
+        return false;
+    viewer->size -= (size_t)used;
+    SDL_memmove(viewer->buffer, viewer->buffer + used, viewer->size);
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+  Live matches streamed to spectators over TCP.
+
+  The game broadcasts whatever it plays with --broadcast PORT and another copy watches it with
+  --watch HOST:PORT. tron_spectators puts a thousand or more spectators on one server over loopback
+  and reports what they cost.
+
+  The stream is a run of frames, a type byte and a varint length before the payload:
+
+    SPECTATE_KEYFRAME  the whole match: tick, arena, players, state, every player's head and star
+                       power, the dead players and the cells run-length encoded
+    SPECTATE_TICK      one step, bit-packed: for every player still alive 2 bits of direction and
+                       a bit for crashing, then the cells that changed besides the heads (the items
+                       spawned), each a 1 bit, its index in as few bits as the arena needs and its
+                       value, closed by a 0 bit
+
+  A spectator plays the ticks on its own copy of the match with the same rules as sim_step, moving
+  the heads and crashing the players it is told to, so the four players of the default arena cost
+  2 bytes a tick plus the frame's 2. The server keeps a copy made the same way (the mirror) and
+  compares it with the real match after every tick: any cell the moves don't explain goes in the
+  tick, and when the mirror can't be brought back that way (the game rolled back, scrubbed or
+  started another match) a keyframe goes out to everybody instead.
+
+  Fan-out: every frame is written once, into a ring (the log) all spectators read from at their own
+  position, and sent from there with no copy per spectator. A spectator that connects gets the
+  keyframe of the tick it connected on, built once and shared by everybody who connected on that
+  tick, and then the log from where it was when it connected. A spectator that falls a whole log
+  behind is disconnected.
+
+    spectate_open(&server, port);
+    spectate_begin(&server, as);     // a new match
+    ...every step
+    sim_step(as);
+    spectate_tick(&server, as);
+    ...every frame
+    spectate_poll(&server);          // connect spectators and send
+
+  and on the other side
+
+    spectate_connect(&viewer, &address);
+    ...every frame
+    spectate_receive(&viewer, as);   // as plays what came in
+*/
+#ifndef TRON_SPECTATE_H
+#define TRON_SPECTATE_H
+
+#include "tron_sim.h"
+#include "tron_net.h" // NetAddress, net_init
+
+#define SPECTATE_DEFAULT_PORT 7778
+#define SPECTATE_LOG_BYTES    (1 << 20) // shared frames, a power of two
+#define SPECTATE_KEYFRAMES    8         // keyframes being sent to new spectators at once
+#define SPECTATE_RECEIVE      4096      // read from the socket at once
+
+// A keyframe being sent to the spectators that connected on its tick
+typedef struct
+{
+    Uint8 *data;
+    size_t size;
+    size_t capacity;
+    Uint64 position; // log position the spectators continue from
+    int users;       // spectators still sending it
+} SpectateKeyframe;
+
+typedef struct
+{
+    Sint64 fd;
+    int keyframe;     // SpectateKeyframe being sent, -1 once it went out
+    size_t keyframe_sent;
+    Uint64 position;  // in the log, of the next byte to send
+} Spectator;
+
+typedef struct
+{
+    Uint64 spectators;  // connected so far
+    Uint64 disconnected;
+    Uint64 too_slow;    // disconnected for falling a log behind
+    Uint64 ticks;
+    Uint64 keyframes;   // broadcast to everybody, the ones for new spectators aren't counted
+    Uint64 cells;       // cell changes sent in ticks
+    Uint64 logged;      // bytes written to the log
+    Uint64 sent;        // bytes sent to all spectators
+    Uint64 send_calls;
+} SpectateStats;
+
+typedef struct
+{
+    Sint64 listen_fd;
+    Uint16 port;
+    Spectator *spectators;
+    int count;
+    int capacity;
+    Uint8 *log;         // SPECTATE_LOG_BYTES
+    Uint64 log_end;     // bytes written to the log ever, positions count from the first one
+    SpectateKeyframe keyframes[SPECTATE_KEYFRAMES];
+    int current_keyframe; // of the mirror's tick, -1 when there is none
+    AppState mirror;    // the match as the spectators have it
+    bool has_match;
+    SpectateStats stats;
+} SpectateServer;
+
+typedef struct
+{
+    Sint64 fd;
+    Uint8 *buffer;      // received and not parsed yet
+    size_t size;
+    size_t capacity;
+    bool greeted;       // got the magic
+    bool has_match;     // got a keyframe
+    Uint64 received;
+    Uint64 frames;
+} SpectateViewer;
+
+// Functions returning bool set SDL_GetError on failure. net_init has to be called first
+
+// port 0 takes any free port, see SpectateServer.port
+bool spectate_open(SpectateServer *server, Uint16 port);
+void spectate_close(SpectateServer *server);
+// as started a new match, send it to everybody
+void spectate_begin(SpectateServer *server, const AppState *as);
+// as played a tick, send what changed. Anything else it went through (a new match, a rollback) is
+// sent as a keyframe
+void spectate_tick(SpectateServer *server, const AppState *as);
+// Connect new spectators and send everybody what they don't have yet. Never blocks
+void spectate_poll(SpectateServer *server);
+
+bool spectate_connect(SpectateViewer *viewer, const NetAddress *address);
+void spectate_disconnect(SpectateViewer *viewer);
+// Play everything received so far on as, which the viewer owns from the first keyframe on (sim_free
+// it when done). Returns false once the connection is closed or the stream makes no sense
+bool spectate_receive(SpectateViewer *viewer, AppState *as);
+
+#endif // TRON_SPECTATE_H
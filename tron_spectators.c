@@ -0,0 +1,226 @@
+/*
+  Puts a crowd of spectators on one spectator server over loopback TCP and reports what they cost.
+
+  usage: tron_spectators [--spectators N] [--matches N] [--players N] [--width N] [--height N]
+                         [--seed N] [--step-ms N] [--port N]
+
+  The server broadcasts computer vs computer matches (tron_spectate.h) and all --spectators (1000 by
+  default) watch from this same process, each with its own socket and copy of the match. They
+  connect over the first JOIN_TICKS ticks of the first match, so most of them start from a shared
+  join keyframe in the middle of it. --step-ms sets the tick length, 10 ms by default so a run
+  doesn't take long, the bandwidth is reported for the game's 60 ms ticks either way.
+
+  At the end of every match each spectator's copy has to be the same as the server's, anything else
+  is reported and the exit code is 1. Reported per match: the bytes a spectator got per tick (and per
+  second at 60 ms ticks), what a full board every tick would have taken instead, and the time the
+  server spent per tick and per spectator in spectate_tick and spectate_poll.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+#include "tron_spectate.h"
+
+#define JOIN_TICKS     50
+#define DRAIN_TIMEOUT_NS (10 * SDL_NS_PER_SECOND)
+
+typedef struct
+{
+    SpectateViewer viewer;
+    AppState as;
+} Watcher;
+
+// A socket per spectator and the server's own
+static void raise_file_limit(int spectators) {
+#ifndef _WIN32
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return;
+    rlim_t wanted = (rlim_t)spectators * 2 + 64; // both ends are in this process
+    if(limit.rlim_cur >= wanted)
+        return;
+    limit.rlim_cur = limit.rlim_max == RLIM_INFINITY ? wanted : SDL_min(wanted, limit.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if(limit.rlim_cur < wanted)
+        fprintf(stderr, "only %d files can be open, some spectators won't connect\n", (int)limit.rlim_cur);
+#else
+    (void)spectators;
+#endif
+}
+
+// What a spectator sees has to be what was played
+static bool same_view(const AppState *view, const AppState *as) {
+    int players = as->total_human_players + as->total_computer_players;
+    if(view->tick != as->tick || view->state != as->state || view->winner != as->winner || view->hash != as->hash ||
+       view->remaining_players != as->remaining_players || view->board.dead_players != as->board.dead_players ||
+       view->board.cell_count != as->board.cell_count || view->board.free_count != as->board.free_count ||
+       memcmp(view->board.cells, as->board.cells, as->board.cell_count) != 0)
+        return false;
+    for(int i = 0; i < players; i++) {
+        const CharacterContext *x = &view->character_ctx[i];
+        const CharacterContext *y = &as->character_ctx[i];
+        if(x->head_xpos != y->head_xpos || x->head_ypos != y->head_ypos || x->is_alive != y->is_alive ||
+           x->is_invinsible != y->is_invinsible)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int spectators = 1000;
+    int matches = 3;
+    int players = TRON_DEFAULT_PLAYERS;
+    Uint64 seed = 0;
+    Uint64 step_ns = 10 * SDL_NS_PER_MS;
+    int port = 0;
+    SpectateServer server;
+    NetAddress address;
+    int connected = 0;
+    int failures = 0;
+
+    AppState *as = (AppState *)SDL_calloc(1, sizeof(AppState));
+    if(!as)
+        return 1;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--spectators") == 0 && i + 1 < argc) {
+            spectators = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--matches") == 0 && i + 1 < argc) {
+            matches = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            as->board_width = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            as->board_height = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--step-ms") == 0 && i + 1 < argc) {
+            int step_ms = atoi(argv[++i]);
+            step_ns = (Uint64)SDL_max(step_ms, 0) * SDL_NS_PER_MS;
+        } else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--spectators N] [--matches N] [--players N] [--width N] [--height N] [--seed N] [--step-ms N] [--port N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(players < 2 || players > MAX_PLAYERS) {
+        fprintf(stderr, "--players must be between 2 and %d\n", MAX_PLAYERS);
+        return 1;
+    }
+    if(spectators < 1) {
+        fprintf(stderr, "--spectators must be at least 1\n");
+        return 1;
+    }
+
+    raise_file_limit(spectators);
+    Watcher *watchers = (Watcher *)SDL_calloc((size_t)spectators, sizeof(Watcher));
+    if(!watchers || !net_init() || !spectate_open(&server, (Uint16)port)) {
+        fprintf(stderr, "Couldn't start the server: %s\n", SDL_GetError());
+        return 1;
+    }
+    address.host = 0x7F000001; // 127.0.0.1
+    address.port = server.port;
+    printf("loopback port %d, %d spectators, %" SDL_PRIu64 " ms ticks\n", address.port, spectators, step_ns / SDL_NS_PER_MS);
+
+    for(int m = 0; m < matches; m++) {
+        Uint64 server_ns = 0;
+        Uint64 ticks = 0;
+        SpectateStats before = server.stats;
+        as->seed = seed + m;
+        if(!sim_init_match(as, 0, players)) {
+            fprintf(stderr, "Couldn't start match %d: %s\n", m, SDL_GetError());
+            return 1;
+        }
+        Uint64 start = SDL_GetTicksNS();
+        spectate_begin(&server, as);
+        server_ns += SDL_GetTicksNS() - start;
+
+        Uint64 next_step = SDL_GetTicksNS();
+        Uint64 drain_start = 0;
+        for(;;) {
+            // the crowd comes in during the first match
+            int joining = m > 0 || sim_is_over(as) ? spectators : (int)((Sint64)spectators * (Sint64)SDL_min(as->tick + 1, JOIN_TICKS) / JOIN_TICKS);
+            for(; connected < joining; connected++) {
+                if(!spectate_connect(&watchers[connected].viewer, &address)) {
+                    fprintf(stderr, "spectator %d couldn't connect: %s\n", connected, SDL_GetError());
+                    return 1;
+                }
+            }
+
+            bool stepped = false;
+            if(!sim_is_over(as) && SDL_GetTicksNS() >= next_step) {
+                sim_step(as);
+                as->events = SIM_EVENT_NONE;
+                start = SDL_GetTicksNS();
+                spectate_tick(&server, as);
+                server_ns += SDL_GetTicksNS() - start;
+                next_step += step_ns;
+                ticks++;
+                stepped = true;
+            }
+            start = SDL_GetTicksNS();
+            spectate_poll(&server);
+            server_ns += SDL_GetTicksNS() - start;
+
+            bool caught_up = true;
+            for(int i = 0; i < connected; i++) {
+                Watcher *watcher = &watchers[i];
+                if(!spectate_receive(&watcher->viewer, &watcher->as)) {
+                    fprintf(stderr, "spectator %d: %s\n", i, SDL_GetError());
+                    return 1;
+                }
+                caught_up = caught_up && watcher->viewer.has_match && watcher->as.tick == as->tick && watcher->as.state == as->state;
+            }
+            if(sim_is_over(as)) {
+                if(caught_up && connected == spectators)
+                    break;
+                if(!drain_start)
+                    drain_start = SDL_GetTicksNS();
+                if(SDL_GetTicksNS() - drain_start > DRAIN_TIMEOUT_NS) {
+                    fprintf(stderr, "the spectators didn't catch up with match %d\n", m);
+                    return 1;
+                }
+            }
+            if(!stepped)
+                SDL_Delay(1);
+        }
+
+        int wrong = 0;
+        for(int i = 0; i < spectators; i++) {
+            wrong += !same_view(&watchers[i].as, as);
+        }
+        Uint64 sent = server.stats.sent - before.sent;
+        Uint64 keyframes = server.stats.keyframes - before.keyframes;
+        double per_tick = (double)sent / spectators / SDL_max(ticks, 1);
+        size_t full_board = (size_t)as->board.width * as->board.height;
+        printf("match %d: seed %" SDL_PRIu64 ", %" SDL_PRIu64 " ticks, %d of %d spectators agree\n",
+               m, seed + m, ticks, spectators - wrong, spectators);
+        printf("  %.1f bytes per spectator per tick, %.0f bytes/s at 60 ms ticks (a full board: %zu bytes, %.0f bytes/s)\n",
+               per_tick, per_tick * 1000 / 60, full_board, full_board * 1000.0 / 60);
+        printf("  %" SDL_PRIu64 " keyframes to everybody, %" SDL_PRIu64 " cell changes, %" SDL_PRIu64 " sends\n",
+               keyframes, server.stats.cells - before.cells, server.stats.send_calls - before.send_calls);
+        printf("  server %.1f us per tick, %.0f ns per tick per spectator\n",
+               server_ns / 1000.0 / SDL_max(ticks, 1), (double)server_ns / SDL_max(ticks, 1) / spectators);
+        failures += wrong > 0;
+    }
+    printf("%" SDL_PRIu64 " spectators connected, %" SDL_PRIu64 " disconnected (%" SDL_PRIu64 " too slow)\n",
+           server.stats.spectators, server.stats.disconnected, server.stats.too_slow);
+
+    for(int i = 0; i < connected; i++) {
+        spectate_disconnect(&watchers[i].viewer);
+        sim_free(&watchers[i].as);
+    }
+    spectate_close(&server);
+    SDL_free(watchers);
+    sim_free(as);
+    SDL_free(as);
+    net_quit();
+    SDL_Quit();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+  Plays computer vs computer matches on every core and reports how each AI does.
+
+  usage: tron_tournament [--matches N] [--threads N] [--width N] [--height N] [--players N]
+                         [--ai TYPE[,TYPE...]] [--ai-budget-ms N] [--seed N]
+
+  --ai lists the strategies taking part (classic, voronoi, search or mcts), one per seat with the
+  last one filling any seat left over, the same as tron_headless. Seats are rotated every match so
+  no AI keeps the same starting position: in match m seat s plays entry (s + m) % players.
+
+  Match m is played with seed --seed + m, so the results of the deterministic AIs don't depend on
+  how many threads there are (as long as nobody runs out of thinking time, see tron_ai.h). MCTS
+  and the search play as far as their budget gets them, so theirs depend on how fast a worker runs,
+  and with that on the machine and its load.
+
+  Every worker has its own AppState and its own tallies, the only thing the workers share is the
+  counter handing out match numbers. --threads defaults to one per core. MCTS runs single threaded
+  in every worker, on a tree of the worker's own, whatever --threads is, the workers already keep
+  the cores busy.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+#include "tron_sim.h"
+#include "tron_ai.h"
+
+typedef struct
+{
+    SDL_Thread *thread;
+    AppState *as;
+    int wins[AI_TYPE_COUNT];  // by AI, not seat
+    int seats[AI_TYPE_COUNT]; // how many seats each AI played
+    int draws;
+    int matches;
+    Uint64 ticks;
+    bool failed;
+} Worker;
+
+typedef struct
+{
+    int matches;
+    int players;
+    AiType ais[MAX_PLAYERS]; // one per seat
+    Uint64 seed;
+    Uint64 ai_budget_ns;
+    int width;
+    int height;
+    SDL_AtomicInt next_match;
+} Tournament;
+
+static Tournament tournament;
+
+static int SDLCALL run_worker(void *data) {
+    Worker *shared = (Worker *)data;
+    // tallied locally and handed over at the end, the workers sit next to each other in memory
+    Worker tally = *shared;
+    Worker *worker = &tally;
+    AppState *as = worker->as;
+    int players = tournament.players;
+
+    as->board_width = tournament.width;
+    as->board_height = tournament.height;
+    as->ai_budget_ns = tournament.ai_budget_ns;
+    for(;;) {
+        int m = SDL_AddAtomicInt(&tournament.next_match, 1);
+        if(m >= tournament.matches)
+            break;
+        as->seed = tournament.seed + (Uint64)m;
+        if(!sim_init_match(as, 0, players)) {
+            fprintf(stderr, "couldn't start a match: %s\n", SDL_GetError());
+            worker->failed = true;
+            break;
+        }
+        for(int s = 0; s < players; s++) {
+            as->character_ctx[s].ai = tournament.ais[(s + m) % players];
+            worker->seats[as->character_ctx[s].ai]++;
+        }
+        while(!sim_is_over(as)) {
+            sim_step(as);
+        }
+
+        bool draw = true;
+        for(int s = 0; s < players; s++) {
+            if(as->character_ctx[s].is_alive) {
+                worker->wins[as->character_ctx[s].ai]++;
+                draw = false;
+            }
+        }
+        worker->draws += draw;
+        worker->matches++;
+        worker->ticks += as->tick;
+    }
+    *shared = tally;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = 0;
+    AiType listed[MAX_PLAYERS] = {AI_STRAIGHT};
+    int listed_count = 1;
+    Worker *workers;
+    Uint64 start_time;
+    double elapsed;
+    bool failed = false;
+
+    tournament.matches = 1000;
+    tournament.players = TRON_DEFAULT_PLAYERS;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--matches") == 0 && i + 1 < argc) {
+            tournament.matches = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            tournament.width = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            tournament.height = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--players") == 0 && i + 1 < argc) {
+            tournament.players = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            tournament.seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--ai") == 0 && i + 1 < argc) {
+            listed_count = ai_parse_types(argv[++i], listed, MAX_PLAYERS);
+            if(listed_count == 0) {
+                fprintf(stderr, "%s\n", SDL_GetError());
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--ai-budget-ms") == 0 && i + 1 < argc) {
+            tournament.ai_budget_ns = SDL_MS_TO_NS(strtoull(argv[++i], NULL, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--matches N] [--threads N] [--width N] [--height N] [--players N] [--ai TYPE[,TYPE...]] [--ai-budget-ms N] [--seed N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(tournament.players < 2 || tournament.players > MAX_PLAYERS) {
+        fprintf(stderr, "--players must be between 2 and %d\n", MAX_PLAYERS);
+        return 1;
+    }
+    if(threads <= 0)
+        threads = SDL_GetNumLogicalCPUCores();
+    threads = SDL_clamp(threads, 1, SDL_max(tournament.matches, 1));
+    ai_set_thread_count(1); // no MCTS pool shared between workers, see pick_mcts_dir
+    for(int s = 0; s < tournament.players; s++) {
+        tournament.ais[s] = listed[SDL_min(s, listed_count - 1)];
+    }
+
+    workers = (Worker *)SDL_calloc((size_t)threads, sizeof(Worker));
+    if(!workers)
+        return 1;
+    for(int t = 0; t < threads; t++) {
+        workers[t].as = (AppState *)SDL_calloc(1, sizeof(AppState));
+        if(!workers[t].as)
+            return 1;
+    }
+
+    start_time = SDL_GetTicksNS();
+    for(int t = 0; t < threads; t++) {
+        workers[t].thread = SDL_CreateThread(run_worker, "tournament", &workers[t]);
+        if(!workers[t].thread) {
+            // whoever did start plays the rest
+            fprintf(stderr, "couldn't start worker %d: %s\n", t, SDL_GetError());
+            if(t == 0)
+                return 1;
+            threads = t;
+            break;
+        }
+    }
+
+    int wins[AI_TYPE_COUNT] = {0};
+    int seats[AI_TYPE_COUNT] = {0};
+    int draws = 0;
+    int matches = 0;
+    Uint64 ticks = 0;
+    for(int t = 0; t < threads; t++) {
+        Worker *worker = &workers[t];
+        SDL_WaitThread(worker->thread, NULL);
+        for(int ai = 0; ai < AI_TYPE_COUNT; ai++) {
+            wins[ai] += worker->wins[ai];
+            seats[ai] += worker->seats[ai];
+        }
+        draws += worker->draws;
+        matches += worker->matches;
+        ticks += worker->ticks;
+        failed |= worker->failed;
+        sim_free(worker->as);
+        SDL_free(worker->as);
+    }
+    elapsed = (double)(SDL_GetTicksNS() - start_time) / SDL_NS_PER_SECOND;
+    SDL_free(workers);
+    ai_shutdown();
+
+    printf("matches:         %d on %d threads\n", matches, threads);
+    printf("avg match ticks: %.1f\n", matches ? (double)ticks / matches : 0.0);
+    printf("matches/sec:     %.0f\n", elapsed > 0 ? matches / elapsed : 0.0);
+    printf("ticks/sec:       %.0f\n", elapsed > 0 ? ticks / elapsed : 0.0);
+    // a seat wins at most once a match, so wins / seats is the chance a seat of that AI wins
+    for(int ai = 0; ai < AI_TYPE_COUNT; ai++) {
+        if(seats[ai] == 0)
+            continue;
+        printf("%-8s win rate: %5.1f%% (%d wins in %d seats)\n", ai_type_name((AiType)ai),
+               100.0 * wins[ai] / seats[ai], wins[ai], seats[ai]);
+    }
+    printf("draws:           %.1f%% (%d)\n", matches ? 100.0 * draws / matches : 0.0, draws);
+
+    SDL_Quit();
+    return failed ? 1 : 0;
+}